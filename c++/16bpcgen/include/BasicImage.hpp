@@ -0,0 +1,131 @@
+#ifndef BPCGEN_BASICIMAGE_HPP_
+#define BPCGEN_BASICIMAGE_HPP_
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+#include "FramePool.hpp"
+#include "Image.hpp"
+
+template <typename T>
+class BasicImage{
+public:
+	typedef Pixel<T> pixel_type;
+	typedef BasicRow<T> row_type;
+	typedef BasicConstRow<T> const_row_type;
+	static const byte_t pixelsize = sizeof(pixel_type);
+	BasicImage(const column_t& a_width, const row_t& a_height):
+		head_(NULL), width_(a_width), height_(a_height), pitch_(Image::default_pitch(a_width, pixelsize))
+	{
+		head_ = FramePool::instance().acquire(data_size());
+	}
+	explicit BasicImage(const Image& image):
+		head_(NULL), width_(image.width()), height_(image.height()), pitch_(Image::default_pitch(image.width(), pixelsize))
+	{
+		head_ = FramePool::instance().acquire(data_size());
+		convert(image);
+	}
+	template <typename U>
+	explicit BasicImage(const BasicImage<U>& image):
+		head_(NULL), width_(image.width()), height_(image.height()), pitch_(Image::default_pitch(image.width(), pixelsize))
+	{
+		head_ = FramePool::instance().acquire(data_size());
+		convert(image);
+	}
+	BasicImage(const BasicImage& image):
+		head_(NULL), width_(image.width()), height_(image.height()), pitch_(image.pitch())
+	{
+		head_ = FramePool::instance().acquire(data_size());
+		std::copy(image.head(), image.head() + data_size(), head_);
+	}
+	BasicImage& operator=(const BasicImage& image)
+	{
+		BasicImage tmp(image);
+		return swap(tmp);
+	}
+	~BasicImage(){FramePool::instance().release(head_, data_size());}
+	const_row_type operator[](row_t row)const{return const_row_type(head_ + row*pitch_, width_, pitch_);}
+	row_type operator[](row_t row){return row_type(head_ + row*pitch_, width_, pitch_);}
+	Image image()const
+	{
+		Image result(width(), height());
+		for(row_t h = 0; h < height(); ++h){
+			const const_row_type src = (*this)[h];
+			const Row dst = result[h];
+			for(column_t w = 0; w < width(); ++w){
+				dst[w] = Image::pixel_type(src[w]);
+			}
+		}
+		return result;
+	}
+	const BasicImage& write(const std::string& filename)const;
+	const BasicImage& operator>>(const std::string& filename)const{return write(filename);}
+	BasicImage& swap(BasicImage& rhs)
+	{
+		std::swap(head_,   rhs.head_);
+		std::swap(width_,  rhs.width_);
+		std::swap(height_, rhs.height_);
+		std::swap(pitch_,  rhs.pitch_);
+		return *this;
+	}
+	const byte_t* head()const{return head_;}
+	      byte_t* head(){return head_;}
+	const column_t& width()const{return width_;}
+	const row_t& height()const{return height_;}
+	std::size_t pitch()const{return pitch_;}
+	std::size_t row_size()const{return static_cast<std::size_t>(width_)*pixelsize;}
+	std::size_t data_size()const{return height_*pitch_;}
+private:
+	static uint16_t quantize(T value)
+	{
+		const double max = Pixel<uint16_t>::max;
+		return static_cast<uint16_t>(std::min(std::max(0.0, static_cast<double>(value)*max/static_cast<double>(pixel_type::max)), max));
+	}
+	template <typename I>
+	void convert(const I& image)
+	{
+		for(row_t h = 0; h < height(); ++h){
+			const BasicConstRow<typename I::pixel_type::value_type> src = image[h];
+			const row_type dst = (*this)[h];
+			for(column_t w = 0; w < width(); ++w){
+				dst[w] = pixel_type(src[w]);
+			}
+		}
+	}
+	byte_t* head_;
+	column_t width_;
+	row_t height_;
+	std::size_t pitch_;
+};
+
+template <typename T>
+const byte_t BasicImage<T>::pixelsize;
+
+typedef BasicImage<uint8_t>  Image8;
+typedef BasicImage<uint16_t> Image16;
+typedef BasicImage<float>    ImageF;
+
+template <>
+const Image8& Image8::write(const std::string& filename)const;
+template <>
+const Image16& Image16::write(const std::string& filename)const;
+
+/**
+ * 8bitと16bit以外の画素は、値域に収めて16bitへ量子化してから書き出す。
+ */
+template <typename T>
+const BasicImage<T>& BasicImage<T>::write(const std::string& filename)const
+{
+	Image16 quantized(width(), height());
+	for(row_t h = 0; h < height(); ++h){
+		const const_row_type src = (*this)[h];
+		const Image16::row_type dst = quantized[h];
+		for(column_t w = 0; w < width(); ++w){
+			dst[w] = Image16::pixel_type(quantize(src[w].R()), quantize(src[w].G()), quantize(src[w].B()));
+		}
+	}
+	quantized.write(filename);
+	return *this;
+}
+
+#endif
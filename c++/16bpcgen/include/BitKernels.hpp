@@ -0,0 +1,31 @@
+#ifndef BPCGEN_BITKERNELS_HPP_
+#define BPCGEN_BITKERNELS_HPP_
+
+#include <cstddef>
+#include "typedef.hpp"
+
+class BitKernels{
+public:
+	enum Isa{
+		ISA_SCALAR,
+		ISA_SSE2,
+		ISA_AVX2,
+		ISA_AVX512
+	};
+	static void bit_and(uint16_t* dst, const uint16_t* src, std::size_t size);
+	static void bit_or(uint16_t* dst, const uint16_t* src, std::size_t size);
+	static void mask_and(uint16_t* dst, const uint16_t* mask, std::size_t size);
+	static void mask_or(uint16_t* dst, const uint16_t* mask, std::size_t size);
+	static void mask_xor(uint16_t* dst, const uint16_t* mask, std::size_t size);
+	static void add_saturate(uint16_t* dst, const uint16_t* addend, std::size_t size);
+	static void subtract_saturate(uint16_t* dst, const uint16_t* subtrahend, std::size_t size);
+	static void shift_left(uint16_t* dst, std::size_t size, byte_t shift);
+	static void shift_right(uint16_t* dst, std::size_t size, byte_t shift);
+	static Isa isa();
+	static Isa supported();
+	static void set_isa(Isa isa);
+private:
+	static Isa& selected();
+};
+
+#endif
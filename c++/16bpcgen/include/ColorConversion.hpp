@@ -0,0 +1,66 @@
+#ifndef BPCGEN_COLORCONVERSION_HPP_
+#define BPCGEN_COLORCONVERSION_HPP_
+
+#include <vector>
+#include "Image.hpp"
+
+class ColorConversion{
+public:
+	typedef Image::pixel_type pixel_type;
+	typedef pixel_type::ColorSpace ColorSpace;
+	enum{
+		OUT_OF_RANGE = 0x1,
+		OUT_OF_GAMUT = 0x2
+	};
+	enum Precision{
+		PREC_DOUBLE,
+		PREC_FIXED
+	};
+	explicit ColorConversion(ColorSpace cs, Precision precision = PREC_DOUBLE);
+	ColorSpace color_space()const{return cs_;}
+	Precision precision()const{return precision_;}
+	std::size_t from_rgb(const pixel_type* first, const pixel_type* last, pixel_type* result, byte_t* mask = NULL)const;
+	std::size_t to_rgb(const pixel_type* first, const pixel_type* last, pixel_type* result, byte_t* mask = NULL)const;
+	Image from_rgb(const Image& image, std::vector<byte_t>* mask = NULL)const;
+	Image to_rgb(const Image& image, std::vector<byte_t>* mask = NULL)const;
+private:
+	class Affine{
+	public:
+		Affine();
+		void invert(const Affine& affine);
+		std::size_t apply(const pixel_type* first, const pixel_type* last, pixel_type* result, byte_t* mask)const;
+		double matrix_[3][3];
+		double offset_in_[3];
+		double offset_out_[3];
+		double lower_[3];
+		double upper_[3];
+	};
+	class Fixed{
+	public:
+		Fixed();
+		void setup(const Affine& forward, const Affine& inverse);
+		std::size_t forward(const pixel_type* first, const pixel_type* last, pixel_type* result, byte_t* mask)const;
+		std::size_t inverse(const pixel_type* first, const pixel_type* last, pixel_type* result, byte_t* mask)const;
+	private:
+		uint32_t forward_[3][3];
+		uint32_t complement_[3][3];
+		uint32_t constant_[3];
+		int inverse_[3][3];
+		int offset_[3];
+		int lower_[3];
+		int upper_[3];
+	};
+	static std::size_t hsv(const pixel_type* first, const pixel_type* last, pixel_type* result, byte_t* mask);
+	static std::size_t hsv_fixed(const pixel_type* first, const pixel_type* last, pixel_type* result, byte_t* mask);
+	static std::size_t hsv_to_rgb(const pixel_type* first, const pixel_type* last, pixel_type* result, byte_t* mask);
+	static std::size_t hsv_to_rgb_fixed(const pixel_type* first, const pixel_type* last, pixel_type* result, byte_t* mask);
+	static std::size_t rgb(const pixel_type* first, const pixel_type* last, pixel_type* result, byte_t* mask);
+	Image convert(const Image& image, std::vector<byte_t>* mask, bool forward)const;
+	ColorSpace cs_;
+	Precision precision_;
+	Affine forward_;
+	Affine inverse_;
+	Fixed fixed_;
+};
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef BPCGEN_COMPOSITOR_HPP_
+#define BPCGEN_COMPOSITOR_HPP_
+
+#include <vector>
+#include "Image.hpp"
+
+class Compositor{
+public:
+	explicit Compositor(column_t columns = 0): columns_(columns), cells_(0), tiles_(){}
+	Compositor& operator<<(const Image& image){return add(image);}
+	Compositor& add(const Image& image);
+	Compositor& add(const Image& image, column_t x, row_t y);
+	Image compose(const Image::pixel_type& background = black)const;
+	column_t columns()const{return columns_;}
+	std::size_t size()const{return tiles_.size();}
+private:
+	class Tile{
+	public:
+		Tile(const Image& image, column_t x, row_t y, std::size_t cell):
+			image_(image), x_(x), y_(y), cell_(cell){}
+		Image image_;
+		column_t x_;
+		row_t y_;
+		std::size_t cell_;
+	};
+	static const std::size_t no_cell = static_cast<std::size_t>(-1);
+	column_t columns_;
+	std::size_t cells_;
+	std::vector<Tile> tiles_;
+};
+
+#endif
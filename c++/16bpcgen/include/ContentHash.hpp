@@ -0,0 +1,15 @@
+#ifndef BPCGEN_CONTENTHASH_HPP_
+#define BPCGEN_CONTENTHASH_HPP_
+
+#include <cstddef>
+#include <string>
+#include "Image.hpp"
+
+class ContentHash{
+public:
+	static uint64_t xxh64(const void* data, std::size_t size, uint64_t seed = 0);
+	static uint64_t digest(const Image& image, uint64_t seed = 0);
+	static std::string hex(uint64_t hash);
+};
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef BPCGEN_CONVERTERCHAIN_HPP_
+#define BPCGEN_CONVERTERCHAIN_HPP_
+
+#include <vector>
+#include "PixelConverter.hpp"
+
+class ConverterChain: public PixelConverter{
+public:
+	typedef Image::pixel_type::value_type value_type;
+	enum{
+		entries = 0x10000
+	};
+	ConverterChain(): stages_(), luts_(){}
+	ConverterChain(const ConverterChain& chain);
+	virtual ~ConverterChain();
+	ConverterChain& operator=(const ConverterChain& chain);
+	ConverterChain& add(const PixelConverter& converter);
+	ConverterChain& operator<<(const PixelConverter& converter){return add(converter);}
+	std::size_t stages()const{return stages_.size();}
+	bool folded(std::size_t stage)const{return !stages_[stage];}
+	virtual Image::pixel_type& convert(Image::pixel_type& pixel)const;
+	virtual void convert_row(Image::pixel_type* first, Image::pixel_type* last)const;
+	virtual bool convert_plane(value_type* first, value_type* last, byte_t plane)const;
+	virtual ConverterChain* clone()const{return new ConverterChain(*this);}
+private:
+	void release();
+	std::vector<const PixelConverter*> stages_;
+	std::vector<std::vector<value_type> > luts_;
+};
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef BPCGEN_DITHER_HPP_
+#define BPCGEN_DITHER_HPP_
+
+#include <vector>
+#include "Image.hpp"
+#include "ImageProcess.hpp"
+
+class Dither: public ImageProcess{
+public:
+	typedef Image::pixel_type::value_type value_type;
+	enum Method{
+		DITHER_BAYER,
+		DITHER_BLUE_NOISE,
+		DITHER_FLOYD_STEINBERG,
+		DITHER_JARVIS
+	};
+	explicit Dither(int bits, Method method = DITHER_FLOYD_STEINBERG);
+	int bits()const{return bits_;}
+	Method method()const{return method_;}
+	virtual Image& process(Image& image)const;
+	virtual ImageView process_view(const ImageView& image)const;
+private:
+	int bits_;
+	Method method_;
+	std::vector<value_type> levels_;
+};
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef BPCGEN_FRAMEPOOL_HPP_
+#define BPCGEN_FRAMEPOOL_HPP_
+
+#include <cstddef>
+#include <map>
+#include <vector>
+#include <pthread.h>
+#include "typedef.hpp"
+
+class FramePool{
+public:
+	static FramePool& instance();
+	byte_t* acquire(std::size_t size);
+	void release(byte_t* frame, std::size_t size);
+	void clear();
+	void set_capacity(std::size_t bytes);
+	std::size_t capacity()const{return read(capacity_);}
+	std::size_t retained()const{return read(retained_);}
+	std::size_t hits()const{return read(hits_);}
+	std::size_t misses()const{return read(misses_);}
+	double hit_rate()const;
+	static std::size_t bucket(std::size_t size);
+private:
+	explicit FramePool(std::size_t a_capacity);
+	~FramePool();
+	FramePool(const FramePool&);
+	FramePool& operator=(const FramePool&);
+	void trim(std::size_t bytes);
+	std::size_t read(const std::size_t& counter)const;
+	mutable pthread_mutex_t mutex_;
+	std::map<std::size_t, std::vector<byte_t*> > frames_;
+	std::size_t capacity_;
+	std::size_t retained_;
+	std::size_t hits_;
+	std::size_t misses_;
+};
+
+#endif
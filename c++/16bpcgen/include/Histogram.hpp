@@ -0,0 +1,34 @@
+#ifndef BPCGEN_HISTOGRAM_HPP_
+#define BPCGEN_HISTOGRAM_HPP_
+
+#include <vector>
+#include "Image.hpp"
+
+class Histogram{
+public:
+	typedef Image::pixel_type::value_type value_type;
+	enum{
+		bins = 0x10000
+	};
+	explicit Histogram(const ImageView& image);
+	explicit Histogram(const Image& image);
+	uint64_t total()const{return total_;}
+	uint64_t count(byte_t plane, value_type value)const{return counts_[index(plane, value)];}
+	uint64_t cumulative(byte_t plane, value_type value)const{return cumulative_[index(plane, value)];}
+	double cdf(byte_t plane, value_type value)const;
+	value_type min(byte_t plane)const;
+	value_type max(byte_t plane)const;
+	value_type percentile(byte_t plane, double ratio)const;
+	Image::pixel_type min()const;
+	Image::pixel_type max()const;
+	Image::pixel_type percentile(double ratio)const;
+private:
+	static std::size_t index(byte_t plane, value_type value){return static_cast<std::size_t>(plane)*bins + value;}
+	void build(const ImageView& image);
+	value_type rank(byte_t plane, uint64_t rank)const;
+	uint64_t total_;
+	std::vector<uint64_t> counts_;
+	std::vector<uint64_t> cumulative_;
+};
+
+#endif
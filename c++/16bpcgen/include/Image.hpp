@@ -1,14 +1,17 @@
 #ifndef BPCGEN_IMAGE_HPP_
 #define BPCGEN_IMAGE_HPP_
 
+#include <algorithm>
 #include <cstdarg>
+#include <cstddef>
 #include <cstdio>
 #include "Pixel.hpp"
+#include "ThreadPool.hpp"
 class ImageProcess;
 class PatternGenerator;
 class PixelConverter;
+template <typename E> class ImageExpression;
 
-extern const byte_t bitdepth;
 #ifdef ENABLE_TIFF
 struct tiff;
 #endif
@@ -18,7 +21,6 @@ struct png_struct_def;
 struct png_info_def;
 struct png_text_struct;
 #endif
-extern const byte_t pixelsize;
 
 #ifdef __GNUC__
 #define ATTRIBUTE_FORMAT(archetype, strindex, first_to_check) __attribute__((format(archetype, strindex, first_to_check)))
@@ -26,23 +28,86 @@ extern const byte_t pixelsize;
 #define ATTRIBUTE_FORMAT(archetype, strindex, first_to_check)
 #endif
 
-class Row{
+template <typename T>
+class BasicRow{
 public:
-	typedef Pixel<> pixel_type;
-	Row(byte_t* row, const column_t& a_width): row_(row), width_(a_width){}
+	typedef Pixel<T> pixel_type;
+	BasicRow(byte_t* row, const column_t& a_width, std::size_t a_pitch): row_(row), width_(a_width), pitch_(a_pitch){}
 	const column_t& width()const{return width_;}
-	pixel_type& operator[](column_t column)const{return *reinterpret_cast<pixel_type*>(const_cast<byte_t*>(row_) + column*pixelsize);}
-	Row& operator++(){row_ += width()*pixelsize; return *this;}
-	bool operator!=(const Row& rhs)const{return this->row_ != rhs.row_;}
-	static void fill(Row first, Row last, const Row& row);
+	std::size_t pitch()const{return pitch_;}
+	pixel_type& operator[](column_t column)const{return static_cast<pixel_type*>(static_cast<void*>(const_cast<byte_t*>(row_)))[column];}
+	BasicRow& operator++(){row_ += pitch_; return *this;}
+	bool operator!=(const BasicRow& rhs)const{return this->row_ != rhs.row_;}
+	static void fill(BasicRow first, BasicRow last, const BasicRow& row)
+	{
+		const std::size_t rows = first.row_ < last.row_ ? static_cast<std::size_t>(last.row_ - first.row_)/first.pitch_ : 0;
+		parallel_for(0, rows, Replicate(first, row));
+	}
 private:
+	class Replicate{
+	public:
+		Replicate(const BasicRow& first, const BasicRow& row): first_(first), row_(row){}
+		void operator()(std::size_t begin, std::size_t end)const
+		{
+			for(std::size_t i = begin; i < end; ++i){
+				const BasicRow dst(const_cast<byte_t*>(first_.row_) + i*first_.pitch_, first_.width_, first_.pitch_);
+				std::copy(&row_[0], &row_[row_.width()], &dst[0]);
+			}
+		}
+	private:
+		const BasicRow& first_;
+		const BasicRow& row_;
+	};
 	const byte_t* row_;
 	const column_t& width_;
+	std::size_t pitch_;
+};
+
+template <typename T>
+class BasicConstRow{
+public:
+	typedef Pixel<T> pixel_type;
+	BasicConstRow(const byte_t* row, const column_t& a_width, std::size_t a_pitch): row_(row), width_(a_width), pitch_(a_pitch){}
+	BasicConstRow(const BasicRow<T>& row): row_(static_cast<const byte_t*>(static_cast<const void*>(&row[0]))), width_(row.width()), pitch_(row.pitch()){}
+	const column_t& width()const{return width_;}
+	std::size_t pitch()const{return pitch_;}
+	const pixel_type& operator[](column_t column)const{return static_cast<const pixel_type*>(static_cast<const void*>(row_))[column];}
+	BasicConstRow& operator++(){row_ += pitch_; return *this;}
+	bool operator!=(const BasicConstRow& rhs)const{return this->row_ != rhs.row_;}
+private:
+	const byte_t* row_;
+	const column_t& width_;
+	std::size_t pitch_;
+};
+
+typedef BasicRow<uint16_t> Row;
+typedef BasicConstRow<uint16_t> ConstRow;
+
+class ImageView{
+public:
+	typedef Row::pixel_type pixel_type;
+	ImageView(byte_t* head, const column_t& a_width, const row_t& a_height, std::size_t a_pitch):
+		head_(head), width_(a_width), height_(a_height), pitch_(a_pitch){}
+	Row operator[](row_t row)const{return Row(head_ + row*pitch_, width_, pitch_);}
+	ImageView view(column_t x, row_t y, column_t a_width, row_t a_height)const;
+	bool contains(column_t x, row_t y, column_t a_width, row_t a_height)const;
+	byte_t* head()const{return head_;}
+	const column_t& width()const{return width_;}
+	const row_t& height()const{return height_;}
+	std::size_t pitch()const{return pitch_;}
+private:
+	byte_t* head_;
+	column_t width_;
+	row_t height_;
+	std::size_t pitch_;
 };
 
 class Image{
 public:
 	typedef Row::pixel_type pixel_type;
+	static const byte_t bitdepth  = 8*sizeof(pixel_type::value_type);
+	static const byte_t pixelsize = sizeof(pixel_type);
+	static const byte_t alignment = 64;
 	enum Orientation{
 		ORI_HORI = 0x01,
 		ORI_VERT = 0x02,
@@ -51,76 +116,137 @@ public:
 	enum FileFormat{
 		FMT_NONE = 0x00,
 		FMT_TIFF = 0x01,
-		FMT_PNG  = 0x02
+		FMT_PNG  = 0x02,
+		FMT_RAW  = 0x04
+	};
+	enum MapMode{
+		MMAP_READ_ONLY,
+		MMAP_COPY_ON_WRITE
 	};
-	Image(const column_t& a_width, const row_t& a_height):
-		head_(new byte_t[a_height*a_width*pixelsize]), width_(a_width), height_(a_height){}
-	Image(const std::string& filename): head_(NULL), width_(0), height_(0){read(filename);}
+	enum RawLayout{
+		RAW_RGB48LE,
+		RAW_RGB48BE,
+		RAW_RGB24,
+		RAW_PLANAR48LE,
+		RAW_PLANAR48BE
+	};
+	Image(const column_t& a_width, const row_t& a_height, std::size_t a_pitch = 0);
+	Image(const std::string& filename): buffer_(NULL), width_(0), height_(0), pitch_(0), offset_(0){read(filename);}
 	Image(const Image& image);
 	Image& operator=(const Image& image);
-	~Image(){delete[] head_;}
-	Row operator[](row_t row)const{return Row(head_ + row*width()*pixelsize, width());}
+	template <typename E>
+	Image(const ImageExpression<E>& expression);
+	template <typename E>
+	Image& operator=(const ImageExpression<E>& expression);
+#if 201103L <= __cplusplus
+	Image(Image&& image)noexcept;
+	Image& operator=(Image&& image)noexcept;
+#endif
+	~Image(){release();}
+	ConstRow operator[](row_t row)const{return ConstRow(buffer_->head() + offset_ + row*pitch_, width(), pitch_);}
+	Row operator[](row_t row){return Row(head() + row*pitch_, width(), pitch_);}
+#if 201103L <= __cplusplus
+	Image  operator<< (const PatternGenerator& generator)const&;
+	Image  operator<< (const PatternGenerator& generator)&&;
+#else
 	Image  operator<< (const PatternGenerator& generator)const;
+#endif
 	Image& operator<<=(const PatternGenerator& generator);
 	Image& operator<<=(std::istream& is);
+#if 201103L <= __cplusplus
+	Image  operator>> (const ImageProcess& process)const&;
+	Image  operator>> (const ImageProcess& process)&&;
+#else
 	Image  operator>> (const ImageProcess& process)const;
+#endif
 	Image& operator>>=(const ImageProcess& process);
+#if 201103L <= __cplusplus
+	Image  operator>> (const PixelConverter& converter)const&;
+	Image  operator>> (const PixelConverter& converter)&&;
+#else
 	Image  operator>> (const PixelConverter& converter)const;
+#endif
 	Image& operator>>=(const PixelConverter& converter);
 	Image& operator<<(const std::string& filename){return read(filename);}
 	Image& operator>>(const std::string& filename)const{return write(filename);}
-	Image  operator<< (byte_t shift)const;
 	Image& operator<<=(byte_t shift);
-	Image  operator>> (byte_t shift)const;
 	Image& operator>>=(byte_t shift);
-	Image  operator& (const Image& image)const;
-	Image  operator& (const pixel_type& pixel)const;
+	Image& operator&=(const Image& image);
 	Image& operator&=(const pixel_type& pixel);
-	Image  operator| (const Image& image)const;
-	Image  operator| (const pixel_type& pixel)const;
+	Image& operator|=(const Image& image);
 	Image& operator|=(const pixel_type& pixel);
 	Image  operator()(const Image& image, byte_t orientation = ORI_AUTO)const;
+	Image  crop(column_t x, row_t y, column_t a_width, row_t a_height)const;
+	ImageView view(){return ImageView(head(), width(), height(), pitch());}
+	ImageView view(column_t x, row_t y, column_t a_width, row_t a_height){return view().view(x, y, a_width, a_height);}
 	Image& read(const std::string& filename);
 	Image& write(const std::string& filename, FileFormat fmt = FMT_NONE)const;
-	byte_t* head()const{return head_;}
-	byte_t* tail()const{return head_ + data_size();}
+	Image& map(const std::string& filename, MapMode mode = MMAP_COPY_ON_WRITE);
+	bool import_raw(std::istream& is, RawLayout layout);
+	bool export_raw(std::ostream& os, RawLayout layout)const;
+#ifndef _WIN32
+	bool import_raw(int fd, RawLayout layout);
+	bool export_raw(int fd, RawLayout layout)const;
+#endif
+	const byte_t* head()const{return buffer_ ? buffer_->head() + offset_ : NULL;}
+	      byte_t* head(){leak(); return buffer_ ? buffer_->head() + offset_ : NULL;}
+	const byte_t* tail()const{return head() + data_size();}
+	      byte_t* tail(){return head() + data_size();}
 	const column_t& width()const{return width_;}
 	const row_t& height()const{return height_;}
-	std::size_t data_size()const{return height_*width_*pixelsize;}
-	Image& swap(Image& rhs);
-private:
-	class lshifter{
-	public:
-		lshifter(byte_t shift): shift_(shift){}
-		void       operator()(      pixel_type& pixel)const;
-		pixel_type operator()(const pixel_type& pixel)const;
-	private:
-		byte_t shift_;
-	};
-	class rshifter{
-	public:
-		rshifter(byte_t shift): shift_(shift){}
-		void       operator()(      pixel_type& pixel)const;
-		pixel_type operator()(const pixel_type& pixel)const;
-	private:
-		byte_t shift_;
-	};
-	class bit_and{
+	std::size_t pitch()const{return pitch_;}
+	std::size_t row_size()const{return static_cast<std::size_t>(width_)*pixelsize;}
+	std::size_t data_size()const{return height_*pitch_;}
+	static std::size_t default_pitch(column_t a_width, std::size_t a_pixelsize = pixelsize);
+#ifdef ENABLE_PNG
+	class RowSource{
 	public:
-		bit_and(const pixel_type& pixel): pixel_(pixel){}
-		void       operator()(      pixel_type& pixel)const;
-		pixel_type operator()(const pixel_type& pixel)const;
-	private:
-		const pixel_type& pixel_;
+		virtual ~RowSource(){}
+		virtual const byte_t* row(row_t row) = 0;
 	};
-	class bit_or{
+	static void write_png(const std::string& filename, const byte_t* a_head, column_t a_width, row_t a_height, std::size_t a_pitch, byte_t depth);
+	static void write_png(const std::string& filename, RowSource& rows, column_t a_width, row_t a_height, byte_t depth);
+#endif
+	bool shared()const{return buffer_ && (1 < buffer_->count() || !buffer_->writable());}
+	Image& swap(Image& rhs);
+private:
+	class Buffer{
 	public:
-		bit_or(const pixel_type& pixel): pixel_(pixel){}
-		void       operator()(      pixel_type& pixel)const;
-		pixel_type operator()(const pixel_type& pixel)const;
+		explicit Buffer(std::size_t size);
+		Buffer(byte_t* mapping, std::size_t size, bool writable);
+		~Buffer();
+		byte_t* head()const{return head_;}
+		unsigned int count()const{return count_;}
+		bool writable()const{return writable_;}
+		bool shareable()const{return shareable_;}
+		void leak(){shareable_ = false;}
+#ifdef __GNUC__
+		Buffer* acquire(){__sync_add_and_fetch(&count_, 1u); return this;}
+		bool release(){return __sync_sub_and_fetch(&count_, 1u) == 0;}
+#else
+		Buffer* acquire(){++count_; return this;}
+		bool release(){return --count_ == 0;}
+#endif
 	private:
-		const pixel_type& pixel_;
+		Buffer(const Buffer&);
+		Buffer& operator=(const Buffer&);
+		byte_t* head_;
+		std::size_t size_;
+		unsigned int count_;
+		bool mapped_;
+		bool writable_;
+		bool shareable_;
 	};
+	template <typename E>
+	void assign(const E& expression);
+	static void expand(const byte_t* src, pixel_type::value_type* dst, std::size_t size);
+	Buffer* duplicate()const;
+	void share(const Image& image);
+	void detach();
+	void leak(){detach(); if(buffer_){buffer_->leak();}}
+	void renew();
+	void release();
+	void reset(column_t a_width, row_t a_height, std::size_t a_pitch = 0);
 #ifdef ENABLE_TIFF
 	class Tiff{
 	public:
@@ -176,9 +302,12 @@ private:
 #ifdef ENABLE_JPEG
 	Image& read_jpeg(const std::string& filename);
 #endif
-	byte_t* head_;
+	Image& write_raw(const std::string& filename)const;
+	Buffer* buffer_;
 	column_t width_;
 	row_t height_;
+	std::size_t pitch_;
+	std::size_t offset_;
 };
 
 inline std::istream& operator>>(std::istream& is, Image& image){image <<= is; return is;}
@@ -189,4 +318,6 @@ void get_current_time(char* buf);
 const char* get_current_time_rfc1123();
 #endif
 
+#include "ImageExpression.hpp"
+
 #endif
@@ -0,0 +1,316 @@
+#ifndef BPCGEN_IMAGEEXPRESSION_HPP_
+#define BPCGEN_IMAGEEXPRESSION_HPP_
+
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "BitKernels.hpp"
+#include "Image.hpp"
+#include "ImageProcess.hpp"
+#include "ThreadPool.hpp"
+
+/**
+ * 各節点はeval(row, dst, scratch)でrow行目をdstへ書き込む。
+ * scratchは評価器が帯ごとに一度だけ確保する作業領域で、1行分の領域がdepth個並ぶ。
+ * 節点は先頭の1行分を使い、子には残りを渡す。
+ */
+template <typename E>
+class ImageExpression{
+public:
+	typedef Image::pixel_type::value_type value_type;
+	const E& self()const{return static_cast<const E&>(*this);}
+	const value_type* read(row_t row, value_type* scratch)const
+	{
+		self().eval(row, scratch, scratch + static_cast<std::size_t>(self().width())*3);
+		return scratch;
+	}
+protected:
+	ImageExpression(){}
+	~ImageExpression(){}
+};
+
+class ImageTerm: public ImageExpression<ImageTerm>{
+public:
+	static const std::size_t depth = 0;
+	explicit ImageTerm(const Image& image): image_(image){}
+	column_t width()const{return image_.width();}
+	row_t height()const{return image_.height();}
+	void eval(row_t row, value_type* dst, value_type*)const
+	{
+		const value_type* const src = read(row);
+		if(src != dst){
+			std::copy(src, src + static_cast<std::size_t>(width())*3, dst);
+		}
+	}
+	const value_type* read(row_t row, value_type*)const{return read(row);}
+private:
+	const value_type* read(row_t row)const{return reinterpret_cast<const value_type*>(&image_[row][0]);}
+	const Image& image_;
+};
+
+class BitAnd{
+public:
+	static const char* name(){return "operator&";}
+	static void apply(Image::pixel_type::value_type* dst, const Image::pixel_type::value_type* src, std::size_t size)
+	{
+		BitKernels::bit_and(dst, src, size);
+	}
+	static void mask(Image::pixel_type::value_type* dst, const Image::pixel_type::value_type* mask, std::size_t size)
+	{
+		BitKernels::mask_and(dst, mask, size);
+	}
+};
+
+class BitOr{
+public:
+	static const char* name(){return "operator|";}
+	static void apply(Image::pixel_type::value_type* dst, const Image::pixel_type::value_type* src, std::size_t size)
+	{
+		BitKernels::bit_or(dst, src, size);
+	}
+	static void mask(Image::pixel_type::value_type* dst, const Image::pixel_type::value_type* mask, std::size_t size)
+	{
+		BitKernels::mask_or(dst, mask, size);
+	}
+};
+
+class LeftShift{
+public:
+	static void apply(Image::pixel_type::value_type* dst, std::size_t size, byte_t shift)
+	{
+		BitKernels::shift_left(dst, size, shift);
+	}
+};
+
+class RightShift{
+public:
+	static void apply(Image::pixel_type::value_type* dst, std::size_t size, byte_t shift)
+	{
+		BitKernels::shift_right(dst, size, shift);
+	}
+};
+
+/**
+ * 右辺を先に作業領域の先頭1行へ評価してから左辺をdstへ書き込む。
+ * 代入先と同じ画像を右辺が参照していても、上書き前の値で演算される。
+ * 右辺の値を持ったまま左辺を評価するので、作業領域は左右の深い方より1行多く要る。
+ */
+template <typename L, typename R, typename Op>
+class BinaryExpression: public ImageExpression<BinaryExpression<L, R, Op> >{
+public:
+	typedef typename ImageExpression<BinaryExpression<L, R, Op> >::value_type value_type;
+	static const std::size_t depth = 1 + (L::depth < R::depth ? R::depth : L::depth);
+	BinaryExpression(const L& lhs, const R& rhs): lhs_(lhs), rhs_(rhs)
+	{
+		if(lhs_.width() != rhs_.width() || lhs_.height() != rhs_.height()){
+			throw std::invalid_argument(Op::name() + std::string(": can not apply bitwise operation. image width/height unmatch."));
+		}
+	}
+	column_t width()const{return lhs_.width();}
+	row_t height()const{return lhs_.height();}
+	void eval(row_t row, value_type* dst, value_type* scratch)const
+	{
+		const std::size_t size = static_cast<std::size_t>(width())*3;
+		const value_type* src = rhs_.read(row, scratch);
+		if(src == dst){
+			std::copy(src, src + size, scratch);
+			src = scratch;
+		}
+		lhs_.eval(row, dst, scratch + size);
+		Op::apply(dst, src, size);
+	}
+private:
+	L lhs_;
+	R rhs_;
+};
+
+template <typename E, typename Op>
+class MaskExpression: public ImageExpression<MaskExpression<E, Op> >{
+public:
+	typedef typename ImageExpression<MaskExpression<E, Op> >::value_type value_type;
+	static const std::size_t depth = E::depth;
+	MaskExpression(const E& expression, const Image::pixel_type& pixel): expression_(expression), mask_()
+	{
+		mask_[0] = pixel.R();
+		mask_[1] = pixel.G();
+		mask_[2] = pixel.B();
+	}
+	column_t width()const{return expression_.width();}
+	row_t height()const{return expression_.height();}
+	void eval(row_t row, value_type* dst, value_type* scratch)const
+	{
+		expression_.eval(row, dst, scratch);
+		Op::mask(dst, mask_, static_cast<std::size_t>(width())*3);
+	}
+private:
+	E expression_;
+	value_type mask_[3];
+};
+
+template <typename E, typename Op>
+class ShiftExpression: public ImageExpression<ShiftExpression<E, Op> >{
+public:
+	typedef typename ImageExpression<ShiftExpression<E, Op> >::value_type value_type;
+	static const std::size_t depth = E::depth;
+	ShiftExpression(const E& expression, byte_t shift): expression_(expression), shift_(shift){}
+	column_t width()const{return expression_.width();}
+	row_t height()const{return expression_.height();}
+	void eval(row_t row, value_type* dst, value_type* scratch)const
+	{
+		expression_.eval(row, dst, scratch);
+		Op::apply(dst, static_cast<std::size_t>(width())*3, shift_);
+	}
+private:
+	E expression_;
+	byte_t shift_;
+};
+
+template <typename E>
+Image::Image(const ImageExpression<E>& expression): buffer_(NULL), width_(0), height_(0), pitch_(0), offset_(0)
+{
+	reset(expression.self().width(), expression.self().height());
+	assign(expression.self());
+}
+
+template <typename E>
+Image& Image::operator=(const ImageExpression<E>& expression)
+{
+	if(shared() || width() != expression.self().width() || height() != expression.self().height()){
+		Image result(expression);
+		return swap(result);
+	}
+	assign(expression.self());
+	return *this;
+}
+
+template <typename E>
+class ExpressionBand{
+public:
+	ExpressionBand(const E& expression, const ImageView& image): expression_(expression), image_(image){}
+	void operator()(std::size_t begin, std::size_t end)const
+	{
+		std::vector<Image::pixel_type::value_type> scratch(E::depth*static_cast<std::size_t>(image_.width())*3);
+		Image::pixel_type::value_type* const rows = scratch.empty() ? NULL : &scratch[0];
+		for(row_t h = static_cast<row_t>(begin); h < end; ++h){
+			expression_.eval(h, reinterpret_cast<Image::pixel_type::value_type*>(&image_[h][0]), rows);
+		}
+	}
+private:
+	const E& expression_;
+	const ImageView image_;
+};
+
+template <typename E>
+void Image::assign(const E& expression)
+{
+	parallel_for(0, height(), ExpressionBand<E>(expression, view()));
+}
+
+inline BinaryExpression<ImageTerm, ImageTerm, BitAnd> operator&(const Image& lhs, const Image& rhs)
+{
+	return BinaryExpression<ImageTerm, ImageTerm, BitAnd>(ImageTerm(lhs), ImageTerm(rhs));
+}
+
+template <typename E>
+BinaryExpression<E, ImageTerm, BitAnd> operator&(const ImageExpression<E>& lhs, const Image& rhs)
+{
+	return BinaryExpression<E, ImageTerm, BitAnd>(lhs.self(), ImageTerm(rhs));
+}
+
+template <typename E>
+BinaryExpression<ImageTerm, E, BitAnd> operator&(const Image& lhs, const ImageExpression<E>& rhs)
+{
+	return BinaryExpression<ImageTerm, E, BitAnd>(ImageTerm(lhs), rhs.self());
+}
+
+template <typename E, typename F>
+BinaryExpression<E, F, BitAnd> operator&(const ImageExpression<E>& lhs, const ImageExpression<F>& rhs)
+{
+	return BinaryExpression<E, F, BitAnd>(lhs.self(), rhs.self());
+}
+
+inline MaskExpression<ImageTerm, BitAnd> operator&(const Image& lhs, const Image::pixel_type& rhs)
+{
+	return MaskExpression<ImageTerm, BitAnd>(ImageTerm(lhs), rhs);
+}
+
+template <typename E>
+MaskExpression<E, BitAnd> operator&(const ImageExpression<E>& lhs, const Image::pixel_type& rhs)
+{
+	return MaskExpression<E, BitAnd>(lhs.self(), rhs);
+}
+
+inline BinaryExpression<ImageTerm, ImageTerm, BitOr> operator|(const Image& lhs, const Image& rhs)
+{
+	return BinaryExpression<ImageTerm, ImageTerm, BitOr>(ImageTerm(lhs), ImageTerm(rhs));
+}
+
+template <typename E>
+BinaryExpression<E, ImageTerm, BitOr> operator|(const ImageExpression<E>& lhs, const Image& rhs)
+{
+	return BinaryExpression<E, ImageTerm, BitOr>(lhs.self(), ImageTerm(rhs));
+}
+
+template <typename E>
+BinaryExpression<ImageTerm, E, BitOr> operator|(const Image& lhs, const ImageExpression<E>& rhs)
+{
+	return BinaryExpression<ImageTerm, E, BitOr>(ImageTerm(lhs), rhs.self());
+}
+
+template <typename E, typename F>
+BinaryExpression<E, F, BitOr> operator|(const ImageExpression<E>& lhs, const ImageExpression<F>& rhs)
+{
+	return BinaryExpression<E, F, BitOr>(lhs.self(), rhs.self());
+}
+
+inline MaskExpression<ImageTerm, BitOr> operator|(const Image& lhs, const Image::pixel_type& rhs)
+{
+	return MaskExpression<ImageTerm, BitOr>(ImageTerm(lhs), rhs);
+}
+
+template <typename E>
+MaskExpression<E, BitOr> operator|(const ImageExpression<E>& lhs, const Image::pixel_type& rhs)
+{
+	return MaskExpression<E, BitOr>(lhs.self(), rhs);
+}
+
+inline ShiftExpression<ImageTerm, LeftShift> operator<<(const Image& lhs, byte_t shift)
+{
+	return ShiftExpression<ImageTerm, LeftShift>(ImageTerm(lhs), shift);
+}
+
+template <typename E>
+ShiftExpression<E, LeftShift> operator<<(const ImageExpression<E>& lhs, byte_t shift)
+{
+	return ShiftExpression<E, LeftShift>(lhs.self(), shift);
+}
+
+inline ShiftExpression<ImageTerm, RightShift> operator>>(const Image& lhs, byte_t shift)
+{
+	return ShiftExpression<ImageTerm, RightShift>(ImageTerm(lhs), shift);
+}
+
+template <typename E>
+ShiftExpression<E, RightShift> operator>>(const ImageExpression<E>& lhs, byte_t shift)
+{
+	return ShiftExpression<E, RightShift>(lhs.self(), shift);
+}
+
+template <typename E>
+Image operator>>(const ImageExpression<E>& lhs, const ImageProcess& process)
+{
+	Image result(lhs);
+	process.process(result);
+	return result;
+}
+
+template <typename E>
+Image operator>>(const ImageExpression<E>& lhs, const PixelConverter& converter)
+{
+	Image result(lhs);
+	result >>= converter;
+	return result;
+}
+
+#endif
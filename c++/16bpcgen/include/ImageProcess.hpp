@@ -2,11 +2,13 @@
 #define BPCGEN_IMAGEPROCESS_HPP_
 
 class Image;
+class ImageView;
 
 class ImageProcess{
 public:
 	virtual ~ImageProcess(){}
 	virtual Image& process(Image& image)const = 0;
+	virtual ImageView process_view(const ImageView& image)const;
 };
 
 #endif
@@ -19,7 +19,15 @@ class AreaSpecifier: public ImageProcess{
 public:
 	AreaSpecifier(const Area& area = Area()): area_(area){}
 	virtual Image& process(Image& image)const = 0;
-	bool within(const Image& image)const;
+	template <typename T>
+	bool within(const T& image)const
+	{
+		return area_.offset_x_ < image.width()  &&
+			area_.offset_y_ < image.height() &&
+			area_.offset_x_ + area_.width_  <= image.width() &&
+			area_.offset_y_ + area_.height_ <= image.height();
+	}
+	ImageView area(const ImageView& image)const;
 protected:
 	const Area& area_;
 };
@@ -29,6 +37,7 @@ public:
 	Tone(const PixelConverter& converter, const Area& area = Area()):
 		AreaSpecifier(area), converter_(converter){}
 	virtual Image& process(Image& image)const;
+	virtual ImageView process_view(const ImageView& image)const;
 private:
 	const PixelConverter& converter_;
 };
@@ -37,18 +46,21 @@ class Normalize: public AreaSpecifier{
 public:
 	Normalize(const Area& area = Area()): AreaSpecifier(area){}
 	virtual Image& process(Image& image)const;
+	virtual ImageView process_view(const ImageView& image)const;
 };
 
 class Median: public AreaSpecifier{
 public:
 	Median(const Area& area = Area()): AreaSpecifier(area){}
 	virtual Image& process(Image& image)const;
+	virtual ImageView process_view(const ImageView& image)const;
 };
 
 class Crop: public AreaSpecifier{
 public:
 	Crop(const Area& area): AreaSpecifier(area){}
 	virtual Image& process(Image& image)const;
+	virtual ImageView process_view(const ImageView& image)const;
 };
 
 class Filter: public ImageProcess{
@@ -103,6 +115,15 @@ private:
 	static Kernel init();
 };
 
+class BoxBlur: public ImageProcess{
+public:
+	BoxBlur(column_t radius_x, row_t radius_y): radius_x_(radius_x), radius_y_(radius_y){}
+	virtual Image& process(Image& image)const;
+private:
+	column_t radius_x_;
+	row_t radius_y_;
+};
+
 class HScale: public ImageProcess{
 public:
 	HScale(column_t width): width_(width){}
@@ -0,0 +1,33 @@
+#ifndef BPCGEN_INTEGRALIMAGE_HPP_
+#define BPCGEN_INTEGRALIMAGE_HPP_
+
+#include <vector>
+#include "Image.hpp"
+
+class IntegralImage{
+public:
+	explicit IntegralImage(const Image& image, bool squared = true);
+	explicit IntegralImage(const ImageView& image, bool squared = true);
+	~IntegralImage();
+	const column_t& width()const{return width_;}
+	const row_t& height()const{return height_;}
+	uint64_t sum(byte_t plane, column_t x, row_t y, column_t w, row_t h)const{return query(sums_, plane, x, y, w, h);}
+	uint64_t squared_sum(byte_t plane, column_t x, row_t y, column_t w, row_t h)const;
+	Pixel<double> mean(column_t x, row_t y, column_t w, row_t h)const;
+	Pixel<double> variance(column_t x, row_t y, column_t w, row_t h)const;
+private:
+	void build(const ImageView& image);
+	uint64_t query(const std::vector<uint64_t>& table, byte_t plane, column_t x, row_t y, column_t w, row_t h)const
+	{
+		const std::size_t stride = 3*(static_cast<std::size_t>(width_) + 1);
+		const std::size_t top    = y*stride + plane;
+		const std::size_t bottom = (y + h)*stride + plane;
+		return table[bottom + 3*(x + w)] - table[bottom + 3*x] - table[top + 3*(x + w)] + table[top + 3*x];
+	}
+	column_t width_;
+	row_t height_;
+	std::vector<uint64_t> sums_;
+	std::vector<uint64_t> squares_;
+};
+
+#endif
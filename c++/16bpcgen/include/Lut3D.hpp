@@ -0,0 +1,36 @@
+#ifndef BPCGEN_LUT3D_HPP_
+#define BPCGEN_LUT3D_HPP_
+
+#include <istream>
+#include <string>
+#include <vector>
+#include "PixelConverter.hpp"
+
+class Lut3D: public PixelConverter{
+public:
+	typedef Image::pixel_type::value_type value_type;
+	enum{
+		min_size = 2,
+		max_size = 256
+	};
+	explicit Lut3D(const std::string& filename);
+	explicit Lut3D(std::istream& is);
+	std::size_t size()const{return size_;}
+	const std::string& title()const{return title_;}
+	virtual Image::pixel_type& convert(Image::pixel_type& pixel)const;
+	virtual void convert_row(Image::pixel_type* first, Image::pixel_type* last)const;
+	virtual Lut3D* clone()const{return new Lut3D(*this);}
+private:
+	void load(std::istream& is);
+	void interpolate(Image::pixel_type& pixel)const;
+	std::string title_;
+	std::size_t size_;
+	float scale_[4];
+	float bias_[4];
+	std::size_t stride_[3];
+	byte_t axes_[8][3];
+	std::size_t offsets_[8][2];
+	std::vector<value_type> lattice_;
+};
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef BPCGEN_METRICS_HPP_
+#define BPCGEN_METRICS_HPP_
+
+#include "Image.hpp"
+
+class Metrics{
+public:
+	Metrics(const Image& reference, const Image& image);
+	Pixel<double> mse()const;
+	Pixel<double> psnr()const;
+	Pixel<double> ssim(Image* map = NULL)const;
+	double delta_e(Image* map = NULL, double range = 10.0)const;
+	static Pixel<double> lab(const Image::pixel_type& pixel);
+	static double ciede2000(const Pixel<double>& lab1, const Pixel<double>& lab2);
+	static Image::pixel_type heat(double value);
+private:
+	const Image& reference_;
+	const Image& image_;
+};
+
+#endif
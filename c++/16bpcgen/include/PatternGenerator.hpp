@@ -2,12 +2,16 @@
 #define BPCGEN_PATTERN_GENERATOR_HPP_
 
 #include "ImageProcess.hpp"
+#include "Image.hpp"
 
 class PatternGenerator: public ImageProcess{
 public:
 	virtual ~PatternGenerator(){}
-	virtual Image& process(Image& image)const{return generate(image);}
-	virtual Image& generate(Image& image)const = 0;
+	virtual Image& process(Image& image)const{generate(image.view()); return image;}
+	virtual ImageView process_view(const ImageView& image)const{return generate(image);}
+	virtual ImageView generate(const ImageView& image)const = 0;
+	virtual bool overwrites()const{return false;}
+	virtual ImageView generate_tile(const ImageView& image, column_t left, row_t top, column_t canvas_width, row_t canvas_height)const;
 };
 
 #endif
@@ -6,13 +6,17 @@
 
 class ColorBar: public PatternGenerator{
 public:
-	virtual Image& generate(Image& image)const;
+	virtual bool overwrites()const{return true;}
+	virtual ImageView generate(const ImageView& image)const;
+	virtual ImageView generate_tile(const ImageView& image, column_t left, row_t top, column_t canvas_width, row_t canvas_height)const;
 };
 
 class Luster: public PatternGenerator{
 public:
 	Luster(const Image::pixel_type& pixel): pixel_(pixel){}
-	virtual Image& generate(Image& image)const;
+	virtual bool overwrites()const{return true;}
+	virtual ImageView generate(const ImageView& image)const;
+	virtual ImageView generate_tile(const ImageView& image, column_t left, row_t top, column_t canvas_width, row_t canvas_height)const;
 private:
 	const Image::pixel_type pixel_;
 };
@@ -20,7 +24,9 @@ private:
 class Checker: public PatternGenerator{
 public:
 	Checker(bool invert = false): invert_(invert){}
-	virtual Image& generate(Image& image)const;
+	virtual bool overwrites()const{return true;}
+	virtual ImageView generate(const ImageView& image)const;
+	virtual ImageView generate_tile(const ImageView& image, column_t left, row_t top, column_t canvas_width, row_t canvas_height)const;
 private:
 	const bool invert_;
 };
@@ -29,7 +35,9 @@ class StairStepH: public PatternGenerator{
 public:
 	StairStepH(byte_t stairs = 2, byte_t steps = 20, bool invert = false):
 		stairs_(stairs), steps_(steps), invert_(invert){}
-	virtual Image& generate(Image& image)const;
+	virtual bool overwrites()const{return true;}
+	virtual ImageView generate(const ImageView& image)const;
+	virtual ImageView generate_tile(const ImageView& image, column_t left, row_t top, column_t canvas_width, row_t canvas_height)const;
 private:
 	const byte_t stairs_;
 	const byte_t steps_;
@@ -40,7 +48,9 @@ class StairStepV: public PatternGenerator{
 public:
 	StairStepV(byte_t stairs = 2, byte_t steps = 20, bool invert = false):
 		stairs_(stairs), steps_(steps), invert_(invert){}
-	virtual Image& generate(Image& image)const;
+	virtual bool overwrites()const{return true;}
+	virtual ImageView generate(const ImageView& image)const;
+	virtual ImageView generate_tile(const ImageView& image, column_t left, row_t top, column_t canvas_width, row_t canvas_height)const;
 private:
 	const byte_t stairs_;
 	const byte_t steps_;
@@ -49,14 +59,17 @@ private:
 
 class Ramp: public PatternGenerator{
 public:
-	virtual Image& generate(Image& image)const;
+	virtual bool overwrites()const{return true;}
+	virtual ImageView generate(const ImageView& image)const;
+	virtual ImageView generate_tile(const ImageView& image, column_t left, row_t top, column_t canvas_width, row_t canvas_height)const;
 };
 
 class CrossHatch: public PatternGenerator{
 public:
 	CrossHatch(column_t width, row_t height, const Image::pixel_type& pixel = white):
 		lattice_width_(width), lattice_height_(height), pixel_(pixel){}
-	virtual Image& generate(Image& image)const;
+	virtual ImageView generate(const ImageView& image)const;
+	virtual ImageView generate_tile(const ImageView& image, column_t left, row_t top, column_t canvas_width, row_t canvas_height)const;
 private:
 	const column_t lattice_width_;
 	const row_t lattice_height_;
@@ -66,7 +79,8 @@ private:
 #if 201103L <= __cplusplus
 class WhiteNoise: public PatternGenerator{
 public:
-	virtual Image& generate(Image& image)const;
+	virtual bool overwrites()const{return true;}
+	virtual ImageView generate(const ImageView& image)const;
 };
 #endif
 
@@ -81,11 +95,11 @@ public:
 	Character(const std::string& text, const Image::pixel_type& pixel = white,
 			byte_t scale = 1, row_t row = 0, column_t column = 0):
 		text_(text), pixel_(pixel), scale_(scale), row_(row), column_(column){}
-	virtual Image& generate(Image& image)const;
+	virtual ImageView generate(const ImageView& image)const;
 private:
-	void write(Image& image, row_t row, column_t column,
+	void write(const ImageView& image, row_t row, column_t column,
 			unsigned char c, const Image::pixel_type& pixel, byte_t scale)const;
-	void write(Image& image, row_t row, column_t column,
+	void write(const ImageView& image, row_t row, column_t column,
 			const std::string& str, const Image::pixel_type& pixel, byte_t scale)const;
 private:
 	const std::string text_;
@@ -100,7 +114,7 @@ public:
 	TypeWriter(const std::string& textfilename, const Image::pixel_type& pixel = white);
 	virtual const column_t& width()const{return width_;}
 	virtual const row_t& height()const{return height_;}
-	virtual Image& generate(Image& image)const;
+	virtual ImageView generate(const ImageView& image)const;
 private:
 	static bool is_tab(unsigned char c){return c == '\t';}
 	column_t width_;
@@ -113,7 +127,7 @@ class Line: public PatternGenerator{
 public:
 	Line(column_t from_col, row_t from_row, column_t to_col, row_t to_row, const Image::pixel_type& pixel = white):
 		from_col_(from_col), from_row_(from_row), to_col_(to_col), to_row_(to_row), pixel_(pixel){}
-	virtual Image& generate(Image& image)const;
+	virtual ImageView generate(const ImageView& image)const;
 private:
 	const column_t from_col_;
 	const row_t from_row_;
@@ -127,7 +141,7 @@ public:
 	typedef column_t radius_t;
 	Circle(column_t column, row_t row, const Image::pixel_type& pixel = white, radius_t radius = 0, bool fill_enabled = true):
 		column_(column), row_(row), pixel_(pixel), radius_(radius), fill_enabled_(fill_enabled){}
-	virtual Image& generate(Image& image)const;
+	virtual ImageView generate(const ImageView& image)const;
 private:
 	const column_t column_;
 	const row_t row_;
@@ -1,6 +1,8 @@
 #ifndef BPCGEN_PIXEL_HPP_
 #define BPCGEN_PIXEL_HPP_
 
+#include <algorithm>
+#include <cmath>
 #include <iomanip>
 #include <ostream>
 #include <stdexcept>
@@ -66,47 +68,9 @@ public:
 			B_ = static_cast<value_type>(std::min(std::max(Ytmp + 1.8814*Cbtmp,                0.0), static_cast<double>(max)));
 			break;
 		}
-		case CS_HSV:{
-			const value_type maximum = b_cr;
-			const value_type minimum = static_cast<value_type>(maximum - ( g_cb / max * maximum));
-			switch(static_cast<int>(r_y / 60.0)){
-			case 0:
-				R_ = maximum;
-				G_ = static_cast<value_type>((r_y / 60.0) * (maximum - minimum) + minimum);
-				B_ = minimum;
-				break;
-			case 1:
-				R_ = static_cast<value_type>(((120.0 - r_y) / 60.0) * (maximum - minimum) + minimum);
-				G_ = maximum;
-				B_ = minimum;
-				break;
-			case 2:
-				R_ = minimum;
-				G_ = maximum;
-				B_ = static_cast<value_type>(((r_y - 120.0) / 60.0) * (maximum - minimum) + minimum);
-				break;
-			case 3:
-				R_ = minimum;
-				G_ = static_cast<value_type>(((240.0 - r_y) / 60.0) * (maximum - minimum) + minimum);
-				B_ = maximum;
-				break;
-			case 4:
-				R_ = static_cast<value_type>(((r_y - 240.0) / 60.0) * (maximum - minimum) + minimum);
-				G_ = minimum;
-				B_ = maximum;
-				break;
-			case 5:
-			case 6:
-				R_ = maximum;
-				G_ = minimum;
-				B_ = static_cast<value_type>(((360.0 - r_y) / 60.0) * (maximum - minimum) + minimum);
-				break;
-			default:
-				throw std::range_error(__func__ + std::string(": can not set pixel color. color range violation."));
-				break;
-			}
+		case CS_HSV:
+			set_hsv(static_cast<double>(r_y), static_cast<double>(g_cb)/static_cast<double>(max), static_cast<double>(b_cr));
 			break;
-		}
 		case CS_XYZ:
 			R_ = static_cast<value_type>( 0.418452000*r_y - 0.15865200*g_cb - 0.0828342*b_cr);
 			G_ = static_cast<value_type>(-0.091164200*r_y + 0.25242400*g_cb + 0.0157058*b_cr);
@@ -118,18 +82,18 @@ public:
 	}
 	template <typename U>
 	Pixel(const Pixel<U>& rhs):
-		R_(static_cast<value_type>(static_cast<double>(rhs.R())*max/Pixel<U>::max)),
-		G_(static_cast<value_type>(static_cast<double>(rhs.G())*max/Pixel<U>::max)),
-		B_(static_cast<value_type>(static_cast<double>(rhs.B())*max/Pixel<U>::max)){}
+		R_(static_cast<value_type>(static_cast<double>(rhs.R())*static_cast<double>(max)/static_cast<double>(Pixel<U>::max))),
+		G_(static_cast<value_type>(static_cast<double>(rhs.G())*static_cast<double>(max)/static_cast<double>(Pixel<U>::max))),
+		B_(static_cast<value_type>(static_cast<double>(rhs.B())*static_cast<double>(max)/static_cast<double>(Pixel<U>::max))){}
 	template <typename U>
 	Pixel& operator=(const Pixel<U>& rhs)
 	{
 		if(this == reinterpret_cast<const Pixel*>(&rhs)){
 			return *this;
 		}
-		R_ = static_cast<value_type>(static_cast<double>(rhs.R())*max/Pixel<U>::max);
-		G_ = static_cast<value_type>(static_cast<double>(rhs.G())*max/Pixel<U>::max);
-		B_ = static_cast<value_type>(static_cast<double>(rhs.B())*max/Pixel<U>::max);
+		R_ = static_cast<value_type>(static_cast<double>(rhs.R())*static_cast<double>(max)/static_cast<double>(Pixel<U>::max));
+		G_ = static_cast<value_type>(static_cast<double>(rhs.G())*static_cast<double>(max)/static_cast<double>(Pixel<U>::max));
+		B_ = static_cast<value_type>(static_cast<double>(rhs.B())*static_cast<double>(max)/static_cast<double>(Pixel<U>::max));
 		return *this;
 	}
 	template <typename U>
@@ -269,18 +233,13 @@ public:
 	value_type Cr2020()const{return ( 0.5000*R_ - 0.4597*G_ - 0.0402*B_)*224.0/255.0 + 128.0*max/255.0;}
 	double H()const
 	{
-		const value_type maximum = std::max(std::max(R_, G_), B_);
-		const value_type minimum = std::min(std::min(R_, G_), B_);
-		const double diff = maximum - minimum;
-		if(minimum == maximum){
-			throw std::runtime_error(__func__ + std::string(": can not calculate hue. hue undefined."));
-		}else if(minimum == B_){
-			return 60.0 * (static_cast<double>(G_) - R_) / max / diff +  60.0;
-		}else if(minimum == R_){
-			return 60.0 * (static_cast<double>(B_) - G_) / max / diff + 180.0;
-		}else{
-			return 60.0 * (static_cast<double>(R_) - B_) / max / diff + 300.0;
-		}
+		const double r = static_cast<double>(R_), g = static_cast<double>(G_), b = static_cast<double>(B_);
+		const double diff = std::max(std::max(r, g), b) - std::min(std::min(r, g), b);
+		const bool r_max = g <= r && b <= r;
+		const bool g_max = !r_max && b <= g;
+		const double num  = r_max ? g - b : g_max ? b - r : r - g;
+		const double base = r_max ? (g < b ? 6.0 : 0.0) : g_max ? 2.0 : 4.0;
+		return 0.0 < diff ? 60.0*(base + num/diff) : 0.0;
 	}
 	double S()const
 	{
@@ -291,6 +250,19 @@ public:
 	value_type Y()const{return 1.0000*R_ + 4.5907*G_ + 0.0601*B_;}
 	value_type Z()const{return 0.0000*R_ + 0.0565*G_ + 5.5943*B_;}
 private:
+	void set_hsv(double hue, double saturation, double value)
+	{
+		const double h = std::fmod(std::fmod(hue, 360.0) + 360.0, 360.0)/60.0;
+		const double c = value*saturation;
+		R_ = static_cast<value_type>(value - c*hsv_weight(h + 5.0));
+		G_ = static_cast<value_type>(value - c*hsv_weight(h + 3.0));
+		B_ = static_cast<value_type>(value - c*hsv_weight(h + 1.0));
+	}
+	static double hsv_weight(double k)
+	{
+		k = 6.0 <= k ? k - 6.0 : k;
+		return std::min(std::max(std::min(k, 4.0 - k), 0.0), 1.0);
+	}
 	value_type R_;
 	value_type G_;
 	value_type B_;
@@ -1,12 +1,30 @@
 #ifndef BPCGEN_PIXELCONVERTER_HPP_
 #define BPCGEN_PIXELCONVERTER_HPP_
 
+#include <typeinfo>
 #include "Image.hpp"
 
 class PixelConverter{
 public:
 	virtual ~PixelConverter(){}
 	virtual Image::pixel_type& convert(Image::pixel_type& pixel)const = 0;
+	void convert(Image::pixel_type* first, Image::pixel_type* last)const{convert_row(first, last);}
+	virtual void convert_row(Image::pixel_type* first, Image::pixel_type* last)const{convert_each(first, last);}
+	virtual bool convert_plane(Image::pixel_type::value_type*, Image::pixel_type::value_type*, byte_t)const{return false;}
+	virtual PixelConverter* clone()const{return NULL;}
+protected:
+	/**
+	 * 行や面の専用カーネルは、動的型がKernelそのものであるときだけ使う。
+	 * convertだけを定義した派生クラスはカーネルを継承してしまうので、その場合はconvert_eachへ回す。
+	 */
+	template<class Kernel>
+	bool uses_kernel_of()const{return typeid(*this) == typeid(Kernel);}
+	void convert_each(Image::pixel_type* first, Image::pixel_type* last)const
+	{
+		for(; first != last; ++first){
+			convert(*first);
+		}
+	}
 };
 
 #endif
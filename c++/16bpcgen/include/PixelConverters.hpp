@@ -3,6 +3,7 @@
 
 #include <vector>
 #include "PixelConverter.hpp"
+#include "TransferFunction.hpp"
 
 class Channel: public PixelConverter{
 public:
@@ -14,6 +15,8 @@ public:
 	typedef byte_t Ch;
 	Channel(Ch c = R | G | B): ch_(c){}
 	virtual Image::pixel_type& convert(Image::pixel_type& pixel)const;
+	virtual void convert_row(Image::pixel_type* first, Image::pixel_type* last)const;
+	virtual Channel* clone()const{return new Channel(*this);}
 	Ch ch()const{return ch_;}
 private:
 	const Ch ch_;
@@ -22,6 +25,8 @@ private:
 class GrayScale: public PixelConverter{
 public:
 	virtual Image::pixel_type& convert(Image::pixel_type& pixel)const;
+	virtual void convert_row(Image::pixel_type* first, Image::pixel_type* last)const;
+	virtual GrayScale* clone()const{return new GrayScale(*this);}
 };
 
 class Threshold: public Channel{
@@ -29,6 +34,8 @@ public:
 	Threshold(Image::pixel_type::value_type threshold, Ch c):
 		Channel(c), threshold_(threshold){}
 	virtual Image::pixel_type& convert(Image::pixel_type& pixel)const;
+	virtual void convert_row(Image::pixel_type* first, Image::pixel_type* last)const;
+	virtual Threshold* clone()const{return new Threshold(*this);}
 private:
 	const Image::pixel_type::value_type threshold_;
 };
@@ -38,6 +45,9 @@ public:
 	Offset(Image::pixel_type::value_type offset, bool invert = false, Ch c = R | G | B):
 		Channel(c), offset_(offset), invert_(invert){}
 	virtual Image::pixel_type& convert(Image::pixel_type& pixel)const;
+	virtual void convert_row(Image::pixel_type* first, Image::pixel_type* last)const;
+	virtual bool convert_plane(Image::pixel_type::value_type* first, Image::pixel_type::value_type* last, byte_t plane)const;
+	virtual Offset* clone()const{return new Offset(*this);}
 private:
 	const Image::pixel_type::value_type offset_;
 	const bool invert_;
@@ -47,14 +57,24 @@ class Reversal: public Channel{
 public:
 	Reversal(Ch c = R | G | B): Channel(c){}
 	virtual Image::pixel_type& convert(Image::pixel_type& pixel)const;
+	virtual void convert_row(Image::pixel_type* first, Image::pixel_type* last)const;
+	virtual bool convert_plane(Image::pixel_type::value_type* first, Image::pixel_type::value_type* last, byte_t plane)const;
+	virtual Reversal* clone()const{return new Reversal(*this);}
 };
 
 class Gamma: public Channel{
 public:
 	Gamma(const std::vector<Image::pixel_type::value_type>& lut, Ch c = R | G | B);
+	Gamma(TransferFunction::Curve curve, TransferFunction::Direction direction, Ch c = R | G | B, double exponent = 2.2);
+	Gamma(const Gamma& gamma);
 	virtual Image::pixel_type& convert(Image::pixel_type& pixel)const;
+	virtual void convert_row(Image::pixel_type* first, Image::pixel_type* last)const;
+	virtual bool convert_plane(Image::pixel_type::value_type* first, Image::pixel_type::value_type* last, byte_t plane)const;
+	virtual Gamma* clone()const{return new Gamma(*this);}
 private:
+	Gamma& operator=(const Gamma&);
 	std::vector<Image::pixel_type::value_type> lut_;
+	const Image::pixel_type::value_type* table_;
 };
 
 #endif
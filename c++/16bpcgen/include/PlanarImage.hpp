@@ -0,0 +1,44 @@
+#ifndef BPCGEN_PLANARIMAGE_HPP_
+#define BPCGEN_PLANARIMAGE_HPP_
+
+#include <string>
+#include <vector>
+#include "Image.hpp"
+class PixelConverter;
+
+class PlanarImage{
+public:
+	typedef Image::pixel_type pixel_type;
+	typedef pixel_type::value_type value_type;
+	enum Plane{
+		PLANE_R,
+		PLANE_G,
+		PLANE_B
+	};
+	PlanarImage(const column_t& a_width, const row_t& a_height):
+		planes_(3*static_cast<std::size_t>(a_width)*a_height), width_(a_width), height_(a_height){}
+	explicit PlanarImage(const Image& image): planes_(), width_(0), height_(0){deinterleave(image);}
+	explicit PlanarImage(const std::string& filename): planes_(), width_(0), height_(0){read(filename);}
+	PlanarImage  operator>> (const PixelConverter& converter)const;
+	PlanarImage& operator>>=(const PixelConverter& converter);
+	PlanarImage& operator<<(const std::string& filename){return read(filename);}
+	const PlanarImage& operator>>(const std::string& filename)const{return write(filename);}
+	PlanarImage& read(const std::string& filename);
+	const PlanarImage& write(const std::string& filename, Image::FileFormat fmt = Image::FMT_NONE)const;
+	PlanarImage& deinterleave(const Image& image);
+	Image& interleave(Image& image)const;
+	Image image()const;
+	pixel_type pixel(row_t row, column_t column)const;
+	void pixel(row_t row, column_t column, const pixel_type& pixel);
+	      value_type* plane(byte_t channel)      {return &planes_[channel*plane_size()];}
+	const value_type* plane(byte_t channel)const{return &planes_[channel*plane_size()];}
+	const column_t& width()const{return width_;}
+	const row_t& height()const{return height_;}
+	std::size_t plane_size()const{return static_cast<std::size_t>(width_)*height_;}
+private:
+	std::vector<value_type> planes_;
+	column_t width_;
+	row_t height_;
+};
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef BPCGEN_THREADPOOL_HPP_
+#define BPCGEN_THREADPOOL_HPP_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <pthread.h>
+
+#ifdef __GNUC__
+#define ATTRIBUTE_COLD __attribute__((cold))
+#else
+#define ATTRIBUTE_COLD
+#endif
+
+class ThreadPool{
+public:
+	class Task{
+	public:
+		virtual ~Task(){}
+		virtual void run(std::size_t begin, std::size_t end)const = 0;
+	};
+	static ThreadPool& instance();
+	void run(std::size_t begin, std::size_t end, const Task& task, std::size_t grain = 0);
+	void set_threads(std::size_t threads);
+	std::size_t threads()const{return workers_.size() + 1;}
+	static std::size_t default_threads();
+private:
+	explicit ThreadPool(std::size_t threads);
+	~ThreadPool();
+	ThreadPool(const ThreadPool&);
+	ThreadPool& operator=(const ThreadPool&);
+	class Error{
+	public:
+		Error(): type_(ERR_NONE), what_(){}
+		static Error current()ATTRIBUTE_COLD;
+		bool empty()const{return type_ == ERR_NONE;}
+		void raise()const;
+	private:
+		enum Type{
+			ERR_NONE,
+			ERR_INVALID_ARGUMENT,
+			ERR_DOMAIN_ERROR,
+			ERR_LENGTH_ERROR,
+			ERR_OUT_OF_RANGE,
+			ERR_LOGIC_ERROR,
+			ERR_RANGE_ERROR,
+			ERR_OVERFLOW_ERROR,
+			ERR_UNDERFLOW_ERROR,
+			ERR_RUNTIME_ERROR,
+			ERR_BAD_ALLOC,
+			ERR_UNKNOWN
+		};
+		Error(Type type, const std::string& what): type_(type), what_(what){}
+		Type type_;
+		std::string what_;
+	};
+	static void* work(void* pool);
+	void start(std::size_t threads);
+	void stop();
+	void drain();
+	void execute(const Task& task, std::size_t begin, std::size_t end);
+	pthread_mutex_t job_;
+	pthread_mutex_t mutex_;
+	pthread_cond_t wake_;
+	pthread_cond_t done_;
+	pthread_key_t in_task_;
+	std::vector<pthread_t> workers_;
+	const Task* task_;
+	std::size_t next_;
+	std::size_t end_;
+	std::size_t grain_;
+	std::size_t active_;
+	std::size_t generation_;
+	bool quit_;
+	Error error_;
+};
+
+template <typename F>
+class Band: public ThreadPool::Task{
+public:
+	explicit Band(const F& body): body_(body){}
+	void run(std::size_t begin, std::size_t end)const{body_(begin, end);}
+private:
+	const F& body_;
+};
+
+template <typename F>
+void parallel_for(std::size_t begin, std::size_t end, const F& body, std::size_t grain = 0)
+{
+	ThreadPool::instance().run(begin, end, Band<F>(body), grain);
+}
+
+#endif
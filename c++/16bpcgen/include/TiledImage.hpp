@@ -0,0 +1,64 @@
+#ifndef BPCGEN_TILEDIMAGE_HPP_
+#define BPCGEN_TILEDIMAGE_HPP_
+
+#include <cstdio>
+#include <iosfwd>
+#include <list>
+#include <vector>
+#include "Image.hpp"
+class PatternGenerator;
+class PixelConverter;
+
+class TiledImage{
+public:
+	typedef Image::pixel_type pixel_type;
+	TiledImage(const column_t& a_width, const row_t& a_height, column_t a_tile_size = 256, std::size_t a_cache_size = 64);
+	~TiledImage();
+	TiledImage& operator<<=(const PatternGenerator& generator);
+	TiledImage& operator>>=(const PixelConverter& converter);
+	TiledImage& operator<<=(std::istream& is);
+	std::ostream& write(std::ostream& os);
+#ifdef ENABLE_PNG
+	const TiledImage& write_png(const std::string& filename);
+#endif
+	Image crop(column_t x, row_t y, column_t a_width, row_t a_height);
+	TiledImage& paste(const Image& image, column_t x, row_t y);
+	pixel_type pixel(row_t row, column_t column);
+	void pixel(row_t row, column_t column, const pixel_type& pixel);
+	const column_t& width()const{return width_;}
+	const row_t& height()const{return height_;}
+	column_t tile_size()const{return tile_size_;}
+	column_t tiles_x()const{return (width_ + tile_size_ - 1)/tile_size_;}
+	row_t tiles_y()const{return (height_ + tile_size_ - 1)/tile_size_;}
+	std::size_t cache_size()const{return cache_size_;}
+	uint64_t data_size()const{return static_cast<uint64_t>(width_)*height_*Image::pixelsize;}
+	std::size_t spills()const{return spills_;}
+	std::size_t loads()const{return loads_;}
+private:
+	TiledImage(const TiledImage&);
+	TiledImage& operator=(const TiledImage&);
+	class Tile{
+	public:
+		Tile(std::size_t index, column_t size): index_(index), dirty_(false), image_(size, size){}
+		std::size_t index_;
+		bool dirty_;
+		Image image_;
+	};
+	ImageView tile(column_t x, row_t y);
+	Tile& load(std::size_t index);
+	void spill(Tile& tile);
+	void fetch(Tile& tile);
+	uint64_t tile_bytes()const{return static_cast<uint64_t>(tile_size_)*tile_size_*Image::pixelsize;}
+	column_t width_;
+	row_t height_;
+	column_t tile_size_;
+	std::size_t cache_size_;
+	std::list<Tile> cache_;
+	std::vector<std::list<Tile>::iterator> resident_;
+	std::vector<bool> stored_;
+	std::FILE* scratch_;
+	std::size_t spills_;
+	std::size_t loads_;
+};
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef BPCGEN_TRANSFERFUNCTION_HPP_
+#define BPCGEN_TRANSFERFUNCTION_HPP_
+
+#include <deque>
+#include <map>
+#include <utility>
+#include <vector>
+#include <pthread.h>
+#include "Image.hpp"
+
+class TransferFunction{
+public:
+	typedef Image::pixel_type::value_type value_type;
+	typedef std::vector<value_type> table_type;
+	enum Curve{
+		TF_SRGB,
+		TF_BT709,
+		TF_BT1886,
+		TF_PQ,
+		TF_HLG,
+		TF_POWER
+	};
+	enum Direction{
+		TO_LINEAR,
+		TO_SIGNAL
+	};
+	static const std::size_t power_tables = 16;
+	static TransferFunction& instance();
+	const table_type& table(Curve curve, Direction direction, double exponent = 2.2);
+	std::size_t tables();
+	static table_type build(Curve curve, Direction direction, double exponent = 2.2);
+	static double to_linear(Curve curve, double signal, double exponent = 2.2);
+	static double to_signal(Curve curve, double linear, double exponent = 2.2);
+private:
+	typedef std::pair<int, double> key_type;
+	TransferFunction();
+	~TransferFunction();
+	TransferFunction(const TransferFunction&);
+	TransferFunction& operator=(const TransferFunction&);
+	pthread_mutex_t mutex_;
+	std::map<key_type, table_type> tables_;
+	std::deque<key_type> powers_;
+};
+
+#endif
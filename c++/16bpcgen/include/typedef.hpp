@@ -4,6 +4,11 @@
 typedef unsigned char  uint8_t;
 typedef unsigned short uint16_t;
 typedef unsigned int   uint32_t;
+#if defined(__LP64__) || defined(_LP64)
+typedef unsigned long  uint64_t;
+#else
+__extension__ typedef unsigned long long uint64_t;
+#endif
 typedef unsigned char  byte_t;
 typedef unsigned int   column_t;
 typedef unsigned int   row_t;
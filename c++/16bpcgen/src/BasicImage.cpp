@@ -0,0 +1,31 @@
+#include <stdexcept>
+#include "BasicImage.hpp"
+
+namespace{
+template <typename T>
+void write_png(const BasicImage<T>& image, const std::string& filename)
+{
+#ifdef ENABLE_PNG
+	Image::write_png(append_ext(filename, ".png"), image.head(), image.width(), image.height(), image.pitch(), 8*sizeof(T));
+#else
+	throw std::invalid_argument(__func__ + std::string(": can not write. unsupported file format: ") + filename);
+#endif
+}
+}
+
+/**
+ * 8bitのプレビューは8bitのPNGとしてそのまま書き出す。16bitのImageを経由しないので、転送量は半分で済む。
+ */
+template <>
+const Image8& Image8::write(const std::string& filename)const
+{
+	write_png(*this, filename);
+	return *this;
+}
+
+template <>
+const Image16& Image16::write(const std::string& filename)const
+{
+	write_png(*this, filename);
+	return *this;
+}
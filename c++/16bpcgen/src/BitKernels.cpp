@@ -0,0 +1,324 @@
+#include <algorithm>
+#include "BitKernels.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BPCGEN_X86
+#define BPCGEN_TARGET(isa) __attribute__((target(isa)))
+#include <immintrin.h>
+#endif
+
+template <bool Or>
+static void binary_scalar(uint16_t* dst, const uint16_t* src, std::size_t size)
+{
+	for(std::size_t i = 0; i < size; ++i){
+		dst[i] = static_cast<uint16_t>(Or ? dst[i] | src[i] : dst[i] & src[i]);
+	}
+}
+
+enum MaskOp{
+	MASK_AND,
+	MASK_OR,
+	MASK_XOR,
+	MASK_ADDS,
+	MASK_SUBS
+};
+
+template <int Op>
+static uint16_t mask_op(uint16_t a, uint16_t m)
+{
+	switch(Op){
+	case MASK_AND:  return static_cast<uint16_t>(a & m);
+	case MASK_OR:   return static_cast<uint16_t>(a | m);
+	case MASK_XOR:  return static_cast<uint16_t>(a ^ m);
+	case MASK_ADDS: return static_cast<uint16_t>(std::min(a + m, 0xffff));
+	default:        return static_cast<uint16_t>(std::max(a - m, 0));
+	}
+}
+
+template <int Op>
+static void mask_scalar(uint16_t* dst, const uint16_t* mask, std::size_t size)
+{
+	for(std::size_t i = 0; i < size; ++i){
+		dst[i] = mask_op<Op>(dst[i], mask[i%3]);
+	}
+}
+
+template <bool Left>
+static void shift_scalar(uint16_t* dst, std::size_t size, byte_t shift)
+{
+	for(std::size_t i = 0; i < size; ++i){
+		dst[i] = static_cast<uint16_t>(16 <= shift ? 0 : Left ? dst[i] << shift : dst[i] >> shift);
+	}
+}
+
+#ifdef BPCGEN_X86
+template <typename V>
+static V* lanes(uint16_t* p){return static_cast<V*>(static_cast<void*>(p));}
+
+template <typename V>
+static const V* lanes(const uint16_t* p){return static_cast<const V*>(static_cast<const void*>(p));}
+
+/**
+ * マスクは画素(R, G, B)の3レーン周期なので、ベクタ3本分の長さに展開して使う。
+ */
+static void expand_mask(uint16_t* pattern, const uint16_t* mask, std::size_t size)
+{
+	for(std::size_t i = 0; i < size; ++i){
+		pattern[i] = mask[i%3];
+	}
+}
+
+template <bool Or>
+BPCGEN_TARGET("sse2") static void binary_sse2(uint16_t* dst, const uint16_t* src, std::size_t size)
+{
+	std::size_t i = 0;
+	for(; i + 8 <= size; i += 8){
+		const __m128i a = _mm_loadu_si128(lanes<__m128i>(dst + i));
+		const __m128i b = _mm_loadu_si128(lanes<__m128i>(src + i));
+		_mm_storeu_si128(lanes<__m128i>(dst + i), Or ? _mm_or_si128(a, b) : _mm_and_si128(a, b));
+	}
+	binary_scalar<Or>(dst + i, src + i, size - i);
+}
+
+template <bool Or>
+BPCGEN_TARGET("avx2") static void binary_avx2(uint16_t* dst, const uint16_t* src, std::size_t size)
+{
+	std::size_t i = 0;
+	for(; i + 16 <= size; i += 16){
+		const __m256i a = _mm256_loadu_si256(lanes<__m256i>(dst + i));
+		const __m256i b = _mm256_loadu_si256(lanes<__m256i>(src + i));
+		_mm256_storeu_si256(lanes<__m256i>(dst + i), Or ? _mm256_or_si256(a, b) : _mm256_and_si256(a, b));
+	}
+	binary_scalar<Or>(dst + i, src + i, size - i);
+}
+
+template <bool Or>
+BPCGEN_TARGET("avx512f,avx512bw") static void binary_avx512(uint16_t* dst, const uint16_t* src, std::size_t size)
+{
+	std::size_t i = 0;
+	for(; i + 32 <= size; i += 32){
+		const __m512i a = _mm512_loadu_si512(dst + i);
+		const __m512i b = _mm512_loadu_si512(src + i);
+		_mm512_storeu_si512(dst + i, Or ? _mm512_or_si512(a, b) : _mm512_and_si512(a, b));
+	}
+	binary_scalar<Or>(dst + i, src + i, size - i);
+}
+
+template <int Op>
+BPCGEN_TARGET("sse2") static __m128i mask_op(__m128i a, __m128i m)
+{
+	switch(Op){
+	case MASK_AND:  return _mm_and_si128(a, m);
+	case MASK_OR:   return _mm_or_si128(a, m);
+	case MASK_XOR:  return _mm_xor_si128(a, m);
+	case MASK_ADDS: return _mm_adds_epu16(a, m);
+	default:        return _mm_subs_epu16(a, m);
+	}
+}
+
+template <int Op>
+BPCGEN_TARGET("avx2") static __m256i mask_op(__m256i a, __m256i m)
+{
+	switch(Op){
+	case MASK_AND:  return _mm256_and_si256(a, m);
+	case MASK_OR:   return _mm256_or_si256(a, m);
+	case MASK_XOR:  return _mm256_xor_si256(a, m);
+	case MASK_ADDS: return _mm256_adds_epu16(a, m);
+	default:        return _mm256_subs_epu16(a, m);
+	}
+}
+
+template <int Op>
+BPCGEN_TARGET("avx512f,avx512bw") static __m512i mask_op(__m512i a, __m512i m)
+{
+	switch(Op){
+	case MASK_AND:  return _mm512_and_si512(a, m);
+	case MASK_OR:   return _mm512_or_si512(a, m);
+	case MASK_XOR:  return _mm512_xor_si512(a, m);
+	case MASK_ADDS: return _mm512_adds_epu16(a, m);
+	default:        return _mm512_subs_epu16(a, m);
+	}
+}
+
+template <int Op>
+BPCGEN_TARGET("sse2") static void mask_sse2(uint16_t* dst, const uint16_t* mask, std::size_t size)
+{
+	uint16_t pattern[3*8];
+	expand_mask(pattern, mask, 3*8);
+	const __m128i m0 = _mm_loadu_si128(lanes<__m128i>(pattern));
+	const __m128i m1 = _mm_loadu_si128(lanes<__m128i>(pattern + 8));
+	const __m128i m2 = _mm_loadu_si128(lanes<__m128i>(pattern + 16));
+	std::size_t i = 0;
+	for(; i + 3*8 <= size; i += 3*8){
+		const __m128i a0 = _mm_loadu_si128(lanes<__m128i>(dst + i));
+		const __m128i a1 = _mm_loadu_si128(lanes<__m128i>(dst + i + 8));
+		const __m128i a2 = _mm_loadu_si128(lanes<__m128i>(dst + i + 16));
+		_mm_storeu_si128(lanes<__m128i>(dst + i),      mask_op<Op>(a0, m0));
+		_mm_storeu_si128(lanes<__m128i>(dst + i + 8),  mask_op<Op>(a1, m1));
+		_mm_storeu_si128(lanes<__m128i>(dst + i + 16), mask_op<Op>(a2, m2));
+	}
+	mask_scalar<Op>(dst + i, mask, size - i);
+}
+
+template <int Op>
+BPCGEN_TARGET("avx2") static void mask_avx2(uint16_t* dst, const uint16_t* mask, std::size_t size)
+{
+	uint16_t pattern[3*16];
+	expand_mask(pattern, mask, 3*16);
+	const __m256i m0 = _mm256_loadu_si256(lanes<__m256i>(pattern));
+	const __m256i m1 = _mm256_loadu_si256(lanes<__m256i>(pattern + 16));
+	const __m256i m2 = _mm256_loadu_si256(lanes<__m256i>(pattern + 32));
+	std::size_t i = 0;
+	for(; i + 3*16 <= size; i += 3*16){
+		const __m256i a0 = _mm256_loadu_si256(lanes<__m256i>(dst + i));
+		const __m256i a1 = _mm256_loadu_si256(lanes<__m256i>(dst + i + 16));
+		const __m256i a2 = _mm256_loadu_si256(lanes<__m256i>(dst + i + 32));
+		_mm256_storeu_si256(lanes<__m256i>(dst + i),      mask_op<Op>(a0, m0));
+		_mm256_storeu_si256(lanes<__m256i>(dst + i + 16), mask_op<Op>(a1, m1));
+		_mm256_storeu_si256(lanes<__m256i>(dst + i + 32), mask_op<Op>(a2, m2));
+	}
+	mask_scalar<Op>(dst + i, mask, size - i);
+}
+
+template <int Op>
+BPCGEN_TARGET("avx512f,avx512bw") static void mask_avx512(uint16_t* dst, const uint16_t* mask, std::size_t size)
+{
+	uint16_t pattern[3*32];
+	expand_mask(pattern, mask, 3*32);
+	const __m512i m0 = _mm512_loadu_si512(pattern);
+	const __m512i m1 = _mm512_loadu_si512(pattern + 32);
+	const __m512i m2 = _mm512_loadu_si512(pattern + 64);
+	std::size_t i = 0;
+	for(; i + 3*32 <= size; i += 3*32){
+		const __m512i a0 = _mm512_loadu_si512(dst + i);
+		const __m512i a1 = _mm512_loadu_si512(dst + i + 32);
+		const __m512i a2 = _mm512_loadu_si512(dst + i + 64);
+		_mm512_storeu_si512(dst + i,      mask_op<Op>(a0, m0));
+		_mm512_storeu_si512(dst + i + 32, mask_op<Op>(a1, m1));
+		_mm512_storeu_si512(dst + i + 64, mask_op<Op>(a2, m2));
+	}
+	mask_scalar<Op>(dst + i, mask, size - i);
+}
+
+template <bool Left>
+BPCGEN_TARGET("sse2") static void shift_sse2(uint16_t* dst, std::size_t size, byte_t shift)
+{
+	const __m128i count = _mm_cvtsi32_si128(shift);
+	std::size_t i = 0;
+	for(; i + 8 <= size; i += 8){
+		const __m128i a = _mm_loadu_si128(lanes<__m128i>(dst + i));
+		_mm_storeu_si128(lanes<__m128i>(dst + i), Left ? _mm_sll_epi16(a, count) : _mm_srl_epi16(a, count));
+	}
+	shift_scalar<Left>(dst + i, size - i, shift);
+}
+
+template <bool Left>
+BPCGEN_TARGET("avx2") static void shift_avx2(uint16_t* dst, std::size_t size, byte_t shift)
+{
+	const __m128i count = _mm_cvtsi32_si128(shift);
+	std::size_t i = 0;
+	for(; i + 16 <= size; i += 16){
+		const __m256i a = _mm256_loadu_si256(lanes<__m256i>(dst + i));
+		_mm256_storeu_si256(lanes<__m256i>(dst + i), Left ? _mm256_sll_epi16(a, count) : _mm256_srl_epi16(a, count));
+	}
+	shift_scalar<Left>(dst + i, size - i, shift);
+}
+
+template <bool Left>
+BPCGEN_TARGET("avx512f,avx512bw") static void shift_avx512(uint16_t* dst, std::size_t size, byte_t shift)
+{
+	const __m128i count = _mm_cvtsi32_si128(shift);
+	std::size_t i = 0;
+	for(; i + 32 <= size; i += 32){
+		const __m512i a = _mm512_loadu_si512(dst + i);
+		_mm512_storeu_si512(dst + i, Left ? _mm512_sll_epi16(a, count) : _mm512_srl_epi16(a, count));
+	}
+	shift_scalar<Left>(dst + i, size - i, shift);
+}
+#endif
+
+template <bool Or>
+static void binary(uint16_t* dst, const uint16_t* src, std::size_t size)
+{
+#ifdef BPCGEN_X86
+	if(BitKernels::isa() == BitKernels::ISA_AVX512){
+		return binary_avx512<Or>(dst, src, size);
+	}else if(BitKernels::isa() == BitKernels::ISA_AVX2){
+		return binary_avx2<Or>(dst, src, size);
+	}else if(BitKernels::isa() == BitKernels::ISA_SSE2){
+		return binary_sse2<Or>(dst, src, size);
+	}
+#endif
+	binary_scalar<Or>(dst, src, size);
+}
+
+template <int Op>
+static void masked(uint16_t* dst, const uint16_t* mask, std::size_t size)
+{
+#ifdef BPCGEN_X86
+	if(BitKernels::isa() == BitKernels::ISA_AVX512){
+		return mask_avx512<Op>(dst, mask, size);
+	}else if(BitKernels::isa() == BitKernels::ISA_AVX2){
+		return mask_avx2<Op>(dst, mask, size);
+	}else if(BitKernels::isa() == BitKernels::ISA_SSE2){
+		return mask_sse2<Op>(dst, mask, size);
+	}
+#endif
+	mask_scalar<Op>(dst, mask, size);
+}
+
+template <bool Left>
+static void shift(uint16_t* dst, std::size_t size, byte_t count)
+{
+#ifdef BPCGEN_X86
+	if(BitKernels::isa() == BitKernels::ISA_AVX512){
+		return shift_avx512<Left>(dst, size, count);
+	}else if(BitKernels::isa() == BitKernels::ISA_AVX2){
+		return shift_avx2<Left>(dst, size, count);
+	}else if(BitKernels::isa() == BitKernels::ISA_SSE2){
+		return shift_sse2<Left>(dst, size, count);
+	}
+#endif
+	shift_scalar<Left>(dst, size, count);
+}
+
+void BitKernels::bit_and(uint16_t* dst, const uint16_t* src, std::size_t size){binary<false>(dst, src, size);}
+void BitKernels::bit_or (uint16_t* dst, const uint16_t* src, std::size_t size){binary<true >(dst, src, size);}
+void BitKernels::mask_and(uint16_t* dst, const uint16_t* mask, std::size_t size){masked<MASK_AND>(dst, mask, size);}
+void BitKernels::mask_or (uint16_t* dst, const uint16_t* mask, std::size_t size){masked<MASK_OR >(dst, mask, size);}
+void BitKernels::mask_xor(uint16_t* dst, const uint16_t* mask, std::size_t size){masked<MASK_XOR>(dst, mask, size);}
+void BitKernels::add_saturate     (uint16_t* dst, const uint16_t* addend, std::size_t size){masked<MASK_ADDS>(dst, addend, size);}
+void BitKernels::subtract_saturate(uint16_t* dst, const uint16_t* subtrahend, std::size_t size){masked<MASK_SUBS>(dst, subtrahend, size);}
+void BitKernels::shift_left (uint16_t* dst, std::size_t size, byte_t count){shift<true >(dst, size, count);}
+void BitKernels::shift_right(uint16_t* dst, std::size_t size, byte_t count){shift<false>(dst, size, count);}
+
+BitKernels::Isa BitKernels::isa()
+{
+	return selected();
+}
+
+BitKernels::Isa BitKernels::supported()
+{
+#ifdef BPCGEN_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx512bw")){
+		return ISA_AVX512;
+	}else if(__builtin_cpu_supports("avx2")){
+		return ISA_AVX2;
+	}else if(__builtin_cpu_supports("sse2")){
+		return ISA_SSE2;
+	}
+#endif
+	return ISA_SCALAR;
+}
+
+void BitKernels::set_isa(Isa isa)
+{
+	selected() = std::min(isa, supported());
+}
+
+BitKernels::Isa& BitKernels::selected()
+{
+	static Isa isa = supported();
+	return isa;
+}
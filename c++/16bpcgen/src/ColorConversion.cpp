@@ -0,0 +1,468 @@
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include "ColorConversion.hpp"
+#include "ThreadPool.hpp"
+
+namespace{
+typedef ColorConversion::pixel_type pixel_type;
+typedef pixel_type::value_type value_type;
+
+/**
+ * CIE RGBからXYZへの変換行列。
+ * 各行の和が等しい(等エネルギー白色)ので、和で割れば白色がXYZ=(max, max, max)になる。
+ */
+const double cie_rgb_to_xyz[3][3] = {
+	{2.7689, 1.7517, 1.1302},
+	{1.0000, 4.5907, 0.0601},
+	{0.0000, 0.0565, 5.5943}
+};
+const double cie_white = 5.6508;
+
+inline value_type saturate(double value, byte_t& flag)
+{
+	if(value < -0.5){
+		flag |= ColorConversion::OUT_OF_GAMUT;
+		return 0;
+	}
+	if(pixel_type::max + 0.5 <= value){
+		flag |= ColorConversion::OUT_OF_GAMUT;
+		return pixel_type::max;
+	}
+	return static_cast<value_type>(value + 0.5);
+}
+
+std::vector<uint64_t> reciprocal_table(uint64_t numerator, uint64_t divisor)
+{
+	std::vector<uint64_t> table(static_cast<std::size_t>(pixel_type::max) + 1, 0);
+	for(std::size_t i = 1; i < table.size(); ++i){
+		table[i] = (numerator + divisor*i/2)/(divisor*i);
+	}
+	return table;
+}
+
+/**
+ * table[m] = round(2^24*max/m)。table[0] = 0。
+ */
+const std::vector<uint64_t>& saturation_reciprocal()
+{
+	static const std::vector<uint64_t> table = reciprocal_table(static_cast<uint64_t>(pixel_type::max) << 24, 1);
+	return table;
+}
+
+/**
+ * table[d] = round(2^40/(6d))。table[0] = 0。
+ */
+const std::vector<uint64_t>& hue_reciprocal()
+{
+	static const std::vector<uint64_t> table = reciprocal_table(static_cast<uint64_t>(1u) << 40, 6);
+	return table;
+}
+
+/**
+ * hsv_to_rgb_fixedの1チャンネル分。hueとwはQ16。
+ */
+inline value_type hsv_channel(int hue, int n, uint32_t v, uint32_t c)
+{
+	const int one = 1 << 16;
+	int k = hue + n*one;
+	k = 6*one <= k ? k - 6*one : k;
+	const uint32_t w = static_cast<uint32_t>(std::min(std::max(std::min(k, 4*one - k), 0), one));
+	return static_cast<value_type>(v - ((c*w + 0x8000u) >> 16));
+}
+
+class Rows{
+public:
+	Rows(const ColorConversion& conversion, const Image& image, const ImageView& result, std::vector<byte_t>* mask, bool forward):
+		conversion_(conversion), image_(image), result_(result), mask_(mask), forward_(forward){}
+	void operator()(std::size_t begin, std::size_t end)const
+	{
+		for(row_t h = static_cast<row_t>(begin); h < end; ++h){
+			const pixel_type* const first = &image_[h][0];
+			byte_t* const mask = mask_ ? &(*mask_)[h*static_cast<std::size_t>(image_.width())] : NULL;
+			if(forward_){
+				conversion_.from_rgb(first, first + image_.width(), &result_[h][0], mask);
+			}else{
+				conversion_.to_rgb(first, first + image_.width(), &result_[h][0], mask);
+			}
+		}
+	}
+private:
+	const ColorConversion& conversion_;
+	const Image& image_;
+	const ImageView result_;
+	std::vector<byte_t>* const mask_;
+	const bool forward_;
+};
+}
+
+ColorConversion::Affine::Affine():
+	matrix_(), offset_in_(), offset_out_(), lower_(), upper_()
+{
+	for(int i = 0; i < 3; ++i){
+		matrix_[i][i] = 1.0;
+		upper_[i] = pixel_type::max;
+	}
+}
+
+void ColorConversion::Affine::invert(const Affine& affine)
+{
+	const double (&m)[3][3] = affine.matrix_;
+	const double det =
+		m[0][0]*(m[1][1]*m[2][2] - m[1][2]*m[2][1]) -
+		m[0][1]*(m[1][0]*m[2][2] - m[1][2]*m[2][0]) +
+		m[0][2]*(m[1][0]*m[2][1] - m[1][1]*m[2][0]);
+	for(int i = 0; i < 3; ++i){
+		for(int j = 0; j < 3; ++j){
+			const int r0 = (j + 1)%3, r1 = (j + 2)%3;
+			const int c0 = (i + 1)%3, c1 = (i + 2)%3;
+			matrix_[i][j] = (m[r0][c0]*m[r1][c1] - m[r0][c1]*m[r1][c0])/det;
+		}
+		offset_in_[i]  = affine.offset_out_[i];
+		offset_out_[i] = affine.offset_in_[i];
+	}
+}
+
+/**
+ * result = matrix*(pixel - offset_in) + offset_out を求め、四捨五入して[0, max]に収める。
+ * 入力が[lower, upper]の外ならOUT_OF_RANGE、四捨五入した値を切り詰めたらOUT_OF_GAMUTをmaskに立てる。
+ */
+std::size_t ColorConversion::Affine::apply(const pixel_type* first, const pixel_type* last, pixel_type* result, byte_t* mask)const
+{
+	const double m00 = matrix_[0][0], m01 = matrix_[0][1], m02 = matrix_[0][2];
+	const double m10 = matrix_[1][0], m11 = matrix_[1][1], m12 = matrix_[1][2];
+	const double m20 = matrix_[2][0], m21 = matrix_[2][1], m22 = matrix_[2][2];
+	std::size_t count = 0;
+	for(; first != last; ++first, ++result){
+		const double a = first->R() - offset_in_[0];
+		const double b = first->G() - offset_in_[1];
+		const double c = first->B() - offset_in_[2];
+		byte_t flag = 0;
+		if(first->R() < lower_[0] || upper_[0] < first->R() ||
+		   first->G() < lower_[1] || upper_[1] < first->G() ||
+		   first->B() < lower_[2] || upper_[2] < first->B()){
+			flag = OUT_OF_RANGE;
+		}
+		result->R(saturate(m00*a + m01*b + m02*c + offset_out_[0], flag));
+		result->G(saturate(m10*a + m11*b + m12*c + offset_out_[1], flag));
+		result->B(saturate(m20*a + m21*b + m22*c + offset_out_[2], flag));
+		count += flag ? 1 : 0;
+		if(mask){
+			*mask++ = flag;
+		}
+	}
+	return count;
+}
+
+ColorConversion::Fixed::Fixed():
+	forward_(), complement_(), constant_(), inverse_(), offset_(), lower_(), upper_(){}
+
+/**
+ * 順変換はQ16の符号なし32bit演算で行う。
+ * 負の係数cには、c*x = |c|*(max - x) - |c|*max と書き換えて補数(x ^ 0xffff)を掛け、
+ * 定数項をまとめておく。YCbCrでは全ての項が非負になり、和も2^32未満に収まる。
+ * 逆変換はQ14の符号付き32bit演算で行う。入力をリミテッドレンジに収めておけば和は±2^31未満に収まる。
+ * 倍精度の変換に対する誤差は、順変換で±1、逆変換で±3(BT.601)、±2(BT.709, BT.2020)以内。
+ * 逆変換のOUT_OF_GAMUTは、この誤差の分だけ境界付近で倍精度と食い違うことがある。
+ */
+void ColorConversion::Fixed::setup(const Affine& forward, const Affine& inverse)
+{
+	for(int i = 0; i < 3; ++i){
+		double constant = forward.offset_out_[i]*65536.0 + 32768.0;
+		for(int j = 0; j < 3; ++j){
+			const double c = forward.matrix_[i][j]*65536.0;
+			forward_[i][j] = static_cast<uint32_t>(std::abs(c) + 0.5);
+			complement_[i][j] = c < 0.0 ? 0xffffu : 0x0u;
+			if(c < 0.0){
+				constant -= static_cast<double>(forward_[i][j])*pixel_type::max;
+			}
+			inverse_[i][j] = static_cast<int>(inverse.matrix_[i][j]*16384.0 + (inverse.matrix_[i][j] < 0.0 ? -0.5 : 0.5));
+		}
+		constant_[i] = static_cast<uint32_t>(constant + 0.5);
+		offset_[i] = static_cast<int>(inverse.offset_in_[i] + 0.5);
+		lower_[i]  = static_cast<int>(inverse.lower_[i] + 0.5);
+		upper_[i]  = static_cast<int>(inverse.upper_[i] + 0.5);
+	}
+}
+
+std::size_t ColorConversion::Fixed::forward(const pixel_type* first, const pixel_type* last, pixel_type* result, byte_t* mask)const
+{
+	const value_type* src = reinterpret_cast<const value_type*>(first);
+	value_type* dst = reinterpret_cast<value_type*>(result);
+	const std::size_t size = static_cast<std::size_t>(last - first);
+	for(std::size_t i = 0; i < size; ++i, src += 3, dst += 3){
+		const uint32_t r = src[0], g = src[1], b = src[2];
+		for(int k = 0; k < 3; ++k){
+			dst[k] = static_cast<value_type>((
+				forward_[k][0]*(r ^ complement_[k][0]) +
+				forward_[k][1]*(g ^ complement_[k][1]) +
+				forward_[k][2]*(b ^ complement_[k][2]) + constant_[k]) >> 16);
+		}
+	}
+	if(mask){
+		std::fill(mask, mask + size, 0);
+	}
+	return 0;
+}
+
+std::size_t ColorConversion::Fixed::inverse(const pixel_type* first, const pixel_type* last, pixel_type* result, byte_t* mask)const
+{
+	const value_type* src = reinterpret_cast<const value_type*>(first);
+	value_type* dst = reinterpret_cast<value_type*>(result);
+	const std::size_t size = static_cast<std::size_t>(last - first);
+	const int top = ((pixel_type::max + 1) << 14) - 1;
+	std::size_t count = 0;
+	for(std::size_t i = 0; i < size; ++i, src += 3, dst += 3){
+		int x[3];
+		byte_t flag = 0;
+		for(int k = 0; k < 3; ++k){
+			const int v = src[k];
+			flag |= v < lower_[k] || upper_[k] < v ? OUT_OF_RANGE : 0;
+			x[k] = std::min(std::max(v, lower_[k]), upper_[k]) - offset_[k];
+		}
+		for(int k = 0; k < 3; ++k){
+			const int t = inverse_[k][0]*x[0] + inverse_[k][1]*x[1] + inverse_[k][2]*x[2] + 8192;
+			flag |= t < 0 || top < t ? OUT_OF_GAMUT : 0;
+			dst[k] = static_cast<value_type>(std::min(std::max(t, 0), top) >> 14);
+		}
+		count += flag ? 1 : 0;
+		if(mask){
+			mask[i] = flag;
+		}
+	}
+	return count;
+}
+
+/**
+ * 係数行列は色空間ごとに一度だけ求めておき、変換中は画素ごとの分岐を持たない。
+ * YCbCrは16bitに拡大したリミテッドレンジ(Y: 16-235, C: 16-240)で表す。
+ * HSVはHを[0, 360)度を[0, 65536)に対応させた値、S, Vを[0, max]で表す。
+ * XYZはCIE RGBの白色がXYZ=(max, max, max)となるよう正規化する。
+ */
+ColorConversion::ColorConversion(ColorSpace cs, Precision precision):
+	cs_(cs), precision_(precision), forward_(), inverse_(), fixed_()
+{
+	double kr = 0.0, kb = 0.0;
+	switch(cs_){
+	case pixel_type::CS_RGB:
+		return;
+	case pixel_type::CS_HSV:
+		if(precision_ == PREC_FIXED){
+			saturation_reciprocal();
+			hue_reciprocal();
+		}
+		return;
+	case pixel_type::CS_YCBCR_BT601:
+		kr = 0.2990;
+		kb = 0.1140;
+		break;
+	case pixel_type::CS_YCBCR_BT709:
+		kr = 0.2126;
+		kb = 0.0722;
+		break;
+	case pixel_type::CS_YCBCR_BT2020:
+		kr = 0.2627;
+		kb = 0.0593;
+		break;
+	case pixel_type::CS_XYZ:
+		for(int i = 0; i < 3; ++i){
+			for(int j = 0; j < 3; ++j){
+				forward_.matrix_[i][j] = cie_rgb_to_xyz[i][j]/cie_white;
+			}
+		}
+		inverse_.invert(forward_);
+		return;
+	default:
+		throw std::invalid_argument(__func__ + std::string(": can not convert color space. unknown color space."));
+	}
+	const double kg = 1.0 - kr - kb;
+	const double y = 219.0/255.0, cb = 224.0/255.0/(2.0*(1.0 - kb)), cr = 224.0/255.0/(2.0*(1.0 - kr));
+	const double matrix[3][3] = {
+		{ kr*y,          kg*y,  kb*y        },
+		{-kr*cb,        -kg*cb, (1.0 - kb)*cb},
+		{(1.0 - kr)*cr, -kg*cr, -kb*cr      }
+	};
+	const double offset[3] = {16.0*pixel_type::max/255.0, 128.0*pixel_type::max/255.0, 128.0*pixel_type::max/255.0};
+	for(int i = 0; i < 3; ++i){
+		for(int j = 0; j < 3; ++j){
+			forward_.matrix_[i][j] = matrix[i][j];
+		}
+		forward_.offset_out_[i] = offset[i];
+	}
+	inverse_.invert(forward_);
+	inverse_.lower_[0] =  16.0*pixel_type::max/255.0;
+	inverse_.upper_[0] = 235.0*pixel_type::max/255.0;
+	for(int i = 1; i < 3; ++i){
+		inverse_.lower_[i] =  16.0*pixel_type::max/255.0;
+		inverse_.upper_[i] = 240.0*pixel_type::max/255.0;
+	}
+	fixed_.setup(forward_, inverse_);
+}
+
+/**
+ * [first, last)のRGB画素を変換してresultへ書き込み、範囲外となった画素の数を返す。
+ * resultはfirstと同じでもよい。maskを渡すと画素ごとのフラグを書き込む。
+ */
+std::size_t ColorConversion::from_rgb(const pixel_type* first, const pixel_type* last, pixel_type* result, byte_t* mask)const
+{
+	switch(cs_){
+	case pixel_type::CS_RGB:
+		return rgb(first, last, result, mask);
+	case pixel_type::CS_HSV:
+		return precision_ == PREC_FIXED ? hsv_fixed(first, last, result, mask) : hsv(first, last, result, mask);
+	case pixel_type::CS_YCBCR_BT601:
+	case pixel_type::CS_YCBCR_BT709:
+	case pixel_type::CS_YCBCR_BT2020:
+		return precision_ == PREC_FIXED ? fixed_.forward(first, last, result, mask) : forward_.apply(first, last, result, mask);
+	case pixel_type::CS_XYZ:
+	default:
+		return forward_.apply(first, last, result, mask);
+	}
+}
+
+std::size_t ColorConversion::to_rgb(const pixel_type* first, const pixel_type* last, pixel_type* result, byte_t* mask)const
+{
+	switch(cs_){
+	case pixel_type::CS_RGB:
+		return rgb(first, last, result, mask);
+	case pixel_type::CS_HSV:
+		return precision_ == PREC_FIXED ? hsv_to_rgb_fixed(first, last, result, mask) : hsv_to_rgb(first, last, result, mask);
+	case pixel_type::CS_YCBCR_BT601:
+	case pixel_type::CS_YCBCR_BT709:
+	case pixel_type::CS_YCBCR_BT2020:
+		return precision_ == PREC_FIXED ? fixed_.inverse(first, last, result, mask) : inverse_.apply(first, last, result, mask);
+	case pixel_type::CS_XYZ:
+	default:
+		return inverse_.apply(first, last, result, mask);
+	}
+}
+
+Image ColorConversion::from_rgb(const Image& image, std::vector<byte_t>* mask)const
+{
+	return convert(image, mask, true);
+}
+
+Image ColorConversion::to_rgb(const Image& image, std::vector<byte_t>* mask)const
+{
+	return convert(image, mask, false);
+}
+
+Image ColorConversion::convert(const Image& image, std::vector<byte_t>* mask, bool forward)const
+{
+	Image result(image.width(), image.height());
+	if(mask){
+		mask->assign(static_cast<std::size_t>(image.width())*image.height(), 0);
+	}
+	parallel_for(0, image.height(), Rows(*this, image, result.view(), mask, forward));
+	return result;
+}
+
+/**
+ * 最大値となるチャンネルを選択で求め、画素ごとの分岐を持たない。
+ * 無彩色の画素はH=0とする(diff=0ならnumも0になる)。
+ */
+std::size_t ColorConversion::hsv(const pixel_type* first, const pixel_type* last, pixel_type* result, byte_t* mask)
+{
+	if(mask){
+		std::fill(mask, mask + (last - first), 0);
+	}
+	for(; first != last; ++first, ++result){
+		const int r = first->R(), g = first->G(), b = first->B();
+		const int maximum = std::max(std::max(r, g), b);
+		const int diff = maximum - std::min(std::min(r, g), b);
+		const bool r_max = maximum == r;
+		const bool g_max = !r_max && maximum == g;
+		const int num  = r_max ? g - b : g_max ? b - r : r - g;
+		const int base = r_max ? (g < b ? 6 : 0) : g_max ? 2 : 4;
+		const double hue = base + static_cast<double>(num)/std::max(diff, 1);
+		const double saturation = static_cast<double>(diff)*pixel_type::max/std::max(maximum, 1);
+		result->R(static_cast<value_type>(static_cast<uint32_t>(hue*65536.0/6.0 + 0.5) & 0xffffu));
+		result->G(static_cast<value_type>(saturation + 0.5));
+		result->B(static_cast<value_type>(maximum));
+	}
+	return 0;
+}
+
+/**
+ * 除算を逆数表との積に置き換えた整数版。
+ * Hは[0, 6diff)に収めた値に2^40/(6diff)を掛け、Sはdiffに2^24*max/maximumを掛けて求める。
+ */
+std::size_t ColorConversion::hsv_fixed(const pixel_type* first, const pixel_type* last, pixel_type* result, byte_t* mask)
+{
+	const std::vector<uint64_t>& hue_table = hue_reciprocal();
+	const std::vector<uint64_t>& saturation_table = saturation_reciprocal();
+	const uint64_t half = 1u << 23;
+	if(mask){
+		std::fill(mask, mask + (last - first), 0);
+	}
+	for(; first != last; ++first, ++result){
+		const uint32_t r = first->R(), g = first->G(), b = first->B();
+		const uint32_t maximum = std::max(std::max(r, g), b);
+		const uint32_t diff = maximum - std::min(std::min(r, g), b);
+		const bool r_max = maximum == r;
+		const bool g_max = !r_max && maximum == g;
+		const uint32_t base = r_max ? (g < b ? 6*diff : 0) : g_max ? 2*diff : 4*diff;
+		const uint32_t num = base + (r_max ? g - b : g_max ? b - r : r - g);
+		result->R(static_cast<value_type>(((num*hue_table[diff] + half) >> 24) & 0xffffu));
+		result->G(static_cast<value_type>((diff*saturation_table[maximum] + half) >> 24));
+		result->B(static_cast<value_type>(maximum));
+	}
+	return 0;
+}
+
+/**
+ * 各チャンネルをV - V*S*clamp(min(k, 4 - k), 0, 1), k = (n + H/60) mod 6で求める。
+ * nはR, G, Bに対してそれぞれ5, 3, 1。
+ */
+std::size_t ColorConversion::hsv_to_rgb(const pixel_type* first, const pixel_type* last, pixel_type* result, byte_t* mask)
+{
+	if(mask){
+		std::fill(mask, mask + (last - first), 0);
+	}
+	for(; first != last; ++first, ++result){
+		const double hue = first->R()*6.0/65536.0;
+		const double v = first->B();
+		const double c = v*first->G()/pixel_type::max;
+		double rgb[3];
+		for(int i = 0; i < 3; ++i){
+			double k = hue + (5 - 2*i);
+			k = 6.0 <= k ? k - 6.0 : k;
+			rgb[i] = v - c*std::min(std::max(std::min(k, 4.0 - k), 0.0), 1.0) + 0.5;
+		}
+		*result = pixel_type(static_cast<value_type>(rgb[0]), static_cast<value_type>(rgb[1]), static_cast<value_type>(rgb[2]));
+	}
+	return 0;
+}
+
+/**
+ * hsv_to_rgbと同じ式を32bit整数で計算する。
+ * 彩度分C = V*S/maxはt = V*S + 2^15として(t + (t >> 16)) >> 16で丸め、wはQ16で表す。
+ */
+std::size_t ColorConversion::hsv_to_rgb_fixed(const pixel_type* first, const pixel_type* last, pixel_type* result, byte_t* mask)
+{
+	if(mask){
+		std::fill(mask, mask + (last - first), 0);
+	}
+	for(; first != last; ++first, ++result){
+		const int hue = first->R()*6;
+		const uint32_t v = first->B();
+		const uint32_t t = v*first->G() + 0x8000u;
+		const uint32_t c = (t + (t >> 16)) >> 16;
+		result->R(hsv_channel(hue, 5, v, c));
+		result->G(hsv_channel(hue, 3, v, c));
+		result->B(hsv_channel(hue, 1, v, c));
+	}
+	return 0;
+}
+
+std::size_t ColorConversion::rgb(const pixel_type* first, const pixel_type* last, pixel_type* result, byte_t* mask)
+{
+	if(mask){
+		std::fill(mask, mask + (last - first), 0);
+	}
+	if(first != result){
+		std::copy(first, last, result);
+	}
+	return 0;
+}
@@ -0,0 +1,86 @@
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include "Compositor.hpp"
+#include "ThreadPool.hpp"
+
+namespace{
+class Blit{
+public:
+	Blit(const Image& image, const ImageView& canvas): image_(image), canvas_(canvas){}
+	void operator()(std::size_t begin, std::size_t end)const
+	{
+		for(row_t h = static_cast<row_t>(begin); h < end; ++h){
+			std::copy(&image_[h][0], &image_[h][image_.width()], &canvas_[h][0]);
+		}
+	}
+private:
+	const Image& image_;
+	const ImageView canvas_;
+};
+}
+
+const std::size_t Compositor::no_cell;
+
+Compositor& Compositor::add(const Image& image)
+{
+	if(columns_ == 0){
+		throw std::invalid_argument(__func__ + std::string(": can not add image. grid has no columns."));
+	}
+	tiles_.push_back(Tile(image, 0, 0, cells_++));
+	return *this;
+}
+
+Compositor& Compositor::add(const Image& image, column_t x, row_t y)
+{
+	tiles_.push_back(Tile(image, x, y, no_cell));
+	return *this;
+}
+
+Image Compositor::compose(const Image::pixel_type& background)const
+{
+	const std::size_t rows = columns_ ? (cells_ + columns_ - 1)/columns_ : 0;
+	std::vector<column_t> lefts(columns_ + 1, 0);
+	std::vector<row_t> tops(rows + 1, 0);
+	for(std::size_t i = 0; i < tiles_.size(); ++i){
+		const Tile& tile = tiles_[i];
+		if(tile.cell_ != no_cell){
+			lefts[tile.cell_%columns_ + 1] = std::max(lefts[tile.cell_%columns_ + 1], tile.image_.width());
+			tops[tile.cell_/columns_ + 1]  = std::max(tops[tile.cell_/columns_ + 1],  tile.image_.height());
+		}
+	}
+	for(std::size_t i = 1; i < lefts.size(); ++i){
+		lefts[i] += lefts[i - 1];
+	}
+	for(std::size_t i = 1; i < tops.size(); ++i){
+		tops[i] += tops[i - 1];
+	}
+
+	column_t width  = lefts.back();
+	row_t    height = tops.back();
+	uint64_t covered = 0;
+	bool positioned = false;
+	for(std::size_t i = 0; i < tiles_.size(); ++i){
+		const Tile& tile = tiles_[i];
+		if(tile.cell_ == no_cell){
+			width  = std::max(width,  tile.x_ + tile.image_.width());
+			height = std::max(height, tile.y_ + tile.image_.height());
+			positioned = true;
+		}
+		covered += static_cast<uint64_t>(tile.image_.width())*tile.image_.height();
+	}
+
+	Image result(width, height);
+	const ImageView canvas = result.view();
+	if(positioned || covered != static_cast<uint64_t>(width)*height){
+		std::fill(&canvas[0][0], &canvas[0][width], background);
+		Row::fill(canvas[1], canvas[height], canvas[0]);
+	}
+	for(std::size_t i = 0; i < tiles_.size(); ++i){
+		const Tile& tile = tiles_[i];
+		const column_t x = tile.cell_ == no_cell ? tile.x_ : lefts[tile.cell_%columns_];
+		const row_t    y = tile.cell_ == no_cell ? tile.y_ : tops[tile.cell_/columns_];
+		parallel_for(0, tile.image_.height(), Blit(tile.image_, canvas.view(x, y, tile.image_.width(), tile.image_.height())));
+	}
+	return result;
+}
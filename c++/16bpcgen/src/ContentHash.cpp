@@ -0,0 +1,141 @@
+#include <cstring>
+#include <vector>
+#include "ContentHash.hpp"
+#include "ThreadPool.hpp"
+
+namespace{
+inline uint64_t constant(uint32_t high, uint32_t low)
+{
+	return static_cast<uint64_t>(high) << 32 | low;
+}
+
+const uint64_t prime1 = constant(0x9E3779B1, 0x85EBCA87);
+const uint64_t prime2 = constant(0xC2B2AE3D, 0x27D4EB4F);
+const uint64_t prime3 = constant(0x165667B1, 0x9E3779F9);
+const uint64_t prime4 = constant(0x85EBCA77, 0xC2B2AE63);
+const uint64_t prime5 = constant(0x27D4EB2F, 0x165667C5);
+
+inline uint64_t rotl(uint64_t value, int bits)
+{
+	return value << bits | value >> (64 - bits);
+}
+
+inline uint64_t read64(const byte_t* p)
+{
+	uint64_t value;
+	std::memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+inline uint32_t read32(const byte_t* p)
+{
+	uint32_t value;
+	std::memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+inline uint64_t round(uint64_t acc, uint64_t input)
+{
+	return rotl(acc + input*prime2, 31)*prime1;
+}
+
+inline uint64_t merge(uint64_t acc, uint64_t lane)
+{
+	return (acc ^ round(0, lane))*prime1 + prime4;
+}
+
+/**
+ * 行ごとのハッシュ値を求め、hashes[2 + 行]に格納する。
+ * ピッチの詰め物は画素ではないので、各行のrow_size()バイトだけを対象にする。
+ */
+class RowHash{
+public:
+	RowHash(const Image& image, uint64_t seed, std::vector<uint64_t>& hashes):
+		image_(image), seed_(seed), hashes_(hashes){}
+	void operator()(std::size_t begin, std::size_t end)const
+	{
+		for(std::size_t h = begin; h < end; ++h){
+			hashes_[2 + h] = ContentHash::xxh64(image_.head() + h*image_.pitch(), image_.row_size(), seed_);
+		}
+	}
+private:
+	const Image& image_;
+	const uint64_t seed_;
+	std::vector<uint64_t>& hashes_;
+};
+}
+
+/**
+ * XXH64。
+ * 32バイトのブロックを4本の独立したレーンで処理するので、コンパイラがベクトル化しやすい。
+ * 多バイト値はホストのバイト順で読むため、ビッグエンディアン環境では値が変わる。
+ */
+uint64_t ContentHash::xxh64(const void* data, std::size_t size, uint64_t seed)
+{
+	const byte_t* p = static_cast<const byte_t*>(data);
+	const byte_t* const last = p + size;
+	uint64_t hash;
+	if(32 <= size){
+		uint64_t v1 = seed + prime1 + prime2;
+		uint64_t v2 = seed + prime2;
+		uint64_t v3 = seed;
+		uint64_t v4 = seed - prime1;
+		for(const byte_t* const limit = last - 32; p <= limit; p += 32){
+			v1 = round(v1, read64(p     ));
+			v2 = round(v2, read64(p +  8));
+			v3 = round(v3, read64(p + 16));
+			v4 = round(v4, read64(p + 24));
+		}
+		hash = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+		hash = merge(hash, v1);
+		hash = merge(hash, v2);
+		hash = merge(hash, v3);
+		hash = merge(hash, v4);
+	}else{
+		hash = seed + prime5;
+	}
+	hash += size;
+	for(; p + 8 <= last; p += 8){
+		hash ^= round(0, read64(p));
+		hash = rotl(hash, 27)*prime1 + prime4;
+	}
+	if(p + 4 <= last){
+		hash ^= read32(p)*prime1;
+		hash = rotl(hash, 23)*prime2 + prime3;
+		p += 4;
+	}
+	for(; p < last; ++p){
+		hash ^= *p*prime5;
+		hash = rotl(hash, 11)*prime1;
+	}
+	hash ^= hash >> 33;
+	hash *= prime2;
+	hash ^= hash >> 29;
+	hash *= prime3;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+/**
+ * 画像の内容に対するハッシュ値を求める。
+ * 各行のハッシュ値を並列に求め、幅・高さと共に改めてハッシュする。
+ * ピッチやバッファの共有状態には依存しない。
+ */
+uint64_t ContentHash::digest(const Image& image, uint64_t seed)
+{
+	std::vector<uint64_t> hashes(2 + static_cast<std::size_t>(image.height()));
+	hashes[0] = image.width();
+	hashes[1] = image.height();
+	parallel_for(0, image.height(), RowHash(image, seed, hashes));
+	return xxh64(&hashes[0], hashes.size()*sizeof(uint64_t), seed);
+}
+
+std::string ContentHash::hex(uint64_t hash)
+{
+	static const char digits[] = "0123456789abcdef";
+	std::string str(16, '0');
+	for(std::size_t i = 16; i-- > 0; hash >>= 4){
+		str[i] = digits[hash & 0xf];
+	}
+	return str;
+}
@@ -0,0 +1,142 @@
+#include <stdexcept>
+#include <typeinfo>
+#include "ConverterChain.hpp"
+
+/**
+ * チャンネルをまたぐ段は複製して持つので、複製元の段を順に複製し直す。
+ */
+ConverterChain::ConverterChain(const ConverterChain& chain):
+	PixelConverter(chain), stages_(chain.stages_.size(), static_cast<const PixelConverter*>(NULL)), luts_(chain.luts_)
+{
+	try{
+		for(std::size_t s = 0; s < stages_.size(); ++s){
+			if(chain.stages_[s]){
+				stages_[s] = chain.stages_[s]->clone();
+			}
+		}
+	}catch(...){
+		release();
+		throw;
+	}
+}
+
+ConverterChain::~ConverterChain()
+{
+	release();
+}
+
+ConverterChain& ConverterChain::operator=(const ConverterChain& chain)
+{
+	ConverterChain copy(chain);
+	stages_.swap(copy.stages_);
+	luts_.swap(copy.luts_);
+	return *this;
+}
+
+void ConverterChain::release()
+{
+	for(std::size_t s = 0; s < stages_.size(); ++s){
+		delete stages_[s];
+	}
+	stages_.clear();
+	luts_.clear();
+}
+
+/**
+ * チャンネルごとに独立な変換(convert_planeがtrueを返すもの)は、直前の表に畳み込んで1段にまとめる。
+ * 表は恒等写像から始め、各プレーンの表そのものをconvert_planeで変換すれば合成になる。
+ * GrayScaleのようにチャンネルをまたぐ変換はcloneで複製して単独の段として持つので、
+ * 渡した変換はaddの直後に破棄してよい。複製が同じ型にならない変換は、
+ * 派生クラスがcloneを実装していないのでinvalid_argumentとする。
+ */
+ConverterChain& ConverterChain::add(const PixelConverter& converter)
+{
+	const bool fresh = stages_.empty() || stages_.back();
+	if(fresh){
+		stages_.push_back(NULL);
+		luts_.push_back(std::vector<value_type>(3*entries));
+		for(std::size_t i = 0; i < luts_.back().size(); ++i){
+			luts_.back()[i] = static_cast<value_type>(i & 0xffff);
+		}
+	}
+	value_type* const lut = &luts_.back()[0];
+	if(converter.convert_plane(lut, lut + entries, 0)){
+		converter.convert_plane(lut + entries, lut + 2*entries, 1);
+		converter.convert_plane(lut + 2*entries, lut + 3*entries, 2);
+		return *this;
+	}
+	if(fresh){
+		stages_.pop_back();
+		luts_.pop_back();
+	}
+	const PixelConverter* const stage = converter.clone();
+	if(!stage || typeid(*stage) != typeid(converter)){
+		delete stage;
+		throw std::invalid_argument(__func__ + std::string(": can not add a converter. clone() is not implemented: ") + typeid(converter).name());
+	}
+	try{
+		luts_.push_back(std::vector<value_type>());
+		stages_.push_back(stage);
+	}catch(...){
+		luts_.resize(stages_.size());
+		delete stage;
+		throw;
+	}
+	return *this;
+}
+
+Image::pixel_type& ConverterChain::convert(Image::pixel_type& pixel)const
+{
+	for(std::size_t s = 0; s < stages_.size(); ++s){
+		if(stages_[s]){
+			stages_[s]->convert(pixel);
+		}else{
+			const value_type* const lut = &luts_[s][0];
+			pixel.R(lut[pixel.R()]);
+			pixel.G(lut[entries + pixel.G()]);
+			pixel.B(lut[2*entries + pixel.B()]);
+		}
+	}
+	return pixel;
+}
+
+/**
+ * 全段を1行ずつ適用するので、画像全体を走査するのは1回で済み、行はキャッシュに載ったまま次の段へ渡る。
+ */
+void ConverterChain::convert_row(Image::pixel_type* first, Image::pixel_type* last)const
+{
+	for(std::size_t s = 0; s < stages_.size(); ++s){
+		if(stages_[s]){
+			stages_[s]->convert(first, last);
+			continue;
+		}
+		const value_type* const r = &luts_[s][0];
+		const value_type* const g = r + entries;
+		const value_type* const b = g + entries;
+		value_type* const p = reinterpret_cast<value_type*>(first);
+		const std::size_t size = static_cast<std::size_t>(last - first)*3;
+		for(std::size_t i = 0; i < size; i += 3){
+			p[i]     = r[p[i]];
+			p[i + 1] = g[p[i + 1]];
+			p[i + 2] = b[p[i + 2]];
+		}
+	}
+}
+
+/**
+ * 表1段だけに畳み込めた場合はチャンネルごとに独立なので、別のConverterChainへさらに畳み込める。
+ */
+bool ConverterChain::convert_plane(value_type* first, value_type* last, byte_t plane)const
+{
+	if(stages_.empty()){
+		return true;
+	}
+	if(1 < stages_.size() || stages_[0]){
+		return false;
+	}
+	const value_type* const lut = &luts_[0][plane*static_cast<std::size_t>(entries)];
+	for(; first != last; ++first){
+		*first = lut[*first];
+	}
+	return true;
+}
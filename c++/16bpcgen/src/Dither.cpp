@@ -0,0 +1,399 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <pthread.h>
+#include "Dither.hpp"
+#include "ThreadPool.hpp"
+
+namespace{
+typedef Dither::value_type value_type;
+
+const std::size_t bayer_size  = 16;
+const std::size_t noise_size  = 64;
+const column_t    block_width = 256;
+// Pixel::maxは翻訳単位の外で定義されていて定数除算にならないため、ここで持つ。
+const uint32_t    full_scale  = 0xffffu;
+
+value_type* samples(Image::pixel_type* pixel){return reinterpret_cast<value_type*>(pixel);}
+
+/**
+ * n/0xffff。n < 0xffff*0x10001の範囲で割り算と一致する(ここではn <= 0xffff*0xffff + 0xfffe)。
+ */
+inline uint32_t divide_full_scale(uint32_t n){return (n + (n >> 16) + 1) >> 16;}
+
+/**
+ * 0からcount-1までの順位を、しきい値(順位の中央を16bitへ写した値)に置き換える。
+ */
+std::vector<uint32_t> thresholds(const std::vector<uint32_t>& ranks)
+{
+	const uint32_t count = static_cast<uint32_t>(ranks.size());
+	std::vector<uint32_t> result(ranks.size());
+	for(std::size_t i = 0; i < ranks.size(); ++i){
+		result[i] = (2*ranks[i] + 1)*full_scale/(2*count);
+	}
+	return result;
+}
+
+/**
+ * 16x16のBayer行列。M(2n) = [4M 4M+2; 4M+3 4M+1]を再帰的に広げる。
+ */
+std::vector<uint32_t> build_bayer()
+{
+	std::vector<uint32_t> ranks(1, 0);
+	for(std::size_t n = 1; n < bayer_size; n *= 2){
+		std::vector<uint32_t> next(4*n*n);
+		for(std::size_t y = 0; y < n; ++y){
+			for(std::size_t x = 0; x < n; ++x){
+				const uint32_t v = 4*ranks[y*n + x];
+				next[ y     *2*n + x    ] = v;
+				next[ y     *2*n + x + n] = v + 2;
+				next[(y + n)*2*n + x    ] = v + 3;
+				next[(y + n)*2*n + x + n] = v + 1;
+			}
+		}
+		ranks.swap(next);
+	}
+	return thresholds(ranks);
+}
+
+const std::vector<uint32_t>& bayer()
+{
+	static const std::vector<uint32_t> table = build_bayer();
+	return table;
+}
+
+/**
+ * void-and-cluster法(Ulichney)で作る64x64のブルーノイズ。
+ * 周期境界のガウス(sigma = 1.5)でエネルギーを持ち、最も密な点を外す/最も疎な点を埋める順に順位を付ける。
+ * 重みは整数に丸めてあるので、生成結果は浮動小数点の実装差に左右されない。
+ * 半分より上の順位は0の点の密集度で選ぶのが本来だが、0と1のエネルギーの和は一定なので、
+ * 最も疎な点を埋め続けるのと同じになる。
+ */
+class VoidAndCluster{
+public:
+	VoidAndCluster(): kernel_(noise_size*noise_size), pattern_(noise_size*noise_size), energy_(noise_size*noise_size)
+	{
+		const double sigma = 1.5;
+		for(std::size_t y = 0; y < noise_size; ++y){
+			for(std::size_t x = 0; x < noise_size; ++x){
+				const double dx = static_cast<double>(std::min(x, noise_size - x));
+				const double dy = static_cast<double>(std::min(y, noise_size - y));
+				kernel_[y*noise_size + x] = static_cast<int>(65536.0*std::exp(-(dx*dx + dy*dy)/(2.0*sigma*sigma)) + 0.5);
+			}
+		}
+	}
+	std::vector<uint32_t> build()
+	{
+		const std::size_t count = pattern_.size();
+		uint32_t seed = 1;
+		for(std::size_t ones = 0; ones < count/10;){
+			seed = seed*1103515245u + 12345u;
+			const std::size_t p = (seed >> 8) % count;
+			if(!pattern_[p]){
+				toggle(p);
+				++ones;
+			}
+		}
+		for(std::size_t i = 0; i < count; ++i){
+			const std::size_t cluster = tightest_cluster();
+			toggle(cluster);
+			const std::size_t hole = largest_void();
+			toggle(hole);
+			if(cluster == hole){
+				break;
+			}
+		}
+
+		std::vector<uint32_t> ranks(count);
+		const std::vector<byte_t> pattern = pattern_;
+		const std::vector<int> energy = energy_;
+		const uint32_t initial = static_cast<uint32_t>(std::count(pattern_.begin(), pattern_.end(), 1));
+		for(uint32_t ones = initial; ones;){
+			const std::size_t cluster = tightest_cluster();
+			toggle(cluster);
+			ranks[cluster] = --ones;
+		}
+		pattern_ = pattern;
+		energy_ = energy;
+		for(uint32_t ones = initial; ones < count; ++ones){
+			const std::size_t hole = largest_void();
+			toggle(hole);
+			ranks[hole] = ones;
+		}
+		return thresholds(ranks);
+	}
+private:
+	void toggle(std::size_t p)
+	{
+		const int sign = pattern_[p] ? -1 : 1;
+		pattern_[p] = !pattern_[p];
+		const std::size_t px = p % noise_size;
+		const std::size_t py = p / noise_size;
+		for(std::size_t y = 0; y < noise_size; ++y){
+			const int* const kernel = &kernel_[((y - py) & (noise_size - 1))*noise_size];
+			int* const energy = &energy_[y*noise_size];
+			for(std::size_t x = 0; x < noise_size; ++x){
+				energy[x] += sign*kernel[(x - px) & (noise_size - 1)];
+			}
+		}
+	}
+	std::size_t tightest_cluster()const
+	{
+		std::size_t result = 0;
+		int max = -1;
+		for(std::size_t p = 0; p < energy_.size(); ++p){
+			if(pattern_[p] && max < energy_[p]){
+				max = energy_[p];
+				result = p;
+			}
+		}
+		return result;
+	}
+	std::size_t largest_void()const
+	{
+		std::size_t result = 0;
+		int min = std::numeric_limits<int>::max();
+		for(std::size_t p = 0; p < energy_.size(); ++p){
+			if(!pattern_[p] && energy_[p] < min){
+				min = energy_[p];
+				result = p;
+			}
+		}
+		return result;
+	}
+	std::vector<int> kernel_;
+	std::vector<byte_t> pattern_;
+	std::vector<int> energy_;
+};
+
+const std::vector<uint32_t>& blue_noise()
+{
+	static const std::vector<uint32_t> table = VoidAndCluster().build();
+	return table;
+}
+
+class OrderedBand{
+public:
+	OrderedBand(const ImageView& roi, const std::vector<uint32_t>& table, std::size_t size, const value_type* levels, uint32_t span):
+		roi_(roi), table_(table), size_(size), levels_(levels), span_(span){}
+	void operator()(std::size_t begin, std::size_t end)const
+	{
+		const std::size_t mask = size_ - 1;
+		for(row_t h = static_cast<row_t>(begin); h < end; ++h){
+			const uint32_t* const threshold = &table_[(h & mask)*size_];
+			value_type* const p = samples(&roi_[h][0]);
+			for(column_t w = 0; w < roi_.width(); ++w){
+				const uint32_t t = threshold[w & mask];
+				value_type* const sample = p + 3*w;
+				for(int c = 0; c < 3; ++c){
+					sample[c] = levels_[divide_full_scale(sample[c]*span_ + t)];
+				}
+			}
+		}
+	}
+private:
+	const ImageView roi_;
+	const std::vector<uint32_t>& table_;
+	std::size_t size_;
+	const value_type* levels_;
+	uint32_t span_;
+};
+
+/**
+ * 誤差拡散の重み。拡散先ではなく受け取る側から見た形で持つ。
+ * [0]は同じ行のx-2, x-1、[1]は1行上、[2]は2行上のx-2からx+2。reachは上の行で参照する右側の画素数。
+ */
+struct FloydSteinberg{
+	enum{
+		denominator = 16,
+		reach = 1
+	};
+	static const int weights[3][5];
+};
+const int FloydSteinberg::weights[3][5] = {{0, 7, 0, 0, 0}, {0, 1, 5, 3, 0}, {0, 0, 0, 0, 0}};
+
+struct Jarvis{
+	enum{
+		denominator = 48,
+		reach = 2
+	};
+	static const int weights[3][5];
+};
+const int Jarvis::weights[3][5] = {{5, 7, 0, 0, 0}, {3, 5, 7, 5, 3}, {1, 3, 5, 3, 1}};
+
+/**
+ * 行ごとの処理済み列数。各行は上の行がreach画素先まで進むのを待ってから進むので、
+ * 複数の行が斜めにずれた波面となって同時に処理される。
+ */
+class Wavefront{
+public:
+	explicit Wavefront(row_t height): mutex_(), cond_(), done_(height, 0)
+	{
+		pthread_mutex_init(&mutex_, NULL);
+		pthread_cond_init(&cond_, NULL);
+	}
+	~Wavefront()
+	{
+		pthread_cond_destroy(&cond_);
+		pthread_mutex_destroy(&mutex_);
+	}
+	void wait(row_t row, column_t column)
+	{
+		pthread_mutex_lock(&mutex_);
+		while(done_[row] < column){
+			pthread_cond_wait(&cond_, &mutex_);
+		}
+		pthread_mutex_unlock(&mutex_);
+	}
+	void publish(row_t row, column_t column)
+	{
+		pthread_mutex_lock(&mutex_);
+		done_[row] = column;
+		pthread_cond_broadcast(&cond_);
+		pthread_mutex_unlock(&mutex_);
+	}
+private:
+	Wavefront(const Wavefront&);
+	Wavefront& operator=(const Wavefront&);
+	pthread_mutex_t mutex_;
+	pthread_cond_t cond_;
+	std::vector<column_t> done_;
+};
+
+/**
+ * 各画素は周囲の確定済みの誤差を引き寄せて足す(重みは押し出し型と同じ)。
+ * 自分の行の誤差しか書かないので、行をまたいだ書き込みの競合がない。
+ * 誤差はslots行の環状バッファに持ち、行hの領域はh - slots + 2行目が読み終えてから再利用する。
+ */
+template <typename Kernel>
+class DiffusionBand{
+public:
+	DiffusionBand(const ImageView& roi, const value_type* levels, uint32_t span,
+			Wavefront& wavefront, std::vector<int>& errors, std::size_t slots):
+		roi_(roi), levels_(levels), span_(span),
+		wavefront_(wavefront), errors_(errors), slots_(slots), stride_(3*(roi.width() + 4)){}
+	void operator()(std::size_t begin, std::size_t end)const
+	{
+		for(row_t h = static_cast<row_t>(begin); h < end; ++h){
+			diffuse(h);
+		}
+	}
+private:
+	int* errors(row_t h)const{return &errors_[(h % slots_)*stride_ + 6];}
+	void diffuse(row_t h)const
+	{
+		const column_t width = roi_.width();
+		if(slots_ <= h){
+			wavefront_.wait(static_cast<row_t>(h - slots_ + 2), width);
+		}
+		int* const current = errors(h);
+		const int* const above1 = 1 <= h ? errors(h - 1) : &errors_[slots_*stride_ + 6];
+		const int* const above2 = 2 <= h ? errors(h - 2) : &errors_[slots_*stride_ + 6];
+		std::fill(current - 6, current, 0);
+		std::fill(current + 3*width, current + 3*width + 6, 0);
+
+		const int (&k)[3][5] = Kernel::weights;
+		const uint32_t denominator = Kernel::denominator;
+		value_type* const p = samples(&roi_[h][0]);
+		int left1[3] = {0, 0, 0};
+		int left2[3] = {0, 0, 0};
+		for(column_t first = 0; first < width; first += block_width){
+			const column_t last = std::min(first + block_width, width);
+			if(h){
+				wavefront_.wait(h - 1, std::min<column_t>(width, last + Kernel::reach));
+			}
+			int carried[3*block_width];
+			for(std::size_t i = 3*first; i < 3*last; ++i){
+				carried[i - 3*first] = Kernel::denominator*65536 + Kernel::denominator/2 +
+					k[1][0]*above1[i - 6] + k[1][1]*above1[i - 3] + k[1][2]*above1[i] + k[1][3]*above1[i + 3] + k[1][4]*above1[i + 6] +
+					k[2][0]*above2[i - 6] + k[2][1]*above2[i - 3] + k[2][2]*above2[i] + k[2][3]*above2[i + 3] + k[2][4]*above2[i + 6];
+			}
+			for(std::size_t x = first; x < last; ++x){
+				for(std::size_t c = 0; c < 3; ++c){
+					const std::size_t i = 3*x + c;
+					const int sum = k[0][0]*left2[c] + k[0][1]*left1[c] + carried[i - 3*first];
+					const int diffused = static_cast<int>(static_cast<uint32_t>(sum)/denominator) - 65536;
+					const int value = std::min(std::max(p[i] + diffused, 0), static_cast<int>(full_scale));
+					const value_type level = levels_[divide_full_scale(static_cast<uint32_t>(value)*span_ + full_scale/2)];
+					left2[c] = left1[c];
+					left1[c] = current[i] = value - level;
+					p[i] = level;
+				}
+			}
+			wavefront_.publish(h, last);
+		}
+	}
+	const ImageView roi_;
+	const value_type* levels_;
+	uint32_t span_;
+	Wavefront& wavefront_;
+	std::vector<int>& errors_;
+	std::size_t slots_;
+	std::size_t stride_;
+};
+
+/**
+ * 行を1行ずつ配り、波面の順で並列に誤差拡散する。
+ */
+template <typename Kernel>
+void diffuse(const ImageView& image, const value_type* levels, uint32_t span)
+{
+	if(!image.width()){
+		return;
+	}
+	const std::size_t slots = ThreadPool::instance().threads() + 3;
+	std::vector<int> errors((slots + 1)*3*(image.width() + 4), 0);
+	Wavefront wavefront(image.height());
+	parallel_for(0, image.height(), DiffusionBand<Kernel>(image, levels, span, wavefront, errors, slots), 1);
+}
+}
+
+/**
+ * 16bitの画像をbitsビットのパネル相当に落とす。出力は2^bits段の値をフルスケールへ広げたもの。
+ * BAYERとBLUE_NOISEは位置ごとのしきい値による組織的ディザ、FLOYD_STEINBERGとJARVISは誤差拡散。
+ */
+Dither::Dither(int bits, Method method): bits_(bits), method_(method), levels_()
+{
+	if(bits < 1 || Image::bitdepth < bits){
+		throw std::invalid_argument(__func__ + std::string(": can not create dither. bits must be 1 to 16."));
+	}
+	const uint32_t span = (1u << bits) - 1;
+	levels_.resize(span + 1);
+	for(uint32_t i = 0; i <= span; ++i){
+		levels_[i] = static_cast<value_type>((i*Image::pixel_type::max + span/2)/span);
+	}
+	if(method_ == DITHER_BAYER){
+		bayer();
+	}else if(method_ == DITHER_BLUE_NOISE){
+		blue_noise();
+	}
+}
+
+Image& Dither::process(Image& image)const
+{
+	process_view(image.view());
+	return image;
+}
+
+ImageView Dither::process_view(const ImageView& image)const
+{
+	const uint32_t span = static_cast<uint32_t>(levels_.size() - 1);
+	switch(method_){
+	case DITHER_BAYER:
+		parallel_for(0, image.height(), OrderedBand(image, bayer(), bayer_size, &levels_[0], span));
+		break;
+	case DITHER_BLUE_NOISE:
+		parallel_for(0, image.height(), OrderedBand(image, blue_noise(), noise_size, &levels_[0], span));
+		break;
+	case DITHER_FLOYD_STEINBERG:
+		diffuse<FloydSteinberg>(image, &levels_[0], span);
+		break;
+	case DITHER_JARVIS:
+		diffuse<Jarvis>(image, &levels_[0], span);
+		break;
+	default:
+		throw std::runtime_error(__func__ + std::string(": can not apply dither. unknown method."));
+	}
+	return image;
+}
@@ -0,0 +1,135 @@
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+#include "FramePool.hpp"
+#include "Image.hpp"
+
+static byte_t* aligned_allocate(std::size_t size)
+{
+	void* head = NULL;
+#ifdef _WIN32
+	if(!(head = _aligned_malloc(size, Image::alignment))){
+#else
+	if(posix_memalign(&head, Image::alignment, size)){
+#endif
+		throw std::bad_alloc();
+	}
+	return static_cast<byte_t*>(head);
+}
+
+static void aligned_free(byte_t* head)
+{
+#ifdef _WIN32
+	_aligned_free(head);
+#else
+	std::free(head);
+#endif
+}
+
+FramePool& FramePool::instance()
+{
+	static FramePool pool(256 << 20);
+	return pool;
+}
+
+FramePool::FramePool(std::size_t a_capacity):
+	mutex_(), frames_(), capacity_(a_capacity), retained_(0), hits_(0), misses_(0)
+{
+	pthread_mutex_init(&mutex_, NULL);
+}
+
+FramePool::~FramePool()
+{
+	clear();
+	pthread_mutex_destroy(&mutex_);
+}
+
+byte_t* FramePool::acquire(std::size_t size)
+{
+	size = bucket(size);
+	pthread_mutex_lock(&mutex_);
+	std::map<std::size_t, std::vector<byte_t*> >::iterator it = frames_.find(size);
+	if(it == frames_.end() || it->second.empty()){
+		++misses_;
+		pthread_mutex_unlock(&mutex_);
+		return aligned_allocate(size);
+	}
+	byte_t* const frame = it->second.back();
+	it->second.pop_back();
+	retained_ -= size;
+	++hits_;
+	pthread_mutex_unlock(&mutex_);
+	return frame;
+}
+
+void FramePool::release(byte_t* frame, std::size_t size)
+{
+	size = bucket(size);
+	pthread_mutex_lock(&mutex_);
+	if(capacity_ < size){
+		pthread_mutex_unlock(&mutex_);
+		aligned_free(frame);
+		return;
+	}
+	trim(capacity_ - size);
+	frames_[size].push_back(frame);
+	retained_ += size;
+	pthread_mutex_unlock(&mutex_);
+}
+
+void FramePool::clear()
+{
+	pthread_mutex_lock(&mutex_);
+	trim(0);
+	pthread_mutex_unlock(&mutex_);
+}
+
+void FramePool::set_capacity(std::size_t bytes)
+{
+	pthread_mutex_lock(&mutex_);
+	capacity_ = bytes;
+	trim(capacity_);
+	pthread_mutex_unlock(&mutex_);
+}
+
+/**
+ * 他のスレッドがacquire/releaseの最中でも、ロックを取って読むので途中の値は見えない。
+ * hit_rateはヒットとミスを同じロックの中で読み、別々の時点の値を混ぜない。
+ */
+std::size_t FramePool::read(const std::size_t& counter)const
+{
+	pthread_mutex_lock(&mutex_);
+	const std::size_t value = counter;
+	pthread_mutex_unlock(&mutex_);
+	return value;
+}
+
+double FramePool::hit_rate()const
+{
+	pthread_mutex_lock(&mutex_);
+	const std::size_t hits = hits_, misses = misses_;
+	pthread_mutex_unlock(&mutex_);
+	return hits + misses ? static_cast<double>(hits)/static_cast<double>(hits + misses) : 0.0;
+}
+
+std::size_t FramePool::bucket(std::size_t size)
+{
+	const std::size_t page = 4096;
+	return (std::max<std::size_t>(size, 1) + page - 1)/page*page;
+}
+
+void FramePool::trim(std::size_t bytes)
+{
+	std::map<std::size_t, std::vector<byte_t*> >::reverse_iterator it = frames_.rbegin();
+	while(bytes < retained_ && it != frames_.rend()){
+		while(bytes < retained_ && !it->second.empty()){
+			aligned_free(it->second.back());
+			it->second.pop_back();
+			retained_ -= it->first;
+		}
+		++it;
+	}
+}
@@ -0,0 +1,145 @@
+#include <algorithm>
+#include <cmath>
+#include "Histogram.hpp"
+#include "ThreadPool.hpp"
+
+Histogram::Histogram(const ImageView& image): total_(0), counts_(3*bins), cumulative_(3*bins)
+{
+	build(image);
+}
+
+Histogram::Histogram(const Image& image): total_(0), counts_(3*bins), cumulative_(3*bins)
+{
+	build(ImageView(const_cast<byte_t*>(image.head()), image.width(), image.height(), image.pitch()));
+}
+
+namespace{
+/**
+ * 帯ごとに専用の部分ヒストグラムへ数え上げる。
+ * スレッド間で書き込み先を共有しないので、排他もアトミック操作も要らない。
+ */
+class PartialCount{
+public:
+	PartialCount(const ImageView& image, std::size_t grain, std::vector<std::vector<uint32_t> >& partials):
+		image_(image), grain_(grain), partials_(partials){}
+	void operator()(std::size_t begin, std::size_t end)const
+	{
+		for(std::size_t first = begin; first < end; first += grain_){
+			count(first, std::min(end, first + grain_));
+		}
+	}
+private:
+	void count(std::size_t begin, std::size_t end)const
+	{
+		std::vector<uint32_t>& counts = partials_[begin/grain_];
+		counts.assign(3*Histogram::bins, 0);
+		uint32_t* const r = &counts[0];
+		uint32_t* const g = r + Histogram::bins;
+		uint32_t* const b = g + Histogram::bins;
+		for(row_t h = static_cast<row_t>(begin); h < end; ++h){
+			const Image::pixel_type* const row = &image_[h][0];
+			for(column_t w = 0; w < image_.width(); ++w){
+				++r[row[w].R()];
+				++g[row[w].G()];
+				++b[row[w].B()];
+			}
+		}
+	}
+private:
+	const ImageView image_;
+	const std::size_t grain_;
+	std::vector<std::vector<uint32_t> >& partials_;
+};
+
+class Merge{
+public:
+	Merge(const std::vector<std::vector<uint32_t> >& partials, std::vector<uint64_t>& counts):
+		partials_(partials), counts_(counts){}
+	void operator()(std::size_t begin, std::size_t end)const
+	{
+		for(std::size_t i = 0; i < partials_.size(); ++i){
+			const uint32_t* const partial = &partials_[i][0];
+			for(std::size_t j = begin; j < end; ++j){
+				counts_[j] += partial[j];
+			}
+		}
+	}
+private:
+	const std::vector<std::vector<uint32_t> >& partials_;
+	std::vector<uint64_t>& counts_;
+};
+}
+
+/**
+ * スレッド数と同じ数の帯に分けて部分ヒストグラムを作り、最後にビンごとに足し合わせる。
+ * 部分ヒストグラムは32bitで数えるので、帯1つ当たりの画素数は2^32未満に抑える。
+ */
+void Histogram::build(const ImageView& image)
+{
+	total_ = static_cast<uint64_t>(image.width())*image.height();
+	if(!total_){
+		return;
+	}
+	const std::size_t threads = ThreadPool::instance().threads();
+	const std::size_t limit = std::max<std::size_t>(1, 0xffffffffu/image.width());
+	const std::size_t grain = std::min(limit, (image.height() + threads - 1)/threads);
+	std::vector<std::vector<uint32_t> > partials((image.height() + grain - 1)/grain);
+	parallel_for(0, image.height(), PartialCount(image, grain, partials), grain);
+	parallel_for(0, counts_.size(), Merge(partials, counts_), bins/4);
+	for(byte_t plane = 0; plane < 3; ++plane){
+		uint64_t sum = 0;
+		for(std::size_t i = index(plane, 0); i < index(plane, 0) + bins; ++i){
+			cumulative_[i] = sum += counts_[i];
+		}
+	}
+}
+
+double Histogram::cdf(byte_t plane, value_type value)const
+{
+	return total_ ? static_cast<double>(cumulative(plane, value))/static_cast<double>(total_) : 0.0;
+}
+
+Histogram::value_type Histogram::rank(byte_t plane, uint64_t n)const
+{
+	if(!total_){
+		return 0;
+	}
+	const std::vector<uint64_t>::const_iterator first = cumulative_.begin() + static_cast<std::ptrdiff_t>(index(plane, 0));
+	const std::vector<uint64_t>::const_iterator last  = first + bins;
+	return static_cast<value_type>(std::min<std::ptrdiff_t>(std::lower_bound(first, last, n) - first, bins - 1));
+}
+
+Histogram::value_type Histogram::min(byte_t plane)const
+{
+	return rank(plane, 1);
+}
+
+Histogram::value_type Histogram::max(byte_t plane)const
+{
+	return rank(plane, total_);
+}
+
+/**
+ * 累積度数がratio*total()以上となる最小の値を返す。
+ * ratioが0なら最小値、1なら最大値になる。
+ */
+Histogram::value_type Histogram::percentile(byte_t plane, double ratio)const
+{
+	const double position = std::ceil(std::min(std::max(ratio, 0.0), 1.0)*static_cast<double>(total_));
+	return rank(plane, std::max<uint64_t>(1, static_cast<uint64_t>(position)));
+}
+
+Image::pixel_type Histogram::min()const
+{
+	return Image::pixel_type(min(0), min(1), min(2));
+}
+
+Image::pixel_type Histogram::max()const
+{
+	return Image::pixel_type(max(0), max(1), max(2));
+}
+
+Image::pixel_type Histogram::percentile(double ratio)const
+{
+	return Image::pixel_type(percentile(0, ratio), percentile(1, ratio), percentile(2, ratio));
+}
@@ -1,10 +1,22 @@
 #include <algorithm>
 #include <cerrno>
+#include <climits>
 #include <cstring>
 #include <ctime>
+#include <fstream>
 #include <iomanip>
+#include <limits>
 #include <sstream>
 #include <stdexcept>
+#include <utility>
+#include <vector>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
 #ifdef ENABLE_TIFF
 #include <tiffio.h>
 #endif
@@ -14,28 +26,45 @@
 #ifdef ENABLE_JPEG
 #include <jpeglib.h>
 #endif
+#include "FramePool.hpp"
 #include "Image.hpp"
 #include "ImageProcesses.hpp"
 #include "PatternGenerator.hpp"
 
-const byte_t bitdepth  = 16;
+const byte_t Image::bitdepth;
 #ifdef ENABLE_PNG
 const int colortype = PNG_COLOR_TYPE_RGB;
 #endif
-const byte_t pixelsize = 6;
+const byte_t Image::pixelsize;
+const byte_t Image::alignment;
+static const char raw_magic[] = "16bpcraw";
+static const std::size_t raw_header_size = 4096;
+static const uint16_t raw_byte_order = 0xfeff;
 
-void Row::fill(Row first, Row last, const Row& row)
+template <typename T>
+static void put_field(std::vector<char>& header, std::size_t pos, T value)
 {
-	while(first != last){
-		std::copy(&row[0], &row[row.width()], &first[0]);
-		++first;
-	}
+	std::memcpy(&header[pos], &value, sizeof(value));
+}
+
+template <typename T>
+static T get_field(const byte_t* header, std::size_t pos)
+{
+	T value;
+	std::memcpy(&value, header + pos, sizeof(value));
+	return value;
+}
+
+Image::Image(const column_t& a_width, const row_t& a_height, std::size_t a_pitch):
+	buffer_(NULL), width_(0), height_(0), pitch_(0), offset_(0)
+{
+	reset(a_width, a_height, a_pitch);
 }
 
 Image::Image(const Image& image):
-	head_(new byte_t[image.data_size()]), width_(image.width_), height_(image.height_)
+	buffer_(NULL), width_(image.width_), height_(image.height_), pitch_(image.pitch_), offset_(image.offset_)
 {
-	std::copy(image.head(), image.tail(), head());
+	share(image);
 }
 
 Image& Image::operator=(const Image& image)
@@ -43,182 +72,619 @@ Image& Image::operator=(const Image& image)
 	if(this == &image){
 		return *this;
 	}
-	delete[] head_;
-	width_  = image.width();
-	height_ = image.height();
-	head_   = new byte_t[data_size()];
-	std::copy(image.head(), image.tail(), head());
+	Image copy(image);
+	return swap(copy);
+}
+
+#if 201103L <= __cplusplus
+Image::Image(Image&& image)noexcept:
+	buffer_(image.buffer_), width_(image.width_), height_(image.height_), pitch_(image.pitch_), offset_(image.offset_)
+{
+	image.buffer_ = NULL;
+	image.width_  = 0;
+	image.height_ = 0;
+	image.pitch_  = 0;
+	image.offset_ = 0;
+}
+
+Image& Image::operator=(Image&& image)noexcept
+{
+	if(this == &image){
+		return *this;
+	}
+	release();
+	buffer_ = image.buffer_;
+	width_  = image.width_;
+	height_ = image.height_;
+	pitch_  = image.pitch_;
+	offset_ = image.offset_;
+	image.buffer_ = NULL;
+	image.width_  = 0;
+	image.height_ = 0;
+	image.pitch_  = 0;
+	image.offset_ = 0;
 	return *this;
 }
 
-Image Image::operator<<(const PatternGenerator& generator)const
+Image Image::operator<<(const PatternGenerator& generator)const&
 {
-	Image result = Image(*this);
-	return generator.generate(result);
+	Image result = generator.overwrites() ? Image(width(), height(), pitch()) : Image(*this);
+	generator.generate(result.view());
+	return result;
 }
 
-Image& Image::operator<<=(const PatternGenerator& generator)
+Image Image::operator<<(const PatternGenerator& generator)&&
 {
-	return generator.generate(*this);
+	Image result(std::move(*this));
+	result <<= generator;
+	return result;
 }
+#else
+/**
+ * 全画素を上書きするジェネレータなら、元の画素を複写せずに新しい領域へ描く。
+ */
+Image Image::operator<<(const PatternGenerator& generator)const
+{
+	Image result = generator.overwrites() ? Image(width(), height(), pitch()) : Image(*this);
+	generator.generate(result.view());
+	return result;
+}
+#endif
 
-Image& Image::operator<<=(std::istream& is)
+Image& Image::operator<<=(const PatternGenerator& generator)
 {
-	const std::size_t size = data_size();
-	for(std::size_t i = 0; i < size; ++i){
-		int c = is.get();
-		if(is.eof()){
-			break;
-		}
-		head_[i] = static_cast<byte_t>(c);
+	if(generator.overwrites()){
+		renew();
 	}
+	generator.generate(view());
 	return *this;
 }
 
-Image Image::operator>>(const ImageProcess& process)const
+static bool host_little_endian()
 {
-	Image result = Image(*this);
-	return process.process(result);
+	const uint16_t probe = 1;
+	return *static_cast<const byte_t*>(static_cast<const void*>(&probe)) == 1;
 }
 
-Image& Image::operator>>=(const ImageProcess& process)
+static std::size_t raw_sample_size(Image::RawLayout layout)
 {
-	return process.process(*this);
+	return layout == Image::RAW_RGB24 ? 1 : 2;
 }
 
-Image Image::operator>>(const PixelConverter& converter)const
+static bool raw_planar(Image::RawLayout layout)
 {
-	Image result = Image(*this);
-	return Tone(converter).process(result);
+	return layout == Image::RAW_PLANAR48LE || layout == Image::RAW_PLANAR48BE;
 }
 
-Image& Image::operator>>=(const PixelConverter& converter)
+static bool raw_native(Image::RawLayout layout)
 {
-	return Tone(converter).process(*this);
+	return layout == (host_little_endian() ? Image::RAW_RGB48LE : Image::RAW_RGB48BE);
 }
 
-Image Image::operator<<(byte_t shift)const
+/**
+ * 外部形式のサンプル列srcを、stride飛びに16bitサンプルとしてdstへ展開する。
+ */
+static void unpack(const byte_t* src, uint16_t* dst, std::size_t count, std::size_t stride, Image::RawLayout layout)
 {
-	Image result = Image(width(), height());
-	std::transform(const_cast<const pixel_type*>(&(*this)[0][0]),
-					const_cast<const pixel_type*>(&(*this)[height()][0]),
-					&result[0][0], lshifter(shift));
-	return result;
+	switch(layout){
+	case Image::RAW_RGB24:
+		for(std::size_t i = 0; i < count; ++i){
+			dst[i*stride] = static_cast<uint16_t>(src[i] << 8 | src[i]);
+		}
+		break;
+	case Image::RAW_RGB48LE:
+	case Image::RAW_PLANAR48LE:
+		for(std::size_t i = 0; i < count; ++i){
+			dst[i*stride] = static_cast<uint16_t>(src[2*i] | src[2*i + 1] << 8);
+		}
+		break;
+	case Image::RAW_RGB48BE:
+	case Image::RAW_PLANAR48BE:
+		for(std::size_t i = 0; i < count; ++i){
+			dst[i*stride] = static_cast<uint16_t>(src[2*i] << 8 | src[2*i + 1]);
+		}
+		break;
+	default:
+		break;
+	}
 }
 
-Image& Image::operator<<=(byte_t shift)
+static void pack(const uint16_t* src, byte_t* dst, std::size_t count, std::size_t stride, Image::RawLayout layout)
 {
-	std::for_each(&(*this)[0][0], &(*this)[height()][0], lshifter(shift));
-	return *this;
+	switch(layout){
+	case Image::RAW_RGB24:
+		for(std::size_t i = 0; i < count; ++i){
+			dst[i] = static_cast<byte_t>(src[i*stride] >> 8);
+		}
+		break;
+	case Image::RAW_RGB48LE:
+	case Image::RAW_PLANAR48LE:
+		for(std::size_t i = 0; i < count; ++i){
+			dst[2*i    ] = static_cast<byte_t>(src[i*stride]);
+			dst[2*i + 1] = static_cast<byte_t>(src[i*stride] >> 8);
+		}
+		break;
+	case Image::RAW_RGB48BE:
+	case Image::RAW_PLANAR48BE:
+		for(std::size_t i = 0; i < count; ++i){
+			dst[2*i    ] = static_cast<byte_t>(src[i*stride] >> 8);
+			dst[2*i + 1] = static_cast<byte_t>(src[i*stride]);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+namespace{
+class StreamReader{
+public:
+	explicit StreamReader(std::istream& is): is_(is){}
+	bool operator()(byte_t* dst, std::size_t size)const
+	{
+		is_.read(reinterpret_cast<char*>(dst), static_cast<std::streamsize>(size));
+		return static_cast<std::size_t>(is_.gcount()) == size;
+	}
+private:
+	std::istream& is_;
+};
+
+class StreamWriter{
+public:
+	explicit StreamWriter(std::ostream& os): os_(os){}
+	bool operator()(const byte_t* src, std::size_t size)const
+	{
+		return static_cast<bool>(os_.write(reinterpret_cast<const char*>(src), static_cast<std::streamsize>(size)));
+	}
+private:
+	std::ostream& os_;
+};
+
+#ifndef _WIN32
+class FileReader{
+public:
+	explicit FileReader(int fd): fd_(fd){}
+	bool operator()(byte_t* dst, std::size_t size)const
+	{
+		while(size){
+			const ssize_t n = ::read(fd_, dst, size);
+			if(n < 0 && errno == EINTR){
+				continue;
+			}else if(n < 0){
+				throw std::runtime_error(__func__ + std::string(": can not read raw frame: ") + std::strerror(errno));
+			}else if(n == 0){
+				return false;
+			}
+			dst  += n;
+			size -= static_cast<std::size_t>(n);
+		}
+		return true;
+	}
+private:
+	int fd_;
+};
+
+class FileWriter{
+public:
+	explicit FileWriter(int fd): fd_(fd){}
+	bool operator()(const byte_t* src, std::size_t size)const
+	{
+		while(size){
+			const ssize_t n = ::write(fd_, src, size);
+			if(n < 0 && errno == EINTR){
+				continue;
+			}else if(n < 0){
+				throw std::runtime_error(__func__ + std::string(": can not write raw frame: ") + std::strerror(errno));
+			}
+			src  += n;
+			size -= static_cast<std::size_t>(n);
+		}
+		return true;
+	}
+private:
+	int fd_;
+};
+#endif
 }
 
-Image Image::operator>>(byte_t shift)const
+/**
+ * 1行分ずつ読み込みながら内部形式へ変換する。
+ * 内部形式とバイトオーダーが同じならば行へ直接読み込む。
+ */
+template <typename Reader>
+static bool import_frame(const ImageView& image, const Reader& read, Image::RawLayout layout)
 {
-	Image result = Image(width(), height());
-	std::transform(const_cast<const pixel_type*>(&(*this)[0][0]),
-					const_cast<const pixel_type*>(&(*this)[height()][0]),
-					&result[0][0], rshifter(shift));
-	return result;
+	const std::size_t samples = static_cast<std::size_t>(image.width())*3;
+	if(raw_native(layout)){
+		for(row_t h = 0; h < image.height(); ++h){
+			if(!read(static_cast<byte_t*>(static_cast<void*>(&image[h][0])), samples*2)){
+				return false;
+			}
+		}
+		return true;
+	}
+	const std::size_t channels = raw_planar(layout) ? 3 : 1;
+	const std::size_t count = samples/channels;
+	std::vector<byte_t> staging(count*raw_sample_size(layout));
+	for(std::size_t c = 0; c < channels; ++c){
+		for(row_t h = 0; h < image.height(); ++h){
+			if(!read(&staging[0], staging.size())){
+				return false;
+			}
+			unpack(&staging[0], static_cast<uint16_t*>(static_cast<void*>(&image[h][0])) + c, count, channels, layout);
+		}
+	}
+	return true;
 }
 
-Image& Image::operator>>=(byte_t shift)
+template <typename Writer>
+static bool export_frame(const ImageView& image, const Writer& write, Image::RawLayout layout)
 {
-	std::for_each(&(*this)[0][0], &(*this)[height()][0], rshifter(shift));
+	const std::size_t samples = static_cast<std::size_t>(image.width())*3;
+	if(raw_native(layout)){
+		for(row_t h = 0; h < image.height(); ++h){
+			if(!write(static_cast<const byte_t*>(static_cast<const void*>(&image[h][0])), samples*2)){
+				return false;
+			}
+		}
+		return true;
+	}
+	const std::size_t channels = raw_planar(layout) ? 3 : 1;
+	const std::size_t count = samples/channels;
+	std::vector<byte_t> staging(count*raw_sample_size(layout));
+	for(std::size_t c = 0; c < channels; ++c){
+		for(row_t h = 0; h < image.height(); ++h){
+			pack(static_cast<const uint16_t*>(static_cast<const void*>(&image[h][0])) + c, &staging[0], count, channels, layout);
+			if(!write(&staging[0], staging.size())){
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+Image& Image::operator<<=(std::istream& is)
+{
+	import_raw(is, host_little_endian() ? RAW_RGB48LE : RAW_RGB48BE);
 	return *this;
 }
 
-Image Image::operator&(const Image& image)const
+bool Image::import_raw(std::istream& is, RawLayout layout)
+{
+	return import_frame(view(), StreamReader(is), layout);
+}
+
+bool Image::export_raw(std::ostream& os, RawLayout layout)const
+{
+	return export_frame(ImageView(const_cast<byte_t*>(head()), width(), height(), pitch()), StreamWriter(os), layout);
+}
+
+#ifndef _WIN32
+/**
+ * 内部形式と同じレイアウトならば、全行をreadv/writevでまとめて転送する。
+ */
+template <typename IoFunc>
+static bool transfer_rows(int fd, const ImageView& image, IoFunc io)
 {
-	if(width() != image.width() || height() != image.height()){
-		throw std::invalid_argument(__func__ + std::string(": can not apply bit and. image width/height unmatch."));
+#ifdef IOV_MAX
+	const std::size_t batch = IOV_MAX;
+#else
+	const std::size_t batch = 1024;
+#endif
+	const std::size_t row_size = static_cast<std::size_t>(image.width())*Image::pixelsize;
+	std::vector<iovec> iov(std::min<std::size_t>(batch, image.height()));
+	for(row_t h = 0; h < image.height();){
+		const std::size_t rows = std::min<std::size_t>(iov.size(), image.height() - h);
+		for(std::size_t i = 0; i < rows; ++i){
+			iov[i].iov_base = &image[static_cast<row_t>(h + i)][0];
+			iov[i].iov_len  = row_size;
+		}
+		std::size_t first = 0;
+		while(first < rows){
+			const ssize_t n = io(fd, &iov[first], static_cast<int>(rows - first));
+			if(n < 0 && errno == EINTR){
+				continue;
+			}else if(n < 0){
+				throw std::runtime_error(__func__ + std::string(": can not transfer raw frame: ") + std::strerror(errno));
+			}else if(n == 0){
+				return false;
+			}
+			for(std::size_t done = static_cast<std::size_t>(n); done;){
+				const std::size_t step = std::min(done, iov[first].iov_len);
+				iov[first].iov_base = static_cast<byte_t*>(iov[first].iov_base) + step;
+				iov[first].iov_len -= step;
+				done -= step;
+				if(!iov[first].iov_len){
+					++first;
+				}
+			}
+		}
+		h = static_cast<row_t>(h + rows);
 	}
-	Image result = Image(width(), height());
-	for(std::size_t i = 0; i < data_size(); ++i){
-		result.head()[i] = head()[i] & image.head()[i];
+	return true;
+}
+
+bool Image::import_raw(int fd, RawLayout layout)
+{
+	if(raw_native(layout)){
+		return transfer_rows(fd, view(), ::readv);
 	}
+	return import_frame(view(), FileReader(fd), layout);
+}
+
+bool Image::export_raw(int fd, RawLayout layout)const
+{
+	if(raw_native(layout)){
+		return transfer_rows(fd, ImageView(const_cast<byte_t*>(head()), width(), height(), pitch()), ::writev);
+	}
+	return export_frame(ImageView(const_cast<byte_t*>(head()), width(), height(), pitch()), FileWriter(fd), layout);
+}
+#endif
+
+#if 201103L <= __cplusplus
+Image Image::operator>>(const ImageProcess& process)const&
+{
+	Image result = Image(*this);
+	process.process(result);
 	return result;
 }
 
-Image Image::operator&(const Image::pixel_type& pixel)const
+Image Image::operator>>(const ImageProcess& process)&&
+{
+	Image result(std::move(*this));
+	process.process(result);
+	return result;
+}
+#else
+Image Image::operator>>(const ImageProcess& process)const
 {
-	Image result = Image(width(), height());
-	std::transform(const_cast<const pixel_type*>(&(*this)[0][0]),
-					const_cast<const pixel_type*>(&(*this)[height()][0]),
-					&result[0][0], bit_and(pixel));
+	Image result = Image(*this);
+	process.process(result);
 	return result;
 }
+#endif
 
-Image& Image::operator&=(const Image::pixel_type& pixel)
+Image& Image::operator>>=(const ImageProcess& process)
 {
-	std::for_each(&(*this)[0][0], &(*this)[height()][0], bit_and(pixel));
-	return *this;
+	return process.process(*this);
 }
 
-Image Image::operator|(const Image& image)const
+#if 201103L <= __cplusplus
+Image Image::operator>>(const PixelConverter& converter)const&
 {
-	if(width() != image.width() || height() != image.height()){
-		throw std::invalid_argument(__func__ + std::string(": can not apply bit or. image width/height unmatch."));
-	}
-	Image result = Image(width(), height());
-	for(std::size_t i = 0; i < data_size(); ++i){
-		result.head()[i] = head()[i] | image.head()[i];
-	}
+	Image result = Image(*this);
+	Tone(converter).process(result);
 	return result;
 }
 
-Image Image::operator|(const Image::pixel_type& pixel)const
+Image Image::operator>>(const PixelConverter& converter)&&
+{
+	Image result(std::move(*this));
+	Tone(converter).process(result);
+	return result;
+}
+#else
+Image Image::operator>>(const PixelConverter& converter)const
 {
-	Image result = Image(width(), height());
-	std::transform(const_cast<const pixel_type*>(&(*this)[0][0]),
-					const_cast<const pixel_type*>(&(*this)[height()][0]),
-					&result[0][0], bit_or(pixel));
+	Image result = Image(*this);
+	Tone(converter).process(result);
 	return result;
 }
+#endif
 
-Image& Image::operator|=(const Image::pixel_type& pixel)
+Image& Image::operator>>=(const PixelConverter& converter)
 {
-	std::for_each(&(*this)[0][0], &(*this)[height()][0], bit_or(pixel));
-	return *this;
+	return Tone(converter).process(*this);
 }
 
+Image& Image::operator<<=(byte_t shift){return *this = *this << shift;}
+Image& Image::operator>>=(byte_t shift){return *this = *this >> shift;}
+Image& Image::operator&=(const Image& image){return *this = *this & image;}
+Image& Image::operator&=(const Image::pixel_type& pixel){return *this = *this & pixel;}
+Image& Image::operator|=(const Image& image){return *this = *this | image;}
+Image& Image::operator|=(const Image::pixel_type& pixel){return *this = *this | pixel;}
+
 Image Image::operator()(const Image& image, byte_t orientation)const
 {
 	if( width() == 0 && height() == 0){
 		return image;
 	}else if(orientation & ORI_HORI && height() == image.height()){
 		Image result = Image(width() + image.width(), height());
-		for(column_t h = 0; h < height(); ++h){
-			std::copy(head() + h * width() * pixelsize, head() + (h + 1) * width() * pixelsize, result.head() + h * result.width() * pixelsize);
-			std::copy(image.head() + h * image.width() * pixelsize, image.head() + (h + 1) * image.width() * pixelsize, result.head() + width() * pixelsize + h * result.width() * pixelsize);
+		for(row_t h = 0; h < height(); ++h){
+			std::copy(&(*this)[h][0], &(*this)[h][width()],     &result[h][0]);
+			std::copy(&image[h][0],   &image[h][image.width()], &result[h][width()]);
 		}
 		return result;
 	}else if(orientation & ORI_VERT && width() == image.width()){
 		Image result = Image(width(), height() + image.height());
-		std::copy(head(), head() + data_size(), result.head());
-		std::copy(image.head(), image.head() + image.data_size(), result.head() + data_size());
+		for(row_t h = 0; h < height(); ++h){
+			std::copy(&(*this)[h][0], &(*this)[h][width()], &result[h][0]);
+		}
+		for(row_t h = 0; h < image.height(); ++h){
+			std::copy(&image[h][0],   &image[h][width()],   &result[height() + h][0]);
+		}
 		return result;
 	}else{
 		throw std::invalid_argument(__func__ + std::string(": can not join images. image width/height unmatch."));
 	}
 }
 
+Image Image::crop(column_t x, row_t y, column_t a_width, row_t a_height)const
+{
+	if(width() < x || width() - x < a_width || height() < y || height() - y < a_height){
+		throw std::invalid_argument(__func__ + std::string(": can not crop image. area out of range."));
+	}
+	if(buffer_ && !buffer_->shareable()){
+		Image result(a_width, a_height);
+		for(row_t h = 0; h < a_height; ++h){
+			std::copy(&(*this)[y + h][x], &(*this)[y + h][x + a_width], &result[h][0]);
+		}
+		return result;
+	}
+	Image result(*this);
+	result.width_   = a_width;
+	result.height_  = a_height;
+	result.offset_ += y*pitch_ + static_cast<std::size_t>(x)*pixelsize;
+	return result;
+}
+
 Image& Image::swap(Image& rhs)
 {
 	if(this == &rhs){
 		return *this;
 	}
-	byte_t* const  tmp_head   = head_;
-	const column_t tmp_width  = width_;
-	const row_t    tmp_height = height_;
-	head_   = rhs.head_;
+	Buffer* const     tmp_buffer = buffer_;
+	const column_t    tmp_width  = width_;
+	const row_t       tmp_height = height_;
+	const std::size_t tmp_pitch  = pitch_;
+	const std::size_t tmp_offset = offset_;
+	buffer_ = rhs.buffer_;
 	width_  = rhs.width_;
 	height_ = rhs.height_;
-	rhs.head_   = tmp_head;
+	pitch_  = rhs.pitch_;
+	offset_ = rhs.offset_;
+	rhs.buffer_ = tmp_buffer;
 	rhs.width_  = tmp_width;
 	rhs.height_ = tmp_height;
+	rhs.pitch_  = tmp_pitch;
+	rhs.offset_ = tmp_offset;
 	return *this;
 }
 
+ImageView ImageView::view(column_t x, row_t y, column_t a_width, row_t a_height)const
+{
+	if(!contains(x, y, a_width, a_height)){
+		throw std::invalid_argument(__func__ + std::string(": can not create image view. area out of range."));
+	}
+	return ImageView(head_ + y*pitch_ + static_cast<std::size_t>(x)*Image::pixelsize, a_width, a_height, pitch_);
+}
+
+bool ImageView::contains(column_t x, row_t y, column_t a_width, row_t a_height)const
+{
+	return x <= width() && a_width <= width() - x && y <= height() && a_height <= height() - y;
+}
+
+void Image::expand(const byte_t* src, pixel_type::value_type* dst, std::size_t size)
+{
+	while(size--){
+		dst[size] = static_cast<pixel_type::value_type>(src[size] << 8 | src[size]);
+	}
+}
+
+namespace{
+class RowCopy{
+public:
+	RowCopy(const ImageView& source, const ImageView& destination): source_(source), destination_(destination){}
+	void operator()(std::size_t begin, std::size_t end)const
+	{
+		for(row_t h = static_cast<row_t>(begin); h < end; ++h){
+			std::copy(&source_[h][0], &source_[h][source_.width()], &destination_[h][0]);
+		}
+	}
+private:
+	const ImageView source_;
+	const ImageView destination_;
+};
+}
+
+Image::Buffer* Image::duplicate()const
+{
+	Buffer* const buffer = new Buffer(data_size());
+	const ImageView source(buffer_->head() + offset_, width(), height(), pitch());
+	try{
+		parallel_for(0, height(), RowCopy(source, ImageView(buffer->head(), width(), height(), pitch())));
+	}catch(...){
+		delete buffer;
+		throw;
+	}
+	return buffer;
+}
+
+/**
+ * 行や先頭ポインタを書き込み用に渡した領域は、渡した先からの書き込みが複製にも及ぶので共有せずに複写する。
+ */
+void Image::share(const Image& image)
+{
+	if(!image.buffer_ || image.buffer_->shareable()){
+		buffer_ = image.buffer_ ? image.buffer_->acquire() : NULL;
+		return;
+	}
+	buffer_ = image.duplicate();
+	offset_ = 0;
+}
+
+void Image::detach()
+{
+	if(!shared()){
+		return;
+	}
+	Buffer* const buffer = duplicate();
+	release();
+	buffer_ = buffer;
+	offset_ = 0;
+}
+
+/**
+ * 共有中の領域は複写せずに新しい領域へ差し替える。直後に全画素を上書きするときに使う。
+ */
+void Image::renew()
+{
+	if(!shared()){
+		return;
+	}
+	Buffer* const buffer = new Buffer(data_size());
+	release();
+	buffer_ = buffer;
+	offset_ = 0;
+}
+
+void Image::release()
+{
+	if(buffer_ && buffer_->release()){
+		delete buffer_;
+	}
+	buffer_ = NULL;
+}
+
+void Image::reset(column_t a_width, row_t a_height, std::size_t a_pitch)
+{
+	if(a_pitch == 0){
+		a_pitch = default_pitch(a_width);
+	}else if(a_pitch < static_cast<std::size_t>(a_width)*pixelsize || a_pitch % sizeof(pixel_type::value_type)){
+		throw std::invalid_argument(__func__ + std::string(": can not allocate image. invalid row pitch."));
+	}
+	release();
+	width_  = a_width;
+	height_ = a_height;
+	pitch_  = a_pitch;
+	offset_ = 0;
+	buffer_ = new Buffer(data_size());
+}
+
+std::size_t Image::default_pitch(column_t a_width, std::size_t a_pixelsize)
+{
+	const std::size_t page = 4096;
+	const std::size_t pitch = (static_cast<std::size_t>(a_width)*a_pixelsize + alignment - 1)/alignment*alignment;
+	return pitch % page ? pitch : pitch + alignment;
+}
+
+Image::Buffer::Buffer(std::size_t size):
+	head_(FramePool::instance().acquire(size)), size_(size), count_(1), mapped_(false), writable_(true), shareable_(true){}
+
+Image::Buffer::Buffer(byte_t* mapping, std::size_t size, bool writable):
+	head_(mapping), size_(size), count_(1), mapped_(true), writable_(writable), shareable_(true){}
+
+Image::Buffer::~Buffer()
+{
+#ifndef _WIN32
+	if(mapped_){
+		munmap(head_, size_);
+		return;
+	}
+#endif
+	FramePool::instance().release(head_, size_);
+}
+
 Image& Image::read(const std::string& filename)
 {
 	if(has_ext(filename, ".tif") || has_ext(filename, ".tiff")){
@@ -239,6 +705,8 @@ Image& Image::read(const std::string& filename)
 #else
 		throw std::invalid_argument(__func__ + std::string(": can not read. unsupported file format: ") + filename);
 #endif
+	}else if(has_ext(filename, ".raw")){
+		map(filename);
 	}else{
 		throw std::invalid_argument(__func__ + std::string(": can not read. unsupported file format: ") + filename);
 	}
@@ -259,6 +727,8 @@ Image& Image::write(const std::string& filename, Image::FileFormat fmt)const
 #else
 		throw std::invalid_argument(__func__ + std::string(": can not write. unsupported file format: ") + filename);
 #endif
+	}else if(has_ext(filename, ".raw") || fmt & FMT_RAW){
+		write_raw(filename);
 	}else{
 #ifdef ENABLE_TIFF
 		write_tiff(filename + ".tif");
@@ -273,14 +743,109 @@ Image& Image::write(const std::string& filename, Image::FileFormat fmt)const
 	return const_cast<Image&>(*this);
 }
 
-void              Image::lshifter::operator()(      Image::pixel_type& pixel)const{pixel <<= shift_;}
-Image::pixel_type Image::lshifter::operator()(const Image::pixel_type& pixel)const{return pixel << shift_;}
-void              Image::rshifter::operator()(      Image::pixel_type& pixel)const{pixel >>= shift_;}
-Image::pixel_type Image::rshifter::operator()(const Image::pixel_type& pixel)const{return pixel >> shift_;}
-void              Image::bit_and:: operator()(      Image::pixel_type& pixel)const{pixel &= pixel_;}
-Image::pixel_type Image::bit_and:: operator()(const Image::pixel_type& pixel)const{return pixel & pixel_;}
-void              Image::bit_or::  operator()(      Image::pixel_type& pixel)const{pixel |= pixel_;}
-Image::pixel_type Image::bit_or::  operator()(const Image::pixel_type& pixel)const{return pixel | pixel_;}
+Image& Image::map(const std::string& filename, MapMode mode)
+{
+#ifdef _WIN32
+	std::ifstream ifs(filename.c_str(), std::ios::binary | std::ios::ate);
+	if(!ifs){
+		throw std::invalid_argument(__func__ + std::string(": can not map. file not found: ") + filename);
+	}
+	const std::size_t size = static_cast<std::size_t>(ifs.tellg());
+	Buffer* const buffer = new Buffer(size);
+	ifs.seekg(0);
+	if(!ifs.read(reinterpret_cast<char*>(buffer->head()), static_cast<std::streamsize>(size))){
+		delete buffer;
+		throw std::runtime_error(__func__ + std::string(": can not map. read failed: ") + filename);
+	}
+	static_cast<void>(mode);
+#else
+	const int fd = open(filename.c_str(), O_RDONLY);
+	if(fd < 0){
+		throw std::invalid_argument(__func__ + std::string(": can not map. file not found: ") + filename);
+	}
+	struct stat st;
+	std::size_t size = 0;
+	void* mapping = MAP_FAILED;
+	if(!fstat(fd, &st) && 0 < st.st_size){
+		size = static_cast<std::size_t>(st.st_size);
+		mapping = mmap(NULL, size, mode == MMAP_READ_ONLY ? PROT_READ : PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	}
+	close(fd);
+	if(mapping == MAP_FAILED){
+		throw std::runtime_error(__func__ + std::string(": can not map. mmap failed: ") + filename);
+	}
+	Buffer* buffer = NULL;
+	try{
+		buffer = new Buffer(static_cast<byte_t*>(mapping), size, mode == MMAP_COPY_ON_WRITE);
+	}catch(...){
+		munmap(mapping, size);
+		throw;
+	}
+#endif
+	const byte_t* const header = buffer->head();
+	const column_t    a_width  = raw_header_size <= size ? get_field<uint32_t>(header, 12) : 0;
+	const row_t       a_height = raw_header_size <= size ? get_field<uint32_t>(header, 16) : 0;
+	const uint64_t    a_pitch  = raw_header_size <= size ? get_field<uint64_t>(header, 24) : 0;
+	const uint64_t    a_offset = raw_header_size <= size ? get_field<uint64_t>(header, 32) : 0;
+	const uint64_t    a_row_size = static_cast<uint64_t>(a_width)*pixelsize;
+	// 最終行の末尾 a_offset + (a_height - 1)*a_pitch + a_row_size は桁あふれし得るので、引き算と割り算で比べる
+	if(size < raw_header_size || std::memcmp(header, raw_magic, 8) ||
+	   get_field<uint16_t>(header, 8) != raw_byte_order || get_field<uint16_t>(header, 10) != bitdepth ||
+	   a_pitch < a_row_size || a_pitch % sizeof(pixel_type::value_type) || std::numeric_limits<std::size_t>::max() < a_pitch ||
+	   a_offset < 40 || a_offset % sizeof(pixel_type::value_type) ||
+	   (a_height && (size < a_offset || size - a_offset < a_row_size ||
+	                 (1 < a_height && (size - a_offset - a_row_size)/(a_height - 1) < a_pitch)))){
+		delete buffer;
+		throw std::invalid_argument(__func__ + std::string(": can not map. invalid raw image: ") + filename);
+	}
+	if(a_offset % alignment || a_pitch % alignment){
+		// 行頭が揃っていないファイルは、揃えた行へ複写して読み込む
+		try{
+			Image image(a_width, a_height);
+			for(row_t h = 0; h < a_height; ++h){
+				std::memcpy(image.head() + h*image.pitch(), header + a_offset + h*a_pitch, static_cast<std::size_t>(a_row_size));
+			}
+			delete buffer;
+			return swap(image);
+		}catch(...){
+			delete buffer;
+			throw;
+		}
+	}
+	release();
+	buffer_ = buffer;
+	width_  = a_width;
+	height_ = a_height;
+	pitch_  = static_cast<std::size_t>(a_pitch);
+	offset_ = static_cast<std::size_t>(a_offset);
+	return *this;
+}
+
+Image& Image::write_raw(const std::string& filename)const
+{
+	std::ofstream ofs(filename.c_str(), std::ios::binary);
+	if(!ofs){
+		throw std::invalid_argument(__func__ + std::string(": can not write. can not open file: ") + filename);
+	}
+	std::vector<char> header(raw_header_size);
+	std::memcpy(&header[0], raw_magic, 8);
+	put_field<uint16_t>(header, 8,  raw_byte_order);
+	put_field<uint16_t>(header, 10, bitdepth);
+	put_field<uint32_t>(header, 12, width());
+	put_field<uint32_t>(header, 16, height());
+	put_field<uint64_t>(header, 24, pitch());
+	put_field<uint64_t>(header, 32, raw_header_size);
+	ofs.write(&header[0], static_cast<std::streamsize>(header.size()));
+	const std::vector<char> padding(pitch() - row_size() + 1);
+	for(row_t h = 0; h < height(); ++h){
+		ofs.write(reinterpret_cast<const char*>(&(*this)[h][0]), static_cast<std::streamsize>(row_size()));
+		ofs.write(&padding[0], static_cast<std::streamsize>(pitch() - row_size()));
+	}
+	if(!ofs){
+		throw std::runtime_error(__func__ + std::string(": can not write. write failed: ") + filename);
+	}
+	return const_cast<Image&>(*this);
+}
 
 #ifdef ENABLE_TIFF
 Image::Tiff::Tiff(const std::string& filename, const char* mode): tif_(NULL)
@@ -392,37 +957,26 @@ Image& Image::read_tiff(const std::string& filename)
 		throw std::runtime_error(oss.str());
 	}
 
-	if(head_){
-		delete[] head_;
-	}
-	width_  = image_width;
-	height_ = image_length;
-	head_   = new byte_t[data_size()];
-
-	const tmsize_t strip_size = TIFFStripSize(tif);
-	const uint32_t num_strips = TIFFNumberOfStrips(tif);
-	tmsize_t offset = 0;
-	for(uint32_t i = 0; i < num_strips; ++i){
-		tmsize_t read_result = 0;
-		if((read_result = TIFFReadEncodedStrip(tif, i, head_ + offset, strip_size)) == -1){
-			throw std::runtime_error(__func__ + std::string(": TIFFReadEncodedStrip: can not read."));
-		}
-		offset += read_result;
-	}
+	reset(image_width, image_length);
 
-	switch(bits_per_sample){
-	case 8:
-		for(byte_t *p = head_ + offset - 1, *last = tail() - 1; head_ <= p; --p, last -= 2){
-			*last = *p;
-		}
-		break;
-	case 16:
-		break;
-	default:
+	if(bits_per_sample != 8 && bits_per_sample != 16){
 		std::ostringstream oss;
 		oss << __func__ << ": can not read. unsupported bit depth: " << bits_per_sample;
 		throw std::runtime_error(oss.str());
 	}
+
+	std::vector<byte_t> scanline(static_cast<std::size_t>(TIFFScanlineSize(tif)));
+	for(row_t h = 0; h < height(); ++h){
+		if(TIFFReadScanline(tif, &scanline[0], h, 0) == -1){
+			throw std::runtime_error(__func__ + std::string(": TIFFReadScanline: can not read."));
+		}
+		pixel_type::value_type* const row = reinterpret_cast<pixel_type::value_type*>(&(*this)[h][0]);
+		if(bits_per_sample == 16){
+			std::copy(scanline.begin(), scanline.begin() + static_cast<std::ptrdiff_t>(std::min(scanline.size(), row_size())), reinterpret_cast<byte_t*>(row));
+		}else{
+			expand(&scanline[0], row, std::min(scanline.size(), row_size()/2));
+		}
+	}
 	return *this;
 }
 
@@ -446,7 +1000,11 @@ Image& Image::write_tiff(const std::string& filename)const
 	TIFFSetField(tif, TIFFTAG_SOFTWARE, PROGRAM_NAME);
 	TIFFSetField(tif, TIFFTAG_IMAGEDESCRIPTION, "powered by " PROGRAM_NAME ".");
 	TIFFSetField(tif, TIFFTAG_DATETIME, buf);
-	TIFFWriteEncodedStrip(tif, 0, head(), static_cast<tmsize_t>(data_size()));
+	for(row_t h = 0; h < height(); ++h){
+		if(TIFFWriteScanline(tif, const_cast<byte_t*>(reinterpret_cast<const byte_t*>(&(*this)[h][0])), h, 0) == -1){
+			throw std::runtime_error(__func__ + std::string(": TIFFWriteScanline: can not write."));
+		}
+	}
 	return const_cast<Image&>(*this);
 }
 #endif
@@ -477,12 +1035,7 @@ Image& Image::read_png(const std::string& filename)
 				NULL);
 	byte_t** row_ptrs = png_get_rows(png, png);
 
-	if(head_){
-		delete[] head_;
-	}
-	width_  = png_get_image_width(png, png);
-	height_ = png_get_image_height(png, png);
-	head_   = new byte_t[data_size()];
+	reset(png_get_image_width(png, png), png_get_image_height(png, png));
 
 	for(row_t i = 0; i < height(); ++i){
 		std::copy(&row_ptrs[i][0], &row_ptrs[i][width()*pixelsize], reinterpret_cast<byte_t*>(&this->operator[](i)[0]));
@@ -491,13 +1044,44 @@ Image& Image::read_png(const std::string& filename)
 }
 
 Image& Image::write_png(const std::string& filename)const
+{
+	write_png(filename, head(), width(), height(), pitch(), bitdepth);
+	return const_cast<Image&>(*this);
+}
+
+namespace{
+class PitchedRows: public Image::RowSource{
+public:
+	PitchedRows(const byte_t* head, std::size_t pitch): head_(head), pitch_(pitch){}
+	virtual const byte_t* row(row_t row){return head_ + row*pitch_;}
+private:
+	PitchedRows(const PitchedRows&);
+	PitchedRows& operator=(const PitchedRows&);
+	const byte_t* head_;
+	std::size_t pitch_;
+};
+}
+
+/**
+ * 行の先頭がheadからpitchバイトおきに並ぶRGBの画素列を、depthビット(8または16)のPNGとして書き出す。
+ */
+void Image::write_png(const std::string& filename, const byte_t* a_head, column_t a_width, row_t a_height, std::size_t a_pitch, byte_t depth)
+{
+	PitchedRows rows(a_head, a_pitch);
+	write_png(filename, rows, a_width, a_height, depth);
+}
+
+/**
+ * rowsから1行ずつ受け取りながら書き出す。全体を一度にメモリへ置けない画像(TiledImage)用。
+ */
+void Image::write_png(const std::string& filename, RowSource& rows, column_t a_width, row_t a_height, byte_t depth)
 {
 	File fp(filename, "wb");
 
 	Png png(Png::IO_WRITE);
 	png_init_io(png, fp);
-	png_set_IHDR(png, png, width(), height(),
-			bitdepth, colortype, PNG_INTERLACE_NONE,
+	png_set_IHDR(png, png, a_width, a_height,
+			depth, colortype, PNG_INTERLACE_NONE,
 			PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
 
 	png_text comments[3] = {};
@@ -508,15 +1092,14 @@ Image& Image::write_png(const std::string& filename)const
 	png_convert_from_time_t(&now, std::time(NULL));
 	png_set_tIME(png, png, &now);
 
-	byte_t** row_ptrs = new byte_t*[height()];
-	for(row_t i = 0; i < height(); ++i){
-		row_ptrs[i] = reinterpret_cast<byte_t*>(&this->operator[](i)[0]);
+	png_write_info(png, png);
+	if(8 < depth){
+		png_set_swap(png);
 	}
-	png_set_rows(png, png, row_ptrs);
-	png_write_png(png, png, PNG_TRANSFORM_SWAP_ENDIAN, NULL);
-
-	delete[] row_ptrs;
-	return const_cast<Image&>(*this);
+	for(row_t i = 0; i < a_height; ++i){
+		png_write_row(png, rows.row(i));
+	}
+	png_write_end(png, png);
 }
 
 void Image::construct_tEXt_chunk(png_textp text_ptr)
@@ -566,16 +1149,11 @@ Image& Image::read_jpeg(const std::string& filename)
 	cinfo.out_color_space = JCS_RGB;
 
 	jpeg_start_decompress(&cinfo);
-	if(head_){
-		delete[] head_;
-	}
-	width_  = cinfo.output_width;
-	height_ = cinfo.output_height;
-	head_   = new byte_t[data_size()];
+	reset(cinfo.output_width, cinfo.output_height);
 
 	JSAMPARRAY img = new JSAMPROW[height()];
 	for(row_t i = 0; i < height(); ++i){
-		img[i] = head_ + i*width()*3;
+		img[i] = reinterpret_cast<byte_t*>(&(*this)[i][0]);
 	}
 	while(cinfo.output_scanline < cinfo.output_height){
 		jpeg_read_scanlines(&cinfo, img + cinfo.output_scanline, cinfo.output_height - cinfo.output_scanline);
@@ -586,8 +1164,9 @@ Image& Image::read_jpeg(const std::string& filename)
 	std::fclose(fp);
 	jpeg_destroy_decompress(&cinfo);
 
-	for(byte_t *p = head_ + data_size()/2 - 1, *last = tail() - 1; head_ <= p; --p, last -= 2){
-		*last = *p;
+	for(row_t i = 0; i < height(); ++i){
+		pixel_type::value_type* const row = reinterpret_cast<pixel_type::value_type*>(&(*this)[i][0]);
+		expand(reinterpret_cast<byte_t*>(row), row, row_size()/2);
 	}
 	return *this;
 }
@@ -1,122 +1,223 @@
 #include <algorithm>
 #include <stdexcept>
+#include "Histogram.hpp"
 #include "Image.hpp"
 #include "ImageProcesses.hpp"
+#include "IntegralImage.hpp"
 #include "PatternGenerators.hpp"
 #include "PixelConverter.hpp"
+#include "ThreadPool.hpp"
 
-bool AreaSpecifier::within(const Image& image)const
+ImageView ImageProcess::process_view(const ImageView& image)const
 {
-	return area_.offset_x_ < image.width()  &&
-		area_.offset_y_ < image.height() &&
-		area_.offset_x_ + area_.width_  <= image.width() &&
-		area_.offset_y_ + area_.height_ <= image.height();
+	Image result = Image(image.width(), image.height());
+	for(row_t h = 0; h < image.height(); ++h){
+		std::copy(&image[h][0], &image[h][image.width()], &result[h][0]);
+	}
+	process(result);
+	if(result.width() != image.width() || result.height() != image.height()){
+		throw std::invalid_argument(__func__ + std::string(": can not apply process to image view. image width/height changed."));
+	}
+	for(row_t h = 0; h < image.height(); ++h){
+		std::copy(&result[h][0], &result[h][image.width()], &image[h][0]);
+	}
+	return image;
+}
+
+ImageView AreaSpecifier::area(const ImageView& image)const
+{
+	const column_t width  = area_.width_  == 0 && area_.offset_x_ == 0 ? image.width()  : area_.width_;
+	const row_t    height = area_.height_ == 0 && area_.offset_y_ == 0 ? image.height() : area_.height_;
+	return image.view(area_.offset_x_, area_.offset_y_, width, height);
 }
 
 Image& Tone::process(Image& image)const
+{
+	process_view(image.view());
+	return image;
+}
+
+namespace{
+class ToneBand{
+public:
+	ToneBand(const ImageView& roi, const PixelConverter& converter): roi_(roi), converter_(converter){}
+	void operator()(std::size_t begin, std::size_t end)const
+	{
+		for(row_t h = static_cast<row_t>(begin); h < end; ++h){
+			converter_.convert(&roi_[h][0], &roi_[h][0] + roi_.width());
+		}
+	}
+private:
+	const ImageView roi_;
+	const PixelConverter& converter_;
+};
+}
+
+ImageView Tone::process_view(const ImageView& image)const
 {
 	if(!within(image)){
 		throw std::invalid_argument(__func__ + std::string(": can not apply Tone process. invalid area specification."));
 	}
 
-	const column_t limit_w =
-		area_.width_  == 0 && area_.offset_x_ == 0
-						? image.width()  : area_.offset_x_ + area_.width_;
-	const row_t    limit_h =
-		area_.height_ == 0 && area_.offset_y_ == 0
-						? image.height() : area_.offset_y_ + area_.height_;
+	const ImageView roi = area(image);
+	parallel_for(0, roi.height(), ToneBand(roi, converter_));
+	return image;
+}
 
-	for(row_t h = area_.offset_y_; h < limit_h; ++h){
-		for(column_t w = area_.offset_x_; w < limit_w; ++w){
-			converter_.convert(image[h][w]);
+Image& Normalize::process(Image& image)const
+{
+	process_view(image.view());
+	return image;
+}
+
+namespace{
+class NormalizeBand{
+public:
+	NormalizeBand(const ImageView& roi, Image::pixel_type::value_type max): roi_(roi), max_(max){}
+	void operator()(std::size_t begin, std::size_t end)const
+	{
+		for(row_t h = static_cast<row_t>(begin); h < end; ++h){
+			for(column_t w = 0; w < roi_.width(); ++w){
+				roi_[h][w] = Pixel<double>(roi_[h][w]) / static_cast<double>(max_) * Image::pixel_type::max;
+			}
 		}
 	}
-	return image;
+private:
+	const ImageView roi_;
+	Image::pixel_type::value_type max_;
+};
 }
 
-Image& Normalize::process(Image& image)const
+ImageView Normalize::process_view(const ImageView& image)const
 {
 	if(!within(image)){
 		throw std::invalid_argument(__func__ + std::string(": can not apply Normalize process. invalid area specification."));
 	}
 
-	const column_t limit_w =
-		area_.width_  == 0 && area_.offset_x_ == 0
-						? image.width()  : area_.offset_x_ + area_.width_;
-	const row_t    limit_h =
-		area_.height_ == 0 && area_.offset_y_ == 0
-						? image.height() : area_.offset_y_ + area_.height_;
+	const ImageView roi = area(image);
+	const Histogram histogram(roi);
+	const Image::pixel_type::value_type max = std::max(histogram.max(0), std::max(histogram.max(1), histogram.max(2)));
+	parallel_for(0, roi.height(), NormalizeBand(roi, max));
+	return image;
+}
 
-	const Image::pixel_type::value_type max = *std::max_element(
-		reinterpret_cast<Image::pixel_type::value_type*>(&image[0][0]),
-		reinterpret_cast<Image::pixel_type::value_type*>(&image[image.height()][0]));
+Image& Median::process(Image& image)const
+{
+	process_view(image.view());
+	return image;
+}
 
-	for(row_t h = area_.offset_y_; h < limit_h; ++h){
-		for(column_t w = area_.offset_x_; w < limit_w; ++w){
-			image[h][w] = Pixel<double>(image[h][w]) / static_cast<double>(max) * Image::pixel_type::max;
+namespace{
+class MedianBand{
+public:
+	MedianBand(const ImageView& image, const ImageView& result, column_t offset_x, row_t offset_y):
+		image_(image), result_(result), offset_x_(offset_x), offset_y_(offset_y){}
+	void operator()(std::size_t begin, std::size_t end)const
+	{
+		std::vector<Image::pixel_type::value_type> values1;
+		std::vector<Image::pixel_type::value_type> values2;
+		std::vector<Image::pixel_type::value_type> values3;
+		for(row_t i = static_cast<row_t>(begin); i < end; ++i){
+			const row_t h = offset_y_ + i;
+			const row_t h_lowerbound = h - 1 < image_.height() ? h - 1 : 0 ;
+			const row_t h_upperbound = std::min(h + 1, image_.height());
+			for(column_t w = offset_x_, j = 0; j < result_.width(); ++w, ++j){
+				const column_t w_lowerbound = w - 1 < image_.width() ? w - 1 : 0 ;
+				const column_t w_upperbound = std::min(w + 1, image_.width());
+				values1.clear();
+				values2.clear();
+				values3.clear();
+				for(row_t k = h_lowerbound; k < h_upperbound; ++k){
+					for(column_t l = w_lowerbound; l < w_upperbound; ++l){
+						values1.push_back(image_[k][l].R());
+						values2.push_back(image_[k][l].G());
+						values3.push_back(image_[k][l].B());
+					}
+				}
+				std::sort(values1.begin(), values1.end());
+				std::sort(values2.begin(), values2.end());
+				std::sort(values3.begin(), values3.end());
+				result_[i][j] = Image::pixel_type(
+						values1[values1.size()/2],
+						values2[values2.size()/2],
+						values3[values3.size()/2]);
+			}
 		}
 	}
-	return image;
+private:
+	const ImageView image_;
+	const ImageView result_;
+	column_t offset_x_;
+	row_t offset_y_;
+};
 }
 
-Image& Median::process(Image& image)const
+ImageView Median::process_view(const ImageView& image)const
 {
 	if(!within(image)){
 		throw std::invalid_argument(__func__ + std::string(": can not apply Median filter. invalid area specification."));
 	}
 
-	const column_t limit_w =
-		area_.width_  == 0 && area_.offset_x_ == 0
-						? image.width()  : area_.offset_x_ + area_.width_;
-	const row_t limit_h =
-		area_.height_ == 0 && area_.offset_y_ == 0
-						? image.height() : area_.offset_y_ + area_.height_;
-
-	Image result = Image(image.width(), image.height());
+	const ImageView roi = area(image);
+	Image result = Image(roi.width(), roi.height());
+	parallel_for(0, roi.height(), MedianBand(image, result.view(), area_.offset_x_, area_.offset_y_));
+	for(row_t i = 0; i < roi.height(); ++i){
+		std::copy(&result[i][0], &result[i][roi.width()], &roi[i][0]);
+	}
+	return image;
+}
 
-	for(row_t h = area_.offset_y_; h < limit_h; ++h){
-		const row_t h_lowerbound = h - 1 < image.height() ? h - 1 : 0 ;
-		const row_t h_upperbound = std::min(h + 1, image.height());
-		for(column_t w = area_.offset_x_; w < limit_w; ++w){
-			const column_t w_lowerbound = w - 1 < image.width() ? w - 1 : 0 ;
-			const column_t w_upperbound = std::min(w + 1, image.width());
-			std::vector<Image::pixel_type::value_type> values1;
-			std::vector<Image::pixel_type::value_type> values2;
-			std::vector<Image::pixel_type::value_type> values3;
-			for(row_t i = h_lowerbound; i < h_upperbound; ++i){
-				for(column_t j = w_lowerbound; j < w_upperbound; ++j){
-					values1.push_back(image[i][j].R());
-					values2.push_back(image[i][j].G());
-					values3.push_back(image[i][j].B());
-				}
-			}
-			std::sort(values1.begin(), values1.end());
-			std::sort(values2.begin(), values2.end());
-			std::sort(values3.begin(), values3.end());
-			result[h][w] = Image::pixel_type(
-					values1[values1.size()/2],
-					values2[values2.size()/2],
-					values3[values3.size()/2]);
-		}
+Image& Crop::process(Image& image)const
+{
+	if(!within(image)){
+		throw std::invalid_argument(__func__ + std::string(": can not apply Crop process. invalid area specification."));
 	}
+
+	Image result = image.crop(area_.offset_x_, area_.offset_y_, area_.width_, area_.height_);
 	return image.swap(result);
 }
 
-Image& Crop::process(Image& image)const
+ImageView Crop::process_view(const ImageView& image)const
 {
 	if(!within(image)){
 		throw std::invalid_argument(__func__ + std::string(": can not apply Crop process. invalid area specification."));
 	}
 
-	const column_t limit_w = area_.offset_x_ + area_.width_;
-	const row_t limit_h = area_.offset_y_ + area_.height_;
-	Image result = Image(area_.width_, area_.height_);
-	for(row_t h = area_.offset_y_, i = 0; h < limit_h; ++h, ++i){
-		for(column_t w = area_.offset_x_, j = 0; w < limit_w; ++w, ++j){
-			result[i][j] = image[h][w];
+	return image.view(area_.offset_x_, area_.offset_y_, area_.width_, area_.height_);
+}
+
+namespace{
+class FilterBand{
+public:
+	FilterBand(const Image& image, const ImageView& result, const Filter::Kernel& kernel):
+		image_(image), result_(result), kernel_(kernel){}
+	void operator()(std::size_t begin, std::size_t end)const
+	{
+		for(row_t h = static_cast<row_t>(begin); h < end; ++h){
+			const row_t h_lowerbound =
+				static_cast<row_t>(h - kernel_.size()/2 < image_.height() ? h - kernel_.size()/2 : 0);
+			const row_t h_upperbound = std::min(
+				static_cast<row_t>(h + kernel_.size()/2 + 1), image_.height());
+			for(column_t w = 0; w < image_.width(); ++w){
+				const column_t w_lowerbound =
+					static_cast<column_t>(w - kernel_[0].size()/2 < image_.width() ? w - kernel_[0].size()/2 : 0);
+				const column_t w_upperbound = std::min(
+					static_cast<column_t>(w + kernel_[0].size()/2 + 1), image_.width());
+				Pixel<double> pixel = black;
+				for(row_t hh = h_lowerbound, i = 0; hh < h_upperbound; ++hh, ++i){
+					for(column_t ww = w_lowerbound, j = 0; ww < w_upperbound; ++ww, ++j){
+						pixel = pixel + Pixel<double>(image_[hh][ww]) * kernel_[i][j];
+					}
+				}
+				result_[h][w] = pixel;
+			}
 		}
 	}
-	return image.swap(result);
+private:
+	const Image& image_;
+	const ImageView result_;
+	const Filter::Kernel& kernel_;
+};
 }
 
 Image& Filter::process(Image& image)const
@@ -132,25 +233,8 @@ Image& Filter::process(Image& image)const
 	}
 
 	Image result = Image(image.width(), image.height());
-	for(row_t h = 0; h < image.height(); ++h){
-		const row_t h_lowerbound =
-			static_cast<row_t>(h - kernel_.size()/2 < image.height() ? h - kernel_.size()/2 : 0);
-		const row_t h_upperbound = std::min(
-			static_cast<row_t>(h + kernel_.size()/2 + 1), image.height());
-		for(column_t w = 0; w < image.width(); ++w){
-			const column_t w_lowerbound =
-				static_cast<column_t>(w - kernel_[0].size()/2 < image.width() ? w - kernel_[0].size()/2 : 0);
-			const column_t w_upperbound = std::min(
-				static_cast<column_t>(w + kernel_[0].size()/2 + 1), image.width());
-			Pixel<double> pixel = black;
-			for(row_t hh = h_lowerbound, i = 0; hh < h_upperbound; ++hh, ++i){
-				for(column_t ww = w_lowerbound, j = 0; ww < w_upperbound; ++ww, ++j){
-					pixel = pixel + Pixel<double>(image[hh][ww]) * kernel_[i][j];
-				}
-			}
-			result[h][w] = pixel;
-		}
-	}
+	const Image& source = image;
+	parallel_for(0, image.height(), FilterBand(source, result.view(), kernel_));
 	return image.swap(result);
 }
 
@@ -298,17 +382,74 @@ Filter::Kernel Laplacian5x5::init()
 	return kernel;
 }
 
+namespace{
+class BoxBand{
+public:
+	BoxBand(const IntegralImage& integral, const ImageView& result, column_t radius_x, row_t radius_y):
+		integral_(integral), result_(result), radius_x_(radius_x), radius_y_(radius_y){}
+	void operator()(std::size_t begin, std::size_t end)const
+	{
+		for(row_t h = static_cast<row_t>(begin); h < end; ++h){
+			const row_t top    = h < radius_y_ ? 0 : h - radius_y_;
+			const row_t bottom = result_.height() - h <= radius_y_ ? result_.height() : h + radius_y_ + 1;
+			for(column_t w = 0; w < result_.width(); ++w){
+				const column_t left  = w < radius_x_ ? 0 : w - radius_x_;
+				const column_t right = result_.width() - w <= radius_x_ ? result_.width() : w + radius_x_ + 1;
+				const uint64_t n = static_cast<uint64_t>(right - left)*(bottom - top);
+				result_[h][w] = Image::pixel_type(
+						static_cast<Image::pixel_type::value_type>((integral_.sum(0, left, top, right - left, bottom - top) + n/2)/n),
+						static_cast<Image::pixel_type::value_type>((integral_.sum(1, left, top, right - left, bottom - top) + n/2)/n),
+						static_cast<Image::pixel_type::value_type>((integral_.sum(2, left, top, right - left, bottom - top) + n/2)/n));
+			}
+		}
+	}
+private:
+	const IntegralImage& integral_;
+	const ImageView result_;
+	const column_t radius_x_;
+	const row_t radius_y_;
+};
+}
+
+/**
+ * 積分画像を使うので、窓の大きさによらず1画素当たりの計算量は一定。
+ * 画像の端では、はみ出した部分を除いた窓で平均する。
+ */
+Image& BoxBlur::process(Image& image)const
+{
+	const IntegralImage integral(image, false);
+	Image result(image.width(), image.height());
+	parallel_for(0, result.height(), BoxBand(integral, result.view(), radius_x_, radius_y_));
+	return image.swap(result);
+}
+
+namespace{
+class ScaleBand{
+public:
+	ScaleBand(const Image& image, const ImageView& result): image_(image), result_(result){}
+	void operator()(std::size_t begin, std::size_t end)const
+	{
+		for(row_t h = static_cast<row_t>(begin); h < end; ++h){
+			const ConstRow src = image_[h * image_.height() / result_.height()];
+			for(column_t w = 0; w < result_.width(); ++w){
+				result_[h][w] = src[w * image_.width() / result_.width()];
+			}
+		}
+	}
+private:
+	const Image& image_;
+	const ImageView result_;
+};
+}
+
 /**
  * @TODO アルゴリズムがイケてないので改善する。
  */
 Image& HScale::process(Image& image)const
 {
 	Image result(width_, image.height());
-	for(row_t h = 0; h < image.height(); ++h){
-		for(column_t w = 0; w < width_; ++w){
-			result[h][w] = image[h][w * image.width() / width_];
-		}
-	}
+	const Image& source = image;
+	parallel_for(0, result.height(), ScaleBand(source, result.view()));
 	return image.swap(result);
 }
 
@@ -318,12 +459,60 @@ Image& HScale::process(Image& image)const
 Image& VScale::process(Image& image)const
 {
 	Image result(image.width(), height_);
-	for(column_t w = 0; w < image.width(); ++w){
-		for(row_t h = 0; h < height_; ++h){
-			result[h][w] = image[h * image.height() / height_][w];
+	const Image& source = image;
+	parallel_for(0, result.height(), ScaleBand(source, result.view()));
+	return image.swap(result);
+}
+
+namespace{
+class KeyStoneRows{
+public:
+	KeyStoneRows(const Image& image, const ImageView& result, column_t offset, bool top, bool left):
+		image_(image), result_(result), offset_(offset), top_(top), left_(left){}
+	void operator()(std::size_t begin, std::size_t end)const
+	{
+		const column_t width  = image_.width();
+		const row_t    height = image_.height();
+		for(row_t h = static_cast<row_t>(begin); h < end; ++h){
+			const column_t current_offset = offset_*(top_ ? height - h : h)/height;
+			const column_t shift = left_ ? current_offset : 0;
+			for(column_t w = 0; w < width - current_offset; ++w){
+				result_[h][w + shift] = image_[h][w*width/(width - current_offset)];
+			}
 		}
 	}
-	return image.swap(result);
+private:
+	const Image& image_;
+	const ImageView result_;
+	column_t offset_;
+	bool top_;
+	bool left_;
+};
+
+class KeyStoneColumns{
+public:
+	KeyStoneColumns(const Image& image, const ImageView& result, row_t offset, column_t width_offset, bool top, bool left):
+		image_(image), result_(result), offset_(offset), width_offset_(width_offset), top_(top), left_(left){}
+	void operator()(std::size_t begin, std::size_t end)const
+	{
+		const column_t width  = image_.width();
+		const row_t    height = image_.height();
+		for(column_t w = static_cast<column_t>(begin); w < end; ++w){
+			const row_t current_offset = offset_*(left_ ? width - w : w)/(width - width_offset_);
+			const row_t shift = top_ ? current_offset : 0;
+			for(row_t h = 0; h < height - current_offset; ++h){
+				result_[h + shift][w] = image_[h*height/(height - current_offset)][w];
+			}
+		}
+	}
+private:
+	const Image& image_;
+	const ImageView result_;
+	row_t offset_;
+	column_t width_offset_;
+	bool top_;
+	bool left_;
+};
 }
 
 Image& KeyStone::process(Image& image)const
@@ -332,65 +521,14 @@ Image& KeyStone::process(Image& image)const
 	Image phase2 = Image(image.width(), image.height());
 	phase1 >>= Luster(black);
 	phase2 >>= Luster(black);
-	switch(vertex_){
-	case TOP_LEFT:
-		for(row_t h = 0; h < image.height(); ++h){
-			const column_t current_offset = width_offset_*(image.height() - h)/image.height();
-			for(column_t w = 0; w < image.width() - current_offset; ++w){
-				phase1[h][w + current_offset] = image[h][w*image.width()/(image.width() - current_offset)];
-			}
-		}
-		for(column_t w = 0; w < image.width(); ++w){
-			const row_t current_offset = height_offset_*(image.width() - w)/(image.width() - width_offset_);
-			for(row_t h = 0; h < image.height() - current_offset; ++h){
-				phase2[h + current_offset][w] = phase1[h*image.height()/(image.height() - current_offset)][w];
-			}
-		}
-		break;
-	case TOP_RIGHT:
-		for(row_t h = 0; h < image.height(); ++h){
-			const column_t current_offset = width_offset_*(image.height() - h)/image.height();
-			for(column_t w = 0; w < image.width() - current_offset; ++w){
-				phase1[h][w] = image[h][w*image.width()/(image.width() - current_offset)];
-			}
-		}
-		for(column_t w = 0; w < image.width(); ++w){
-			const row_t current_offset = height_offset_*w/(image.width() - width_offset_);
-			for(row_t h = 0; h < image.height() - current_offset; ++h){
-				phase2[h + current_offset][w] = phase1[h*image.height()/(image.height() - current_offset)][w];
-			}
-		}
-		break;
-	case BOTTOM_LEFT:
-		for(row_t h = 0; h < image.height(); ++h){
-			const column_t current_offset = width_offset_*h/image.height();
-			for(column_t w = 0; w < image.width() - current_offset; ++w){
-				phase1[h][w + current_offset] = image[h][w*image.width()/(image.width() - current_offset)];
-			}
-		}
-		for(column_t w = 0; w < image.width(); ++w){
-			const row_t current_offset = height_offset_*(image.width() - w)/(image.width() - width_offset_);
-			for(row_t h = 0; h < image.height() - current_offset; ++h){
-				phase2[h][w] = phase1[h*image.height()/(image.height() - current_offset)][w];
-			}
-		}
-		break;
-	case BOTTOM_RIGHT:
-		for(row_t h = 0; h < image.height(); ++h){
-			const column_t current_offset = width_offset_*h/image.height();
-			for(column_t w = 0; w < image.width() - current_offset; ++w){
-				phase1[h][w] = image[h][w*image.width()/(image.width() - current_offset)];
-			}
-		}
-		for(column_t w = 0; w < image.width(); ++w){
-			const row_t current_offset = height_offset_*w/(image.width() - width_offset_);
-			for(row_t h = 0; h < image.height() - current_offset; ++h){
-				phase2[h][w] = phase1[h*image.height()/(image.height() - current_offset)][w];
-			}
-		}
-		break;
-	default:
-		break;
+	if(vertex_ != TOP_LEFT && vertex_ != TOP_RIGHT && vertex_ != BOTTOM_LEFT && vertex_ != BOTTOM_RIGHT){
+		return image.swap(phase2);
 	}
+	const bool top  = vertex_ == TOP_LEFT || vertex_ == TOP_RIGHT;
+	const bool left = vertex_ == TOP_LEFT || vertex_ == BOTTOM_LEFT;
+	const Image& source = image;
+	parallel_for(0, image.height(), KeyStoneRows(source, phase1.view(), width_offset_, top, left));
+	const Image& intermediate = phase1;
+	parallel_for(0, image.width(), KeyStoneColumns(intermediate, phase2.view(), height_offset_, width_offset_, top, left));
 	return image.swap(phase2);
 }
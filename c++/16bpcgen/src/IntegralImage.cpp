@@ -0,0 +1,136 @@
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include "IntegralImage.hpp"
+#include "ThreadPool.hpp"
+
+IntegralImage::IntegralImage(const Image& image, bool squared):
+	width_(image.width()), height_(image.height()), sums_(), squares_()
+{
+	sums_.resize(3*(static_cast<std::size_t>(width_) + 1)*(height_ + 1));
+	if(squared){
+		squares_.resize(sums_.size());
+	}
+	build(ImageView(const_cast<byte_t*>(image.head()), image.width(), image.height(), image.pitch()));
+}
+
+IntegralImage::IntegralImage(const ImageView& image, bool squared):
+	width_(image.width()), height_(image.height()), sums_(), squares_()
+{
+	sums_.resize(3*(static_cast<std::size_t>(width_) + 1)*(height_ + 1));
+	if(squared){
+		squares_.resize(sums_.size());
+	}
+	build(image);
+}
+
+IntegralImage::~IntegralImage()
+{
+}
+
+namespace{
+/**
+ * 1パス目。行ごとに水平方向の累積和を求め、テーブルの1行下に書き込む。
+ */
+class RowScan{
+public:
+	RowScan(const ImageView& image, std::vector<uint64_t>& sums, std::vector<uint64_t>& squares):
+		image_(image), sums_(sums), squares_(squares){}
+	void operator()(std::size_t begin, std::size_t end)const
+	{
+		const std::size_t stride = 3*(static_cast<std::size_t>(image_.width()) + 1);
+		for(row_t h = static_cast<row_t>(begin); h < end; ++h){
+			const Image::pixel_type* const row = &image_[h][0];
+			uint64_t* const sum = &sums_[(h + 1)*stride];
+			uint64_t r = 0, g = 0, b = 0;
+			for(column_t w = 0; w < image_.width(); ++w){
+				sum[3*w + 3] = r += row[w].R();
+				sum[3*w + 4] = g += row[w].G();
+				sum[3*w + 5] = b += row[w].B();
+			}
+			if(squares_.empty()){
+				continue;
+			}
+			uint64_t* const square = &squares_[(h + 1)*stride];
+			r = g = b = 0;
+			for(column_t w = 0; w < image_.width(); ++w){
+				square[3*w + 3] = r += static_cast<uint64_t>(row[w].R())*row[w].R();
+				square[3*w + 4] = g += static_cast<uint64_t>(row[w].G())*row[w].G();
+				square[3*w + 5] = b += static_cast<uint64_t>(row[w].B())*row[w].B();
+			}
+		}
+	}
+private:
+	const ImageView image_;
+	std::vector<uint64_t>& sums_;
+	std::vector<uint64_t>& squares_;
+};
+
+/**
+ * 2パス目。列の帯ごとに上から下へ足し込む。
+ * 帯の中は連続したメモリなので、行をまたいでもキャッシュラインを無駄にしない。
+ */
+class ColumnScan{
+public:
+	ColumnScan(std::vector<uint64_t>& table, std::size_t stride): table_(table), stride_(stride){}
+	void operator()(std::size_t begin, std::size_t end)const
+	{
+		uint64_t* const table = &table_[0];
+		for(std::size_t offset = stride_; offset < table_.size(); offset += stride_){
+			for(std::size_t i = begin; i < end; ++i){
+				table[offset + i] += table[offset - stride_ + i];
+			}
+		}
+	}
+private:
+	std::vector<uint64_t>& table_;
+	const std::size_t stride_;
+};
+}
+
+/**
+ * 1行1列ずつ大きいテーブルに、左上を原点とする累積和を作る。
+ * 二乗和は1チャンネル当たり4.3e9程度の画素数まで桁あふれしない。
+ */
+void IntegralImage::build(const ImageView& image)
+{
+	const std::size_t stride = 3*(static_cast<std::size_t>(width_) + 1);
+	parallel_for(0, height_, RowScan(image, sums_, squares_));
+	parallel_for(0, stride, ColumnScan(sums_, stride), 768);
+	if(!squares_.empty()){
+		parallel_for(0, stride, ColumnScan(squares_, stride), 768);
+	}
+}
+
+uint64_t IntegralImage::squared_sum(byte_t plane, column_t x, row_t y, column_t w, row_t h)const
+{
+	if(squares_.empty()){
+		throw std::runtime_error(__func__ + std::string(": squared sums are not built."));
+	}
+	return query(squares_, plane, x, y, w, h);
+}
+
+Pixel<double> IntegralImage::mean(column_t x, row_t y, column_t w, row_t h)const
+{
+	const double n = static_cast<double>(w)*h;
+	if(!w || !h){
+		return Pixel<double>(0.0, 0.0, 0.0);
+	}
+	return Pixel<double>(
+			static_cast<double>(sum(0, x, y, w, h))/n,
+			static_cast<double>(sum(1, x, y, w, h))/n,
+			static_cast<double>(sum(2, x, y, w, h))/n);
+}
+
+Pixel<double> IntegralImage::variance(column_t x, row_t y, column_t w, row_t h)const
+{
+	const double n = static_cast<double>(w)*h;
+	if(!w || !h){
+		return Pixel<double>(0.0, 0.0, 0.0);
+	}
+	const Pixel<double> m = mean(x, y, w, h);
+	return Pixel<double>(
+			std::max(0.0, static_cast<double>(squared_sum(0, x, y, w, h))/n - m.R()*m.R()),
+			std::max(0.0, static_cast<double>(squared_sum(1, x, y, w, h))/n - m.G()*m.G()),
+			std::max(0.0, static_cast<double>(squared_sum(2, x, y, w, h))/n - m.B()*m.B()));
+}
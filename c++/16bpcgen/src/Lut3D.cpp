@@ -0,0 +1,216 @@
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "Lut3D.hpp"
+
+namespace{
+/**
+ * セル内の位置の大小関係(bit0: fg <= fr, bit1: fb <= fg, bit2: fb <= fr)から、
+ * 値の大きい順に並べた軸(0: R, 1: G, 2: B)を返す。3と4は起こり得ない組み合わせ。
+ */
+const byte_t* tetrahedron(int relation)
+{
+	static const byte_t orders[8][3] = {
+		{2, 1, 0},
+		{2, 0, 1},
+		{1, 2, 0},
+		{0, 1, 2},
+		{0, 1, 2},
+		{0, 2, 1},
+		{1, 0, 2},
+		{0, 1, 2}
+	};
+	return orders[relation];
+}
+}
+
+Lut3D::Lut3D(const std::string& filename):
+	title_(), size_(0), scale_(), bias_(), stride_(), axes_(), offsets_(), lattice_()
+{
+	std::ifstream ifs(filename.c_str());
+	if(!ifs){
+		throw std::invalid_argument(__func__ + std::string(": can not load 3D LUT. file not found: ") + filename);
+	}
+	load(ifs);
+}
+
+Lut3D::Lut3D(std::istream& is):
+	title_(), size_(0), scale_(), bias_(), stride_(), axes_(), offsets_(), lattice_()
+{
+	load(is);
+}
+
+/**
+ * Adobe/Resolveの.cube形式を読む。データ行はRが最も速く変化する順に並ぶ。
+ * 格子点は(R, G, B, 0)の4要素を16bitで持ち、1点を1回の64bitロードで読めるようにする(65^3でも2.2MB)。
+ * 入力は各軸で格子座標pos = value*scale + biasへ写し、DOMAIN_MIN/MAXもここに畳み込む。
+ */
+void Lut3D::load(std::istream& is)
+{
+	std::vector<double> table;
+	double domain_min[3] = {0.0, 0.0, 0.0};
+	double domain_max[3] = {1.0, 1.0, 1.0};
+	std::string line;
+	while(std::getline(is, line)){
+		line.erase(std::remove(line.begin(), line.end(), '\r'), line.end());
+		std::istringstream iss(line);
+		std::string keyword;
+		if(!(iss >> keyword) || keyword[0] == '#'){
+			continue;
+		}
+		if(keyword == "TITLE"){
+			const std::string::size_type first = line.find('"');
+			const std::string::size_type last = line.rfind('"');
+			title_ = first < last ? line.substr(first + 1, last - first - 1) : std::string();
+		}else if(keyword == "LUT_3D_SIZE"){
+			iss >> size_;
+		}else if(keyword == "DOMAIN_MIN"){
+			iss >> domain_min[0] >> domain_min[1] >> domain_min[2];
+		}else if(keyword == "DOMAIN_MAX"){
+			iss >> domain_max[0] >> domain_max[1] >> domain_max[2];
+		}else if(keyword == "LUT_3D_INPUT_RANGE"){
+			iss >> domain_min[0] >> domain_max[0];
+			std::fill(domain_min + 1, domain_min + 3, domain_min[0]);
+			std::fill(domain_max + 1, domain_max + 3, domain_max[0]);
+		}else if(keyword == "LUT_1D_SIZE"){
+			throw std::invalid_argument(__func__ + std::string(": can not load 3D LUT. 1D LUT is not supported."));
+		}else if(std::isdigit(static_cast<unsigned char>(keyword[0])) || keyword[0] == '-' || keyword[0] == '+' || keyword[0] == '.'){
+			std::istringstream values(line);
+			double r = 0.0, g = 0.0, b = 0.0;
+			if(!(values >> r >> g >> b)){
+				throw std::invalid_argument(__func__ + std::string(": can not load 3D LUT. invalid data line: ") + line);
+			}
+			table.push_back(r);
+			table.push_back(g);
+			table.push_back(b);
+		}
+		if(iss.fail()){
+			throw std::invalid_argument(__func__ + std::string(": can not load 3D LUT. invalid keyword line: ") + line);
+		}
+	}
+	if(size_ < min_size || max_size < size_){
+		throw std::invalid_argument(__func__ + std::string(": can not load 3D LUT. invalid LUT_3D_SIZE."));
+	}
+	if(table.size() != 3*size_*size_*size_){
+		throw std::invalid_argument(__func__ + std::string(": can not load 3D LUT. data count does not match LUT_3D_SIZE."));
+	}
+	for(int i = 0; i < 3; ++i){
+		if(!(domain_min[i] < domain_max[i])){
+			throw std::invalid_argument(__func__ + std::string(": can not load 3D LUT. invalid domain."));
+		}
+		const double cells = static_cast<double>(size_ - 1);
+		scale_[i] = static_cast<float>(cells/(Image::pixel_type::max*(domain_max[i] - domain_min[i])));
+		bias_[i]  = static_cast<float>(-domain_min[i]*cells/(domain_max[i] - domain_min[i]));
+	}
+	stride_[0] = 4;
+	stride_[1] = 4*size_;
+	stride_[2] = 4*size_*size_;
+	for(int i = 0; i < 8; ++i){
+		const byte_t* const order = tetrahedron(i);
+		std::copy(order, order + 3, axes_[i]);
+		offsets_[i][0] = stride_[order[0]];
+		offsets_[i][1] = stride_[order[0]] + stride_[order[1]];
+	}
+	lattice_.assign(4*size_*size_*size_, 0);
+	for(std::size_t i = 0, n = 0; i < table.size(); i += 3, n += 4){
+		for(std::size_t c = 0; c < 3; ++c){
+			lattice_[n + c] = static_cast<value_type>(std::min(std::max(table[i + c], 0.0), 1.0)*Image::pixel_type::max + 0.5);
+		}
+	}
+}
+
+/**
+ * 四面体補間。セル内の位置(fr, fg, fb)の大小関係で6つの四面体のどれに入るかを決め、
+ * 頂点c000, cA, cAB, c111を重み(1 - f1, f1 - f2, f2 - f3, f3)で足し合わせる(f1 >= f2 >= f3)。
+ * 四面体の選択は表引きで行い、画素ごとの分岐を持たない。
+ * 重みは非負で和が1なので、結果は格子点の値の範囲に収まる。
+ */
+inline void Lut3D::interpolate(Image::pixel_type& pixel)const
+{
+	const float top = static_cast<float>(size_ - 1);
+	int index[4];
+	float f[4];
+#if defined(__SSE2__)
+	const __m128 position = _mm_min_ps(_mm_max_ps(_mm_add_ps(
+			_mm_mul_ps(_mm_cvtepi32_ps(_mm_setr_epi32(pixel.R(), pixel.G(), pixel.B(), 0)), _mm_loadu_ps(scale_)),
+			_mm_loadu_ps(bias_)), _mm_setzero_ps()), _mm_set1_ps(top));
+	const __m128i cell = _mm_cvttps_epi32(_mm_min_ps(position, _mm_set1_ps(top - 1.0f)));
+	_mm_storeu_si128(static_cast<__m128i*>(static_cast<void*>(index)), cell);
+	_mm_storeu_ps(f, _mm_sub_ps(position, _mm_cvtepi32_ps(cell)));
+#else
+	const value_type v[3] = {pixel.R(), pixel.G(), pixel.B()};
+	for(int c = 0; c < 3; ++c){
+		const float position = std::min(std::max(v[c]*scale_[c] + bias_[c], 0.0f), top);
+		index[c] = static_cast<int>(std::min(position, top - 1.0f));
+		f[c] = position - static_cast<float>(index[c]);
+	}
+#endif
+	const int relation = (f[1] <= f[0]) | (f[2] <= f[1]) << 1 | (f[2] <= f[0]) << 2;
+	const byte_t* const axis = axes_[relation];
+	const float w1 = f[axis[0]], w2 = f[axis[1]], w3 = f[axis[2]];
+	const value_type* const c000 = &lattice_[
+			static_cast<std::size_t>(index[0])*stride_[0] +
+			static_cast<std::size_t>(index[1])*stride_[1] +
+			static_cast<std::size_t>(index[2])*stride_[2]];
+	const value_type* const cA   = c000 + offsets_[relation][0];
+	const value_type* const cAB  = c000 + offsets_[relation][1];
+	const value_type* const c111 = c000 + stride_[0] + stride_[1] + stride_[2];
+	const float k0 = 1.0f - w1, k1 = w1 - w2, k2 = w2 - w3, k3 = w3;
+#if defined(__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+	const __m128 n000 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_loadl_epi64(static_cast<const __m128i*>(static_cast<const void*>(c000))), zero));
+	const __m128 nA   = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_loadl_epi64(static_cast<const __m128i*>(static_cast<const void*>(cA))),   zero));
+	const __m128 nAB  = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_loadl_epi64(static_cast<const __m128i*>(static_cast<const void*>(cAB))),  zero));
+	const __m128 n111 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_loadl_epi64(static_cast<const __m128i*>(static_cast<const void*>(c111))), zero));
+	const __m128 sum = _mm_add_ps(
+			_mm_add_ps(_mm_mul_ps(_mm_set1_ps(k0), n000), _mm_mul_ps(_mm_set1_ps(k1), nA)),
+			_mm_add_ps(_mm_mul_ps(_mm_set1_ps(k2), nAB),  _mm_mul_ps(_mm_set1_ps(k3), n111)));
+	int rgb[4];
+	_mm_storeu_si128(static_cast<__m128i*>(static_cast<void*>(rgb)), _mm_cvttps_epi32(_mm_add_ps(sum, _mm_set1_ps(0.5f))));
+#else
+	int rgb[3];
+	for(int c = 0; c < 3; ++c){
+		rgb[c] = static_cast<int>((k0*c000[c] + k1*cA[c]) + (k2*cAB[c] + k3*c111[c]) + 0.5f);
+	}
+#endif
+	pixel.R(static_cast<value_type>(rgb[0]));
+	pixel.G(static_cast<value_type>(rgb[1]));
+	pixel.B(static_cast<value_type>(rgb[2]));
+}
+
+Image::pixel_type& Lut3D::convert(Image::pixel_type& pixel)const
+{
+	interpolate(pixel);
+	return pixel;
+}
+
+/**
+ * 生成したパターンは同じ色が続くことが多いので、直前の画素と同じ入力なら補間をやり直さず結果を使い回す。
+ */
+void Lut3D::convert_row(Image::pixel_type* first, Image::pixel_type* last)const
+{
+	if(!uses_kernel_of<Lut3D>()){
+		convert_each(first, last);
+		return;
+	}
+	if(first == last){
+		return;
+	}
+	Image::pixel_type input = *first;
+	interpolate(*first);
+	Image::pixel_type output = *first;
+	for(++first; first != last; ++first){
+		if(first->R() == input.R() && first->G() == input.G() && first->B() == input.B()){
+			*first = output;
+			continue;
+		}
+		input = *first;
+		interpolate(*first);
+		output = *first;
+	}
+}
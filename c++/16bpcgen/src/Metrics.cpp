@@ -0,0 +1,359 @@
+#include <algorithm>
+#ifdef _MSC_VER
+#define _USE_MATH_DEFINES
+#endif
+#include <cmath>
+#ifndef M_PI
+#define M_PI 3.1415926535
+#endif
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "Metrics.hpp"
+#include "ThreadPool.hpp"
+
+Metrics::Metrics(const Image& reference, const Image& image): reference_(reference), image_(image)
+{
+	if(reference_.width() != image_.width() || reference_.height() != image_.height()){
+		throw std::invalid_argument(__func__ + std::string(": can not compare images. image width/height unmatch."));
+	}
+}
+
+namespace{
+class SquaredError{
+public:
+	SquaredError(const Image& reference, const Image& image, std::vector<uint64_t>& sums):
+		reference_(reference), image_(image), sums_(sums){}
+	void operator()(std::size_t begin, std::size_t end)const
+	{
+		for(row_t h = static_cast<row_t>(begin); h < end; ++h){
+			const ConstRow a = reference_[h];
+			const ConstRow b = image_[h];
+			uint64_t r = 0, g = 0, bl = 0;
+			for(column_t w = 0; w < reference_.width(); ++w){
+				const uint32_t ar = a[w].R(), ag = a[w].G(), ab = a[w].B();
+				const uint32_t br = b[w].R(), bg = b[w].G(), bb = b[w].B();
+				const uint32_t dr = ar < br ? br - ar : ar - br;
+				const uint32_t dg = ag < bg ? bg - ag : ag - bg;
+				const uint32_t db = ab < bb ? bb - ab : ab - bb;
+				r  += static_cast<uint64_t>(dr)*dr;
+				g  += static_cast<uint64_t>(dg)*dg;
+				bl += static_cast<uint64_t>(db)*db;
+			}
+			sums_[3*h    ] = r;
+			sums_[3*h + 1] = g;
+			sums_[3*h + 2] = bl;
+		}
+	}
+private:
+	const Image& reference_;
+	const Image& image_;
+	std::vector<uint64_t>& sums_;
+};
+}
+
+Pixel<double> Metrics::mse()const
+{
+	std::vector<uint64_t> sums(3*static_cast<std::size_t>(image_.height()));
+	parallel_for(0, image_.height(), SquaredError(reference_, image_, sums));
+	double total[3] = {0.0, 0.0, 0.0};
+	for(std::size_t i = 0; i < sums.size(); ++i){
+		total[i%3] += static_cast<double>(sums[i]);
+	}
+	const double pixels = std::max(1.0, static_cast<double>(image_.width())*image_.height());
+	return Pixel<double>(total[0]/pixels, total[1]/pixels, total[2]/pixels);
+}
+
+Pixel<double> Metrics::psnr()const
+{
+	const Pixel<double> error = mse();
+	const double peak = static_cast<double>(Image::pixel_type::max)*Image::pixel_type::max;
+	const double inf = std::numeric_limits<double>::infinity();
+	return Pixel<double>(
+			0.0 < error.R() ? 10.0*std::log10(peak/error.R()) : inf,
+			0.0 < error.G() ? 10.0*std::log10(peak/error.G()) : inf,
+			0.0 < error.B() ? 10.0*std::log10(peak/error.B()) : inf);
+}
+
+namespace{
+/**
+ * 11x11, σ=1.5のガウス窓によるSSIM。
+ * 水平方向の畳み込み結果を窓の高さ分だけリングバッファに保持し、帯ごとに縦方向へ畳み込む。
+ * 画像端は端の画素を複製して扱う。
+ */
+class SsimBand{
+public:
+	static const int radius = 5;
+	static const int taps = 2*radius + 1;
+	static const int quantities = 5;
+	SsimBand(const Image& reference, const Image& image, std::vector<double>& sums, const ImageView& map):
+		reference_(reference), image_(image), sums_(sums), map_(map), weights_(taps)
+	{
+		double total = 0.0;
+		for(int k = 0; k < taps; ++k){
+			total += std::exp(-(k - radius)*(k - radius)/(2.0*1.5*1.5));
+		}
+		for(int k = 0; k < taps; ++k){
+			weights_[static_cast<std::size_t>(k)] = static_cast<float>(std::exp(-(k - radius)*(k - radius)/(2.0*1.5*1.5))/total);
+		}
+	}
+	void operator()(std::size_t begin, std::size_t end)const
+	{
+		const std::size_t width = reference_.width();
+		std::vector<float> ring(3*quantities*taps*width);
+		std::vector<float> padded(quantities*(width + 2*radius));
+		for(std::ptrdiff_t r = static_cast<std::ptrdiff_t>(begin) - radius; r < static_cast<std::ptrdiff_t>(begin) + radius; ++r){
+			horizontal(r, ring, padded);
+		}
+		const float c1 = 0.01f*0.01f;
+		const float c2 = 0.03f*0.03f;
+		std::vector<float> moments(quantities*width);
+		std::vector<float> loss(width);
+		for(row_t h = static_cast<row_t>(begin); h < end; ++h){
+			horizontal(static_cast<std::ptrdiff_t>(h) + radius, ring, padded);
+			double sum[3] = {0.0, 0.0, 0.0};
+			std::fill(loss.begin(), loss.end(), 0.0f);
+			for(std::size_t c = 0; c < 3; ++c){
+				std::fill(moments.begin(), moments.end(), 0.0f);
+				for(int k = 0; k < taps; ++k){
+					const std::size_t s = slot(static_cast<std::ptrdiff_t>(h) - radius + k);
+					for(int q = 0; q < quantities; ++q){
+						const float* const src = &ring[((c*quantities + static_cast<std::size_t>(q))*taps + s)*width];
+						float* const dst = &moments[static_cast<std::size_t>(q)*width];
+						for(std::size_t w = 0; w < width; ++w){
+							dst[w] += weights_[static_cast<std::size_t>(k)]*src[w];
+						}
+					}
+				}
+				const float* const mu_a = &moments[0];
+				const float* const mu_b = &moments[width];
+				const float* const aa   = &moments[2*width];
+				const float* const bb   = &moments[3*width];
+				const float* const ab   = &moments[4*width];
+				float* const ssim = &moments[0];
+				for(std::size_t w = 0; w < width; ++w){
+					const float var_a  = aa[w] - mu_a[w]*mu_a[w];
+					const float var_b  = bb[w] - mu_b[w]*mu_b[w];
+					const float covar  = ab[w] - mu_a[w]*mu_b[w];
+					ssim[w] = (2.0f*mu_a[w]*mu_b[w] + c1)*(2.0f*covar + c2)/
+						((mu_a[w]*mu_a[w] + mu_b[w]*mu_b[w] + c1)*(var_a + var_b + c2));
+				}
+				for(std::size_t w = 0; w < width; ++w){
+					sum[c] += static_cast<double>(ssim[w]);
+					loss[w] += (1.0f - ssim[w])/3.0f;
+				}
+			}
+			sums_[3*h    ] = sum[0];
+			sums_[3*h + 1] = sum[1];
+			sums_[3*h + 2] = sum[2];
+			if(map_.width()){
+				const Row row = map_[h];
+				for(std::size_t w = 0; w < width; ++w){
+					row[static_cast<column_t>(w)] = Metrics::heat(static_cast<double>(loss[w]));
+				}
+			}
+		}
+	}
+private:
+	static std::size_t slot(std::ptrdiff_t row){return static_cast<std::size_t>((row + taps)%taps);}
+	void horizontal(std::ptrdiff_t r, std::vector<float>& ring, std::vector<float>& padded)const
+	{
+		const std::size_t width = reference_.width();
+		const std::size_t span = width + 2*radius;
+		const row_t row = static_cast<row_t>(std::min<std::ptrdiff_t>(std::max<std::ptrdiff_t>(r, 0), reference_.height() - 1));
+		const ConstRow a = reference_[row];
+		const ConstRow b = image_[row];
+		const float scale = 1.0f/Image::pixel_type::max;
+		for(std::size_t c = 0; c < 3; ++c){
+			for(std::size_t i = 0; i < span; ++i){
+				const column_t w = static_cast<column_t>(std::min(std::max<std::ptrdiff_t>(static_cast<std::ptrdiff_t>(i) - radius, 0), static_cast<std::ptrdiff_t>(width) - 1));
+				const float x = scale*static_cast<float>(c == 0 ? a[w].R() : c == 1 ? a[w].G() : a[w].B());
+				const float y = scale*static_cast<float>(c == 0 ? b[w].R() : c == 1 ? b[w].G() : b[w].B());
+				padded[i           ] = x;
+				padded[i +   span  ] = y;
+				padded[i + 2*span  ] = x*x;
+				padded[i + 3*span  ] = y*y;
+				padded[i + 4*span  ] = x*y;
+			}
+			for(std::size_t q = 0; q < quantities; ++q){
+				float* const dst = &ring[((c*quantities + q)*taps + slot(r))*width];
+				const float* const src = &padded[q*span];
+				std::fill(dst, dst + width, 0.0f);
+				for(int k = 0; k < taps; ++k){
+					for(std::size_t w = 0; w < width; ++w){
+						dst[w] += weights_[static_cast<std::size_t>(k)]*src[w + static_cast<std::size_t>(k)];
+					}
+				}
+			}
+		}
+	}
+	const Image& reference_;
+	const Image& image_;
+	std::vector<double>& sums_;
+	const ImageView map_;
+	std::vector<float> weights_;
+};
+}
+
+Pixel<double> Metrics::ssim(Image* map)const
+{
+	if(!image_.width() || !image_.height()){
+		return Pixel<double>(1.0, 1.0, 1.0);
+	}
+	std::vector<double> sums(3*static_cast<std::size_t>(image_.height()));
+	Image heatmap(map ? image_.width() : 0, map ? image_.height() : 0);
+	parallel_for(0, image_.height(), SsimBand(reference_, image_, sums, heatmap.view()), 64);
+	if(map){
+		map->swap(heatmap);
+	}
+	double total[3] = {0.0, 0.0, 0.0};
+	for(std::size_t i = 0; i < sums.size(); ++i){
+		total[i%3] += sums[i];
+	}
+	const double pixels = static_cast<double>(image_.width())*image_.height();
+	return Pixel<double>(total[0]/pixels, total[1]/pixels, total[2]/pixels);
+}
+
+static std::vector<float> srgb_table()
+{
+	std::vector<float> table(static_cast<std::size_t>(Image::pixel_type::max) + 1);
+	for(std::size_t i = 0; i < table.size(); ++i){
+		const double v = static_cast<double>(i)/Image::pixel_type::max;
+		table[i] = static_cast<float>(v <= 0.04045 ? v/12.92 : std::pow((v + 0.055)/1.055, 2.4));
+	}
+	return table;
+}
+
+static const std::vector<float>& srgb_to_linear()
+{
+	static const std::vector<float> table = srgb_table();
+	return table;
+}
+
+static double lab_f(double t)
+{
+	const double delta = 6.0/29.0;
+	return delta*delta*delta < t ? std::pow(t, 1.0/3.0) : t/(3.0*delta*delta) + 4.0/29.0;
+}
+
+Pixel<double> Metrics::lab(const Image::pixel_type& pixel)
+{
+	const std::vector<float>& linear = srgb_to_linear();
+	const double r = static_cast<double>(linear[pixel.R()]);
+	const double g = static_cast<double>(linear[pixel.G()]);
+	const double b = static_cast<double>(linear[pixel.B()]);
+	const double x = (0.4124564*r + 0.3575761*g + 0.1804375*b)/0.95047;
+	const double y =  0.2126729*r + 0.7151522*g + 0.0721750*b;
+	const double z = (0.0193339*r + 0.1191920*g + 0.9503041*b)/1.08883;
+	const double fy = lab_f(y);
+	return Pixel<double>(116.0*fy - 16.0, 500.0*(lab_f(x) - fy), 200.0*(fy - lab_f(z)));
+}
+
+/**
+ * CIEDE2000色差。
+ * G. Sharma, W. Wu, E. N. Dalal, "The CIEDE2000 Color-Difference Formula", 2005 の式に従う。
+ */
+double Metrics::ciede2000(const Pixel<double>& lab1, const Pixel<double>& lab2)
+{
+	const double deg = M_PI/180.0;
+	const double pow25_7 = 6103515625.0;
+	const double c1 = std::sqrt(lab1.G()*lab1.G() + lab1.B()*lab1.B());
+	const double c2 = std::sqrt(lab2.G()*lab2.G() + lab2.B()*lab2.B());
+	const double c_bar7 = std::pow((c1 + c2)/2.0, 7.0);
+	const double g = 0.5*(1.0 - std::sqrt(c_bar7/(c_bar7 + pow25_7)));
+	const double a1 = (1.0 + g)*lab1.G();
+	const double a2 = (1.0 + g)*lab2.G();
+	const double cp1 = std::sqrt(a1*a1 + lab1.B()*lab1.B());
+	const double cp2 = std::sqrt(a2*a2 + lab2.B()*lab2.B());
+	double hp1 = std::atan2(lab1.B(), a1)/deg;
+	double hp2 = std::atan2(lab2.B(), a2)/deg;
+	hp1 += hp1 < 0.0 ? 360.0 : 0.0;
+	hp2 += hp2 < 0.0 ? 360.0 : 0.0;
+
+	const double dl = lab2.R() - lab1.R();
+	const double dc = cp2 - cp1;
+	double dh = 0.0;
+	if(0.0 < cp1*cp2){
+		dh = hp2 - hp1;
+		dh -= 180.0 < dh ? 360.0 : 0.0;
+		dh += dh < -180.0 ? 360.0 : 0.0;
+	}
+	const double dhh = 2.0*std::sqrt(cp1*cp2)*std::sin(dh/2.0*deg);
+
+	const double l_bar = (lab1.R() + lab2.R())/2.0;
+	const double c_bar = (cp1 + cp2)/2.0;
+	double h_bar = hp1 + hp2;
+	if(0.0 < cp1*cp2){
+		h_bar = std::fabs(hp1 - hp2) <= 180.0 ? h_bar/2.0 : h_bar < 360.0 ? (h_bar + 360.0)/2.0 : (h_bar - 360.0)/2.0;
+	}
+	const double t = 1.0 - 0.17*std::cos((h_bar - 30.0)*deg) + 0.24*std::cos(2.0*h_bar*deg)
+		+ 0.32*std::cos((3.0*h_bar + 6.0)*deg) - 0.20*std::cos((4.0*h_bar - 63.0)*deg);
+	const double d_theta = 30.0*std::exp(-((h_bar - 275.0)/25.0)*((h_bar - 275.0)/25.0));
+	const double c_bar_7 = std::pow(c_bar, 7.0);
+	const double rc = 2.0*std::sqrt(c_bar_7/(c_bar_7 + pow25_7));
+	const double sl = 1.0 + 0.015*(l_bar - 50.0)*(l_bar - 50.0)/std::sqrt(20.0 + (l_bar - 50.0)*(l_bar - 50.0));
+	const double sc = 1.0 + 0.045*c_bar;
+	const double sh = 1.0 + 0.015*c_bar*t;
+	const double rt = -std::sin(2.0*d_theta*deg)*rc;
+	return std::sqrt((dl/sl)*(dl/sl) + (dc/sc)*(dc/sc) + (dhh/sh)*(dhh/sh) + rt*(dc/sc)*(dhh/sh));
+}
+
+Image::pixel_type Metrics::heat(double value)
+{
+	const double v = 3.0*std::min(1.0, std::max(0.0, value));
+	const double max = Image::pixel_type::max;
+	return Image::pixel_type(
+			static_cast<Image::pixel_type::value_type>(std::min(1.0, v)*max),
+			static_cast<Image::pixel_type::value_type>(std::min(1.0, std::max(0.0, v - 1.0))*max),
+			static_cast<Image::pixel_type::value_type>(std::min(1.0, std::max(0.0, v - 2.0))*max));
+}
+
+namespace{
+class DeltaEBand{
+public:
+	DeltaEBand(const Image& reference, const Image& image, std::vector<double>& sums, const ImageView& map, double range):
+		reference_(reference), image_(image), sums_(sums), map_(map), range_(range){}
+	void operator()(std::size_t begin, std::size_t end)const
+	{
+		for(row_t h = static_cast<row_t>(begin); h < end; ++h){
+			const ConstRow a = reference_[h];
+			const ConstRow b = image_[h];
+			double sum = 0.0;
+			for(column_t w = 0; w < reference_.width(); ++w){
+				const bool same = a[w].R() == b[w].R() && a[w].G() == b[w].G() && a[w].B() == b[w].B();
+				const double delta = same ? 0.0 : Metrics::ciede2000(Metrics::lab(a[w]), Metrics::lab(b[w]));
+				sum += delta;
+				if(map_.width()){
+					map_[h][w] = Metrics::heat(delta/range_);
+				}
+			}
+			sums_[h] = sum;
+		}
+	}
+private:
+	const Image& reference_;
+	const Image& image_;
+	std::vector<double>& sums_;
+	const ImageView map_;
+	double range_;
+};
+}
+
+double Metrics::delta_e(Image* map, double range)const
+{
+	if(range <= 0.0){
+		throw std::invalid_argument(__func__ + std::string(": can not draw delta E map. range must be positive."));
+	}
+	std::vector<double> sums(image_.height());
+	Image heatmap(map ? image_.width() : 0, map ? image_.height() : 0);
+	parallel_for(0, image_.height(), DeltaEBand(reference_, image_, sums, heatmap.view(), range));
+	if(map){
+		map->swap(heatmap);
+	}
+	double total = 0.0;
+	for(std::size_t i = 0; i < sums.size(); ++i){
+		total += sums[i];
+	}
+	return total/std::max(1.0, static_cast<double>(image_.width())*image_.height());
+}
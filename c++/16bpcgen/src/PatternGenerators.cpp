@@ -9,97 +9,214 @@
 #include <fstream>
 #include <iostream>
 #include <sstream>
+#include <stdexcept>
+#include <string>
 #include <vector>
 #include "Image.hpp"
 #include "PatternGenerators.hpp"
 #include "Painter.hpp"
 
-Image& ColorBar::generate(Image& image)const
+namespace{
+/**
+ * canvas_width x canvas_height のキャンバスのうち、(x, y)からimageの大きさだけの部分を描く。
+ * rowsで選んだ帯の先頭行にfill/gradateで描き、replicateで帯の残りの行へ複写する。
+ */
+class Canvas{
+public:
+	Canvas(const ImageView& image, column_t x, row_t y, column_t a_width, row_t a_height):
+		image_(image), x_(x), y_(y), width_(a_width), height_(a_height), first_(0), last_(0){}
+	const column_t& width()const{return width_;}
+	const row_t& height()const{return height_;}
+	column_t left()const{return x_;}
+	column_t right()const{return x_ + image_.width();}
+	row_t top()const{return y_;}
+	row_t bottom()const{return y_ + image_.height();}
+	bool rows(row_t first, row_t last)
+	{
+		if(last <= first || last <= top() || bottom() <= first){
+			return false;
+		}
+		first_ = std::max(first, top()) - y_;
+		last_  = std::min(last, bottom()) - y_;
+		return true;
+	}
+	void fill(column_t first, column_t last, const Image::pixel_type& pixel)const
+	{
+		const column_t begin = clip(first);
+		const column_t end   = clip(last);
+		if(begin < end){
+			std::fill(&image_[first_][begin], &image_[first_][end], pixel);
+		}
+	}
+	void gradate(column_t first, column_t last, const Image::pixel_type& step, const Image::pixel_type& initial = black)const
+	{
+		const column_t begin = clip(first);
+		const column_t end   = clip(last);
+		if(begin < end){
+			const Image::pixel_type::value_type skipped = static_cast<Image::pixel_type::value_type>(x_ + begin - first);
+			std::generate(&image_[first_][begin], &image_[first_][end], Gradator(step, initial + step*skipped));
+		}
+	}
+	void replicate()const{Row::fill(image_[first_ + 1], image_[last_], image_[first_]);}
+	void fill_column(column_t column, const Image::pixel_type& pixel)const
+	{
+		if(left() <= column && column < right()){
+			for(row_t row = 0; row < image_.height(); ++row){
+				image_[row][column - x_] = pixel;
+			}
+		}
+	}
+	void plot(row_t row, column_t column, const Image::pixel_type& pixel)const
+	{
+		if(top() <= row && row < bottom() && left() <= column && column < right()){
+			image_[row - y_][column - x_] = pixel;
+		}
+	}
+private:
+	column_t clip(column_t column)const{return std::min(std::max(column, left()), right()) - x_;}
+	const ImageView& image_;
+	const column_t x_;
+	const row_t y_;
+	const column_t width_;
+	const row_t height_;
+	row_t first_;
+	row_t last_;
+};
+
+void checker_row(const Canvas& canvas, const Image::pixel_type& pattern1, const Image::pixel_type& pattern2)
 {
-	const column_t width = image.width();
-	const row_t   height = image.height();
+	const column_t width = canvas.width();
+	canvas.fill(0,         width/4,   pattern1);
+	canvas.fill(width/4,   width/4*2, pattern2);
+	canvas.fill(width/4*2, width/4*3, pattern1);
+	canvas.fill(width/4*3, width,     pattern2);
+	canvas.replicate();
+}
+}
+
+ImageView PatternGenerator::generate_tile(const ImageView& image, column_t left, row_t top, column_t canvas_width, row_t canvas_height)const
+{
+	if(left || top || image.width() != canvas_width || image.height() != canvas_height){
+		throw std::invalid_argument(__func__ + std::string(": can not generate a part of the canvas with this pattern."));
+	}
+	return generate(image);
+}
+
+ImageView ColorBar::generate(const ImageView& image)const{return generate_tile(image, 0, 0, image.width(), image.height());}
+
+ImageView ColorBar::generate_tile(const ImageView& image, column_t left, row_t top, column_t canvas_width, row_t canvas_height)const
+{
+	Canvas canvas(image, left, top, canvas_width, canvas_height);
+	const column_t width = canvas.width();
+	const row_t   height = canvas.height();
 	const column_t x = width*3/4;
-	std::fill(&image[0][0],               &image[0][width/8],         white  /100*40);
-	std::fill(&image[0][width/8],         &image[0][width/8 + x/7],   white  /100*75);
-	std::fill(&image[0][width/8 + x/7],   &image[0][width/8 + x/7*2], yellow /100*75);
-	std::fill(&image[0][width/8 + x/7*2], &image[0][width/8 + x/7*3], cyan   /100*75);
-	std::fill(&image[0][width/8 + x/7*3], &image[0][width/8 + x/7*4], green  /100*75);
-	std::fill(&image[0][width/8 + x/7*4], &image[0][width/8 + x/7*5], magenta/100*75);
-	std::fill(&image[0][width/8 + x/7*5], &image[0][width/8 + x/7*6], red    /100*75);
-	std::fill(&image[0][width/8 + x/7*6], &image[0][width/8 + x],     blue   /100*75);
-	std::fill(&image[0][width/8 + x],     &image[0][width],           white  /100*40);
 	const row_t h1 = height*7/12;
-	Row::fill(image[1], image[h1], image[0]);
+	if(canvas.rows(0, h1)){
+		canvas.fill(0,               width/8,         white  /100*40);
+		canvas.fill(width/8,         width/8 + x/7,   white  /100*75);
+		canvas.fill(width/8 + x/7,   width/8 + x/7*2, yellow /100*75);
+		canvas.fill(width/8 + x/7*2, width/8 + x/7*3, cyan   /100*75);
+		canvas.fill(width/8 + x/7*3, width/8 + x/7*4, green  /100*75);
+		canvas.fill(width/8 + x/7*4, width/8 + x/7*5, magenta/100*75);
+		canvas.fill(width/8 + x/7*5, width/8 + x/7*6, red    /100*75);
+		canvas.fill(width/8 + x/7*6, width/8 + x,     blue   /100*75);
+		canvas.fill(width/8 + x,     width,           white  /100*40);
+		canvas.replicate();
+	}
 
-	std::fill(&image[h1][0],             &image[h1][width/8],       cyan);
-	std::fill(&image[h1][width/8],       &image[h1][width/8 + x/7], white);
-	std::fill(&image[h1][width/8 + x/7], &image[h1][width/8 + x],   white/100*75);
-	std::fill(&image[h1][width/8 + x],   &image[h1][width],         blue);
 	const row_t h2 = h1 + height/12;
-	Row::fill(image[h1 + 1], image[h2], image[h1]);
+	if(canvas.rows(h1, h2)){
+		canvas.fill(0,             width/8,       cyan);
+		canvas.fill(width/8,       width/8 + x/7, white);
+		canvas.fill(width/8 + x/7, width/8 + x,   white/100*75);
+		canvas.fill(width/8 + x,   width,         blue);
+		canvas.replicate();
+	}
 
-	std::fill(&image[h2][0],           &image[h2][width/8], yellow);
-	std::fill(&image[h2][width/8 + x], &image[h2][width],   red);
-	std::generate(&image[h2][width/8], &image[h2][width/8 + x], Gradator(white/static_cast<Image::pixel_type::value_type>(x)));
 	const row_t h3 = h2 + height/12;
-	Row::fill(image[h2 + 1], image[h3], image[h2]);
+	if(canvas.rows(h2, h3)){
+		canvas.fill(0,           width/8, yellow);
+		canvas.fill(width/8 + x, width,   red);
+		canvas.gradate(width/8, width/8 + x, white/static_cast<Image::pixel_type::value_type>(x));
+		canvas.replicate();
+	}
 
-	std::fill(&image[h3][0],                         &image[h3][width/8],                   white/100*15);
-	std::fill(&image[h3][width/8],                   &image[h3][width/8 + x/7*3/2],         black);
-	std::fill(&image[h3][width/8 + x/7*3/2],         &image[h3][width/8 + x/7*3/2 + 2*x/7], white);
-	std::fill(&image[h3][width/8 + x/7*3/2 + 2*x/7], &image[h3][width/8 + x],               black);
-	std::fill(&image[h3][width/8 + x],               &image[h3][width],                     white/100*15);
-	Row::fill(image[h3 + 1], image[height], image[h3]);
+	if(canvas.rows(h3, height)){
+		canvas.fill(0,                         width/8,                   white/100*15);
+		canvas.fill(width/8,                   width/8 + x/7*3/2,         black);
+		canvas.fill(width/8 + x/7*3/2,         width/8 + x/7*3/2 + 2*x/7, white);
+		canvas.fill(width/8 + x/7*3/2 + 2*x/7, width/8 + x,               black);
+		canvas.fill(width/8 + x,               width,                     white/100*15);
+		canvas.replicate();
+	}
+	return image;
+}
+
+ImageView Luster::generate(const ImageView& image)const{return generate_tile(image, 0, 0, image.width(), image.height());}
+
+ImageView Luster::generate_tile(const ImageView& image, column_t left, row_t top, column_t canvas_width, row_t canvas_height)const
+{
+	Canvas canvas(image, left, top, canvas_width, canvas_height);
+	if(canvas.rows(0, canvas.height())){
+		canvas.fill(0, canvas.width(), pixel_);
+		canvas.replicate();
+	}
 	return image;
 }
 
-Image& Luster::generate(Image& image)const{std::fill(&image[0][0], &image[image.height()][0], pixel_); return image;}
+ImageView Checker::generate(const ImageView& image)const{return generate_tile(image, 0, 0, image.width(), image.height());}
 
-Image& Checker::generate(Image& image)const
+ImageView Checker::generate_tile(const ImageView& image, column_t left, row_t top, column_t canvas_width, row_t canvas_height)const
 {
 	const Image::pixel_type pattern1 = invert_ ? black : white;
 	const Image::pixel_type pattern2 = invert_ ? white : black;
-	const column_t width = image.width();
-	const row_t   height = image.height();
-	std::fill(&image[0][0],         &image[0][width/4],   pattern1);
-	std::fill(&image[0][width/4],   &image[0][width/4*2], pattern2);
-	std::fill(&image[0][width/4*2], &image[0][width/4*3], pattern1);
-	std::fill(&image[0][width/4*3], &image[0][width],     pattern2);
-	Row::fill(image[1],          image[height/4],   image[0]);
-	Row::fill(image[height/4*2], image[height/4*3], image[0]);
-
-	std::fill(&image[height/4][0],         &image[height/4][width/4],   pattern2);
-	std::fill(&image[height/4][width/4],   &image[height/4][width/4*2], pattern1);
-	std::fill(&image[height/4][width/4*2], &image[height/4][width/4*3], pattern2);
-	std::fill(&image[height/4][width/4*3], &image[height/4][width],     pattern1);
-	Row::fill(image[height/4+1], image[height/4*2], image[height/4]);
-	Row::fill(image[height/4*3], image[height],     image[height/4]);
+	Canvas canvas(image, left, top, canvas_width, canvas_height);
+	const row_t height = canvas.height();
+	if(canvas.rows(0, height/4)){
+		checker_row(canvas, pattern1, pattern2);
+	}
+	if(canvas.rows(height/4, height/4*2)){
+		checker_row(canvas, pattern2, pattern1);
+	}
+	if(canvas.rows(height/4*2, height/4*3)){
+		checker_row(canvas, pattern1, pattern2);
+	}
+	if(canvas.rows(height/4*3, height)){
+		checker_row(canvas, pattern2, pattern1);
+	}
 	return image;
 }
 
-Image& StairStepH::generate(Image& image)const
+ImageView StairStepH::generate(const ImageView& image)const{return generate_tile(image, 0, 0, image.width(), image.height());}
+
+ImageView StairStepH::generate_tile(const ImageView& image, column_t left, row_t top, column_t canvas_width, row_t canvas_height)const
 {
-	const column_t width = image.width();
-	const row_t   height = image.height();
+	Canvas canvas(image, left, top, canvas_width, canvas_height);
+	const column_t width = canvas.width();
+	const row_t   height = canvas.height();
 	const row_t  stair_height = height/stairs_;
 	const column_t step_width = width/steps_ + (width%steps_ ? 1 : 0);
 	bool invert = invert_;
 	for(row_t row = 0; row < height; row += stair_height){
-		Gradator gradator(white/steps_, invert ? white : black, invert);
-		for(column_t column = 0; column < width; column += step_width){
-			std::fill(&image[row][column], &image[row][std::min(width, column + step_width)],
-					gradator());
+		if(canvas.rows(row, std::min(height, row + stair_height))){
+			Gradator gradator(white/steps_, invert ? white : black, invert);
+			for(column_t column = 0; column < width; column += step_width){
+				canvas.fill(column, std::min(width, column + step_width), gradator());
+			}
+			canvas.replicate();
 		}
-		Row::fill(image[row + 1], image[std::min(height, row + stair_height)], image[row]);
 		invert = !invert;
 	}
 	return image;
 }
 
-Image& StairStepV::generate(Image& image)const
+ImageView StairStepV::generate(const ImageView& image)const{return generate_tile(image, 0, 0, image.width(), image.height());}
+
+ImageView StairStepV::generate_tile(const ImageView& image, column_t left, row_t top, column_t canvas_width, row_t canvas_height)const
 {
-	const column_t width = image.width();
-	const row_t   height = image.height();
+	Canvas canvas(image, left, top, canvas_width, canvas_height);
+	const column_t width = canvas.width();
+	const row_t   height = canvas.height();
 	const column_t stair_width = width/stairs_;
 	const row_t    step_height = height/steps_ + (height%steps_ ? 1 : 0);
 	bool invert = invert_;
@@ -109,73 +226,71 @@ Image& StairStepV::generate(Image& image)const
 		invert = !invert;
 	}
 	for(row_t row = 0; row < height; row += step_height){
+		const bool visible = canvas.rows(row, std::min(height, row + step_height));
 		for(column_t column = 0; column < width; column += stair_width){
-			std::fill(&image[row][column], &image[row][std::min(width, column + stair_width)],
-					gradators.at(column/stair_width)());
+			const Image::pixel_type pixel = gradators.at(column/stair_width)();
+			if(visible){
+				canvas.fill(column, std::min(width, column + stair_width), pixel);
+			}
+		}
+		if(visible){
+			canvas.replicate();
 		}
-		Row::fill(image[row + 1], image[std::min(height, row + step_height)], image[row]);
 	}
 	return image;
 }
 
-Image& Ramp::generate(Image& image)const
+ImageView Ramp::generate(const ImageView& image)const{return generate_tile(image, 0, 0, image.width(), image.height());}
+
+ImageView Ramp::generate_tile(const ImageView& image, column_t left, row_t top, column_t canvas_width, row_t canvas_height)const
 {
-	const column_t width = image.width();
-	const row_t   height = image.height();
+	Canvas canvas(image, left, top, canvas_width, canvas_height);
+	const column_t width = canvas.width();
+	const row_t   height = canvas.height();
 	if(Image::pixel_type::max < width){
 		throw std::runtime_error(": too large image width.");
 	}
 	const Image::pixel_type::value_type w = static_cast<Image::pixel_type::value_type>(width);
-	std::generate(&image[0][0],            &image[0][width],            Gradator(red    /w));
-	std::generate(&image[height/12][0],    &image[height/12][width],    Gradator(green  /w));
-	std::generate(&image[height/12*2][0],  &image[height/12*2][width],  Gradator(blue   /w));
-	std::generate(&image[height/12*3][0],  &image[height/12*3][width],  Gradator(cyan   /w));
-	std::generate(&image[height/12*4][0],  &image[height/12*4][width],  Gradator(magenta/w));
-	std::generate(&image[height/12*5][0],  &image[height/12*5][width],  Gradator(yellow /w));
-	std::generate(&image[height/12*6][0],  &image[height/12*6][width],  Gradator(cyan   /w, red));
-	std::generate(&image[height/12*7][0],  &image[height/12*7][width],  Gradator(magenta/w, green));
-	std::generate(&image[height/12*8][0],  &image[height/12*8][width],  Gradator(yellow /w, blue));
-	std::generate(&image[height/12*9][0],  &image[height/12*9][width],  Gradator(red    /w, cyan));
-	std::generate(&image[height/12*10][0], &image[height/12*10][width], Gradator(green  /w, magenta));
-	std::generate(&image[height/12*11][0], &image[height/12*11][width], Gradator(blue   /w, yellow));
-
-	Row::fill(image[1],                image[height/12],    image[0]);
-	Row::fill(image[height/12    + 1], image[height/12*2],  image[height/12]);
-	Row::fill(image[height/12*2  + 1], image[height/12*3],  image[height/12*2]);
-	Row::fill(image[height/12*3  + 1], image[height/12*4],  image[height/12*3]);
-	Row::fill(image[height/12*4  + 1], image[height/12*5],  image[height/12*4]);
-	Row::fill(image[height/12*5  + 1], image[height/12*6],  image[height/12*5]);
-	Row::fill(image[height/12*6  + 1], image[height/12*7],  image[height/12*6]);
-	Row::fill(image[height/12*7  + 1], image[height/12*8],  image[height/12*7]);
-	Row::fill(image[height/12*8  + 1], image[height/12*9],  image[height/12*8]);
-	Row::fill(image[height/12*9  + 1], image[height/12*10], image[height/12*9]);
-	Row::fill(image[height/12*10 + 1], image[height/12*11], image[height/12*10]);
-	Row::fill(image[height/12*11 + 1], image[height],       image[height/12*11]);
+	const Image::pixel_type steps[] = {
+		red/w, green/w, blue/w, cyan/w, magenta/w, yellow/w,
+		cyan/w, magenta/w, yellow/w, red/w, green/w, blue/w};
+	const Image::pixel_type initials[] = {
+		black, black, black, black, black, black,
+		red, green, blue, cyan, magenta, yellow};
+	const row_t bands = sizeof(steps)/sizeof(steps[0]);
+	for(row_t i = 0; i < bands; ++i){
+		if(canvas.rows(height/bands*i, i + 1 < bands ? height/bands*(i + 1) : height)){
+			canvas.gradate(0, width, steps[i], initials[i]);
+			canvas.replicate();
+		}
+	}
 	return image;
 }
 
-Image& CrossHatch::generate(Image& image)const
+ImageView CrossHatch::generate(const ImageView& image)const{return generate_tile(image, 0, 0, image.width(), image.height());}
+
+ImageView CrossHatch::generate_tile(const ImageView& image, column_t left, row_t top, column_t canvas_width, row_t canvas_height)const
 {
-	const column_t width = image.width();
-	const row_t   height = image.height();
-	for(row_t i = 0; i < height; i += lattice_height_){
-		std::fill(&image[i][0], &image[i][width], pixel_);
+	Canvas canvas(image, left, top, canvas_width, canvas_height);
+	const column_t width = canvas.width();
+	const row_t   height = canvas.height();
+	for(row_t i = canvas.top(); i < canvas.bottom(); ++i){
+		if(i%lattice_height_ == 0 || i == height - 1){
+			canvas.rows(i, i + 1);
+			canvas.fill(0, width, pixel_);
+		}
 	}
-	std::fill(&image[height - 1][0], &image[height][0], pixel_);
 
-	for(column_t i = 0; i < width; i += lattice_width_){
-		for(row_t j = 0; j < height; ++j){
-			image[j][i] = pixel_;
+	for(column_t i = canvas.left(); i < canvas.right(); ++i){
+		if(i%lattice_width_ == 0 || i == width - 1){
+			canvas.fill_column(i, pixel_);
 		}
 	}
-	for(row_t i = 0; i < height; ++i){
-		image[i][width - 1] = pixel_;
-	}
 
 	const double slope = static_cast<double>(height)/width;
-	for(column_t i = 0; i < width; ++i){
-		image[std::min(height - 1, static_cast<row_t>(         slope*i))][i] = pixel_;
-		image[std::min(height - 1, static_cast<row_t>(height - slope*i))][i] = pixel_;
+	for(column_t i = canvas.left(); i < canvas.right(); ++i){
+		canvas.plot(std::min(height - 1, static_cast<row_t>(         slope*i)), i, pixel_);
+		canvas.plot(std::min(height - 1, static_cast<row_t>(height - slope*i)), i, pixel_);
 	}
 
 	const row_t radius     = height/2;
@@ -184,13 +299,13 @@ Image& CrossHatch::generate(Image& image)const
 	for(double theta = 0; theta < 2.0*M_PI; theta += 2.0*M_PI/5000.0){
 		row_t    row    = std::min(height - 1, static_cast<row_t>   (shift_v + radius*std::sin(theta)));
 		column_t column = std::min(width  - 1, static_cast<column_t>(shift_h + radius*std::cos(theta)));
-		image[row][column] = pixel_;
+		canvas.plot(row, column, pixel_);
 	}
 	return image;
 }
 
 #if 201103L <= __cplusplus
-Image& WhiteNoise::generate(Image& image)const
+ImageView WhiteNoise::generate(const ImageView& image)const
 {
 	RandomColor random_color;
 	for(row_t row = 0; row < image.height(); ++row){
@@ -1372,9 +1487,9 @@ const byte_t characters[][8] = {
 	},
 };
 
-Image& Character::generate(Image& image)const{write(image, row_, column_, text_, pixel_, scale_); return image;}
+ImageView Character::generate(const ImageView& image)const{write(image, row_, column_, text_, pixel_, scale_); return image;}
 
-void Character::write(Image& image, row_t row, column_t column,
+void Character::write(const ImageView& image, row_t row, column_t column,
 		unsigned char c, const Image::pixel_type& pixel, byte_t scale)const
 {
 	if('~' < c || image.height() <= row || image.width() <= column){
@@ -1398,7 +1513,7 @@ void Character::write(Image& image, row_t row, column_t column,
 	}
 }
 
-void Character::write(Image& image, row_t row, column_t column,
+void Character::write(const ImageView& image, row_t row, column_t column,
 		const std::string& str, const Image::pixel_type& pixel, byte_t scale)const
 {
 	for(std::string::size_type i = 0, j = 0; i < str.size(); ++i){
@@ -1435,9 +1550,9 @@ TypeWriter::TypeWriter(const std::string& textfilename, const Image::pixel_type&
 	height_ *= char_height;
 }
 
-Image& TypeWriter::generate(Image& image)const{return image <<= Character(text_, pixel_);}
+ImageView TypeWriter::generate(const ImageView& image)const{return Character(text_, pixel_).generate(image);}
 
-Image& Line::generate(Image& image)const
+ImageView Line::generate(const ImageView& image)const
 {
 	if(image.width() <= from_col_ || image.width() <= to_col_ || image.height() <= from_row_ || image.height() <= to_row_){
 		std::ostringstream oss;
@@ -1464,7 +1579,7 @@ Image& Line::generate(Image& image)const
 	return image;
 }
 
-Image& Circle::generate(Image& image)const
+ImageView Circle::generate(const ImageView& image)const
 {
 	if(image.width() <= column_ || image.height() <= row_){
 		std::ostringstream oss;
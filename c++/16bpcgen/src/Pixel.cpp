@@ -6,6 +6,8 @@ template<>
 const Pixel<uint16_t>::value_type Pixel<uint16_t>::max = 0xffffu;
 template<>
 const Pixel<double>::value_type Pixel<double>::max = 0xffffu;
+template<>
+const Pixel<float>::value_type Pixel<float>::max = 1.0f;
 
 const Pixel<> black  (0x0,          0x0,          0x0);
 const Pixel<> white  (Pixel<>::max, Pixel<>::max, Pixel<>::max);
@@ -1,7 +1,30 @@
+#include <algorithm>
 #include <stdexcept>
+#include "BitKernels.hpp"
 #include "Image.hpp"
 #include "PixelConverters.hpp"
 
+namespace{
+typedef Image::pixel_type::value_type value_type;
+
+value_type* samples(Image::pixel_type* pixel){return reinterpret_cast<value_type*>(pixel);}
+
+std::size_t sample_count(const Image::pixel_type* first, const Image::pixel_type* last)
+{
+	return static_cast<std::size_t>(last - first)*3;
+}
+
+/**
+ * BitKernelsに渡す3レーン周期の値。chで選ばれたチャンネルはselected、それ以外はotherとする。
+ */
+void lanes(value_type* lane, Channel::Ch ch, value_type selected, value_type other)
+{
+	for(int i = 0; i < 3; ++i){
+		lane[i] = ch & (1 << i) ? selected : other;
+	}
+}
+}
+
 Image::pixel_type& Channel::convert(Image::pixel_type& pixel)const
 {
 	if(!(ch_ & R)){
@@ -16,6 +39,21 @@ Image::pixel_type& Channel::convert(Image::pixel_type& pixel)const
 	return pixel;
 }
 
+/**
+ * マスクのカーネルはChannel自身の変換にだけ使う。以下の各変換のconvert_rowとconvert_planeも同様に、
+ * uses_kernel_ofで動的型を確かめてから専用の処理を行う。
+ */
+void Channel::convert_row(Image::pixel_type* first, Image::pixel_type* last)const
+{
+	if(!uses_kernel_of<Channel>()){
+		convert_each(first, last);
+		return;
+	}
+	value_type mask[3];
+	lanes(mask, ch_, Image::pixel_type::max, 0);
+	BitKernels::mask_and(samples(first), mask, sample_count(first, last));
+}
+
 Image::pixel_type& GrayScale::convert(Image::pixel_type& pixel)const
 {
 	const int coefficient = 1024;
@@ -27,6 +65,24 @@ Image::pixel_type& GrayScale::convert(Image::pixel_type& pixel)const
 	return pixel = Image::pixel_type(Y, Y, Y);
 }
 
+void GrayScale::convert_row(Image::pixel_type* first, Image::pixel_type* last)const
+{
+	if(!uses_kernel_of<GrayScale>()){
+		convert_each(first, last);
+		return;
+	}
+	const int coefficient = 1024;
+	value_type* const p = samples(first);
+	const std::size_t size = sample_count(first, last);
+	for(std::size_t i = 0; i < size; i += 3){
+		const value_type Y = static_cast<value_type>((
+				0.2126*coefficient*p[i] +
+				0.7152*coefficient*p[i + 1] +
+				0.0722*coefficient*p[i + 2])/coefficient);
+		p[i] = p[i + 1] = p[i + 2] = Y;
+	}
+}
+
 Image::pixel_type& Threshold::convert(Image::pixel_type& pixel)const
 {
 	switch(ch()){
@@ -44,6 +100,37 @@ Image::pixel_type& Threshold::convert(Image::pixel_type& pixel)const
 	}
 }
 
+/**
+ * 判定するチャンネルを先に決め、行内では比較と書き込みだけを行う。
+ */
+void Threshold::convert_row(Image::pixel_type* first, Image::pixel_type* last)const
+{
+	if(!uses_kernel_of<Threshold>()){
+		convert_each(first, last);
+		return;
+	}
+	std::size_t plane = 0;
+	switch(ch()){
+	case R:
+		plane = 0;
+		break;
+	case G:
+		plane = 1;
+		break;
+	case B:
+		plane = 2;
+		break;
+	default:
+		throw std::invalid_argument(__func__ + std::string(": can not apply Threshold process. invalid channelspecification."));
+	}
+	value_type* const p = samples(first);
+	const std::size_t size = sample_count(first, last);
+	for(std::size_t i = 0; i < size; i += 3){
+		const value_type v = p[i + plane] < threshold_ ? 0 : Image::pixel_type::max;
+		p[i] = p[i + 1] = p[i + 2] = v;
+	}
+}
+
 Image::pixel_type& Offset::convert(Image::pixel_type& pixel)const
 {
 
@@ -62,6 +149,41 @@ Image::pixel_type& Offset::convert(Image::pixel_type& pixel)const
 	return pixel;
 }
 
+bool Offset::convert_plane(Image::pixel_type::value_type* first, Image::pixel_type::value_type* last, byte_t plane)const
+{
+	if(!uses_kernel_of<Offset>()){
+		return false;
+	}
+	if(!(ch() & (1 << plane))){
+		return true;
+	}
+	if(invert_){
+		for(; first != last; ++first){
+			*first = static_cast<Image::pixel_type::value_type>(std::max(*first - offset_, 0));
+		}
+	}else{
+		for(; first != last; ++first){
+			*first = static_cast<Image::pixel_type::value_type>(std::min(*first + offset_, static_cast<int>(Image::pixel_type::max)));
+		}
+	}
+	return true;
+}
+
+void Offset::convert_row(Image::pixel_type* first, Image::pixel_type* last)const
+{
+	if(!uses_kernel_of<Offset>()){
+		convert_each(first, last);
+		return;
+	}
+	value_type offset[3];
+	lanes(offset, ch(), offset_, 0);
+	if(invert_){
+		BitKernels::subtract_saturate(samples(first), offset, sample_count(first, last));
+	}else{
+		BitKernels::add_saturate(samples(first), offset, sample_count(first, last));
+	}
+}
+
 Image::pixel_type& Reversal::convert(Image::pixel_type& pixel)const
 {
 	if(ch() & R){
@@ -76,24 +198,112 @@ Image::pixel_type& Reversal::convert(Image::pixel_type& pixel)const
 	return pixel;
 }
 
+bool Reversal::convert_plane(Image::pixel_type::value_type* first, Image::pixel_type::value_type* last, byte_t plane)const
+{
+	if(!uses_kernel_of<Reversal>()){
+		return false;
+	}
+	if(!(ch() & (1 << plane))){
+		return true;
+	}
+	for(; first != last; ++first){
+		*first = static_cast<Image::pixel_type::value_type>(Image::pixel_type::max - *first);
+	}
+	return true;
+}
+
+void Reversal::convert_row(Image::pixel_type* first, Image::pixel_type* last)const
+{
+	if(!uses_kernel_of<Reversal>()){
+		convert_each(first, last);
+		return;
+	}
+	value_type mask[3];
+	lanes(mask, ch(), Image::pixel_type::max, 0);
+	BitKernels::mask_xor(samples(first), mask, sample_count(first, last));
+}
+
 Gamma::Gamma(const std::vector<Image::pixel_type::value_type>& lut, Ch c):
-	Channel(c), lut_(lut)
+	Channel(c), lut_(lut), table_(NULL)
 {
 	if(lut_.size() != static_cast<std::size_t>(Image::pixel_type::max + 1u)){
 		throw std::invalid_argument(__func__ + std::string(": can not apply Gamma process. too short lut."));
 	}
+	table_ = &lut_[0];
+}
+
+/**
+ * TransferFunctionが保持する共有の表を参照するので、表の生成も複製も初回以外は起きない。
+ * TF_POWERの共有の表は捨てられることがあるので、指数そのままの表を自前で持つ。
+ */
+Gamma::Gamma(TransferFunction::Curve curve, TransferFunction::Direction direction, Ch c, double exponent):
+	Channel(c), lut_(), table_(NULL)
+{
+	if(curve == TransferFunction::TF_POWER){
+		lut_ = TransferFunction::build(curve, direction, exponent);
+		table_ = &lut_[0];
+	}else{
+		table_ = &TransferFunction::instance().table(curve, direction, exponent)[0];
+	}
+}
+
+Gamma::Gamma(const Gamma& gamma):
+	Channel(gamma), lut_(gamma.lut_), table_(lut_.empty() ? gamma.table_ : &lut_[0])
+{
 }
 
 Image::pixel_type& Gamma::convert(Image::pixel_type& pixel)const
 {
 	if(ch() & R){
-		pixel.R(lut_[pixel.R()]);
+		pixel.R(table_[pixel.R()]);
 	}
 	if(ch() & G){
-		pixel.G(lut_[pixel.G()]);
+		pixel.G(table_[pixel.G()]);
 	}
 	if(ch() & B){
-		pixel.G(lut_[pixel.B()]);
+		pixel.B(table_[pixel.B()]);
 	}
 	return pixel;
 }
+
+bool Gamma::convert_plane(Image::pixel_type::value_type* first, Image::pixel_type::value_type* last, byte_t plane)const
+{
+	if(!uses_kernel_of<Gamma>()){
+		return false;
+	}
+	if(!(ch() & (1 << plane))){
+		return true;
+	}
+	const Image::pixel_type::value_type* const lut = table_;
+	for(; first != last; ++first){
+		*first = lut[*first];
+	}
+	return true;
+}
+
+/**
+ * 表引きはベクタ化できないので、全チャンネルが対象なら行全体を1本のループで引く。
+ */
+void Gamma::convert_row(Image::pixel_type* first, Image::pixel_type* last)const
+{
+	if(!uses_kernel_of<Gamma>()){
+		convert_each(first, last);
+		return;
+	}
+	const value_type* const lut = table_;
+	value_type* const p = samples(first);
+	const std::size_t size = sample_count(first, last);
+	if(ch() == (R | G | B)){
+		for(std::size_t i = 0; i < size; ++i){
+			p[i] = lut[p[i]];
+		}
+		return;
+	}
+	for(std::size_t plane = 0; plane < 3; ++plane){
+		if(ch() & (1 << plane)){
+			for(std::size_t i = plane; i < size; i += 3){
+				p[i] = lut[p[i]];
+			}
+		}
+	}
+}
@@ -0,0 +1,105 @@
+#include "PixelConverter.hpp"
+#include "PlanarImage.hpp"
+
+PlanarImage PlanarImage::operator>>(const PixelConverter& converter)const
+{
+	PlanarImage result = PlanarImage(*this);
+	result >>= converter;
+	return result;
+}
+
+PlanarImage& PlanarImage::operator>>=(const PixelConverter& converter)
+{
+	const std::size_t size = plane_size();
+	value_type* const r = plane(PLANE_R);
+	value_type* const g = plane(PLANE_G);
+	value_type* const b = plane(PLANE_B);
+	if(converter.convert_plane(r, r + size, PLANE_R)){
+		converter.convert_plane(g, g + size, PLANE_G);
+		converter.convert_plane(b, b + size, PLANE_B);
+		return *this;
+	}
+	for(std::size_t i = 0; i < size; ++i){
+		pixel_type pixel(r[i], g[i], b[i]);
+		converter.convert(pixel);
+		r[i] = pixel.R();
+		g[i] = pixel.G();
+		b[i] = pixel.B();
+	}
+	return *this;
+}
+
+PlanarImage& PlanarImage::read(const std::string& filename)
+{
+	return deinterleave(Image(filename));
+}
+
+const PlanarImage& PlanarImage::write(const std::string& filename, Image::FileFormat fmt)const
+{
+	image().write(filename, fmt);
+	return *this;
+}
+
+PlanarImage& PlanarImage::deinterleave(const Image& image)
+{
+	width_  = image.width();
+	height_ = image.height();
+	planes_.resize(3*plane_size());
+	value_type* const r = plane(PLANE_R);
+	value_type* const g = plane(PLANE_G);
+	value_type* const b = plane(PLANE_B);
+	const std::size_t width = width_;
+	for(row_t h = 0; h < height_; ++h){
+		const value_type* const src = reinterpret_cast<const value_type*>(&image[h][0]);
+		const std::size_t offset = h*width;
+		for(std::size_t w = 0; w < width; ++w){
+			r[offset + w] = src[w*3    ];
+			g[offset + w] = src[w*3 + 1];
+			b[offset + w] = src[w*3 + 2];
+		}
+	}
+	return *this;
+}
+
+Image& PlanarImage::interleave(Image& image)const
+{
+	if(image.width() != width_ || image.height() != height_){
+		Image result(width_, height_);
+		image.swap(result);
+	}
+	const value_type* const r = plane(PLANE_R);
+	const value_type* const g = plane(PLANE_G);
+	const value_type* const b = plane(PLANE_B);
+	const std::size_t width = width_;
+	for(row_t h = 0; h < height_; ++h){
+		value_type* const dst = reinterpret_cast<value_type*>(&image[h][0]);
+		const std::size_t offset = h*width;
+		for(std::size_t w = 0; w < width; ++w){
+			dst[w*3    ] = r[offset + w];
+			dst[w*3 + 1] = g[offset + w];
+			dst[w*3 + 2] = b[offset + w];
+		}
+	}
+	return image;
+}
+
+Image PlanarImage::image()const
+{
+	Image result(width_, height_);
+	interleave(result);
+	return result;
+}
+
+PlanarImage::pixel_type PlanarImage::pixel(row_t row, column_t column)const
+{
+	const std::size_t i = static_cast<std::size_t>(row)*width_ + column;
+	return pixel_type(plane(PLANE_R)[i], plane(PLANE_G)[i], plane(PLANE_B)[i]);
+}
+
+void PlanarImage::pixel(row_t row, column_t column, const pixel_type& pixel)
+{
+	const std::size_t i = static_cast<std::size_t>(row)*width_ + column;
+	plane(PLANE_R)[i] = pixel.R();
+	plane(PLANE_G)[i] = pixel.G();
+	plane(PLANE_B)[i] = pixel.B();
+}
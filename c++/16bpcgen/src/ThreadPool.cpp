@@ -0,0 +1,252 @@
+#include <algorithm>
+#include <cstdlib>
+#include <exception>
+#include <new>
+#include <stdexcept>
+#include <unistd.h>
+#include "ThreadPool.hpp"
+
+ThreadPool& ThreadPool::instance()
+{
+	static ThreadPool pool(default_threads());
+	return pool;
+}
+
+std::size_t ThreadPool::default_threads()
+{
+	const char* const env = std::getenv("BPCGEN_THREADS");
+	if(env && 0 < std::atoi(env)){
+		return static_cast<std::size_t>(std::atoi(env));
+	}
+#ifdef _SC_NPROCESSORS_ONLN
+	const long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	return 0 < cores ? static_cast<std::size_t>(cores) : 1;
+#else
+	return 1;
+#endif
+}
+
+ThreadPool::ThreadPool(std::size_t threads):
+	job_(), mutex_(), wake_(), done_(), in_task_(), workers_(), task_(NULL),
+	next_(0), end_(0), grain_(1), active_(0), generation_(0), quit_(false), error_()
+{
+	pthread_mutex_init(&job_, NULL);
+	pthread_mutex_init(&mutex_, NULL);
+	pthread_cond_init(&wake_, NULL);
+	pthread_cond_init(&done_, NULL);
+	pthread_key_create(&in_task_, NULL);
+	start(threads);
+}
+
+ThreadPool::~ThreadPool()
+{
+	stop();
+	pthread_key_delete(in_task_);
+	pthread_cond_destroy(&done_);
+	pthread_cond_destroy(&wake_);
+	pthread_mutex_destroy(&mutex_);
+	pthread_mutex_destroy(&job_);
+}
+
+/**
+ * 範囲[begin, end)をgrain行ずつの帯に分け、呼び出し元スレッドとワーカーで分担して処理する。
+ * 帯は早く手の空いたスレッドから順に取っていくので、重い帯があっても負荷が偏らない。
+ * ワーカー内から呼ばれた場合など、プールが使用中のときはその場で逐次処理する。
+ * タスクが投げた標準例外はスレッド数によらず同じ型で呼び出し元へ投げ直す。
+ */
+void ThreadPool::run(std::size_t begin, std::size_t end, const Task& task, std::size_t grain)
+{
+	if(end <= begin){
+		return;
+	}
+	if(!grain){
+		grain = std::max<std::size_t>(1, (end - begin)/(threads()*4));
+	}
+	if(workers_.empty() || end - begin <= grain || pthread_mutex_trylock(&job_)){
+		execute(task, begin, end);
+		return;
+	}
+	pthread_mutex_lock(&mutex_);
+	task_  = &task;
+	next_  = begin;
+	end_   = end;
+	grain_ = grain;
+	error_ = Error();
+	++generation_;
+	pthread_cond_broadcast(&wake_);
+	drain();
+	while(active_){
+		pthread_cond_wait(&done_, &mutex_);
+	}
+	task_ = NULL;
+	const Error error = error_;
+	pthread_mutex_unlock(&mutex_);
+	pthread_mutex_unlock(&job_);
+	error.raise();
+}
+
+/**
+ * タスクの中から呼ぶと、実行中のジョブが終わるのを自分で待つことになり止まってしまうので拒否する。
+ */
+void ThreadPool::set_threads(std::size_t threads)
+{
+	if(pthread_getspecific(in_task_)){
+		throw std::runtime_error(__func__ + std::string(": can not change the number of threads inside a parallel task."));
+	}
+	pthread_mutex_lock(&job_);
+	stop();
+	start(threads);
+	pthread_mutex_unlock(&job_);
+}
+
+void* ThreadPool::work(void* pool)
+{
+	ThreadPool& self = *static_cast<ThreadPool*>(pool);
+	pthread_mutex_lock(&self.mutex_);
+	std::size_t generation = self.generation_;
+	for(;;){
+		while(!self.quit_ && generation == self.generation_){
+			pthread_cond_wait(&self.wake_, &self.mutex_);
+		}
+		if(self.quit_){
+			break;
+		}
+		generation = self.generation_;
+		self.drain();
+	}
+	pthread_mutex_unlock(&self.mutex_);
+	return NULL;
+}
+
+void ThreadPool::start(std::size_t threads)
+{
+	quit_ = false;
+	for(std::size_t i = 1; i < threads; ++i){
+		pthread_t worker;
+		if(pthread_create(&worker, NULL, work, this)){
+			break;
+		}
+		workers_.push_back(worker);
+	}
+}
+
+void ThreadPool::stop()
+{
+	pthread_mutex_lock(&mutex_);
+	quit_ = true;
+	pthread_cond_broadcast(&wake_);
+	pthread_mutex_unlock(&mutex_);
+	for(std::size_t i = 0; i < workers_.size(); ++i){
+		pthread_join(workers_[i], NULL);
+	}
+	workers_.clear();
+}
+
+void ThreadPool::drain()
+{
+	++active_;
+	while(next_ < end_){
+		const std::size_t begin = next_;
+		const std::size_t end = std::min(end_, begin + grain_);
+		next_ = end;
+		pthread_mutex_unlock(&mutex_);
+		Error error;
+		try{
+			execute(*task_, begin, end);
+		}catch(...){
+			error = Error::current();
+		}
+		pthread_mutex_lock(&mutex_);
+		if(!error.empty()){
+			if(error_.empty()){
+				error_ = error;
+			}
+			next_ = end_;
+		}
+	}
+	if(!--active_){
+		pthread_cond_broadcast(&done_);
+	}
+}
+
+/**
+ * 実行中のスレッドにタスク内であることを記録してから走らせる。
+ */
+void ThreadPool::execute(const Task& task, std::size_t begin, std::size_t end)
+{
+	void* const outer = pthread_getspecific(in_task_);
+	pthread_setspecific(in_task_, this);
+	try{
+		task.run(begin, end);
+	}catch(...){
+		pthread_setspecific(in_task_, outer);
+		throw;
+	}
+	pthread_setspecific(in_task_, outer);
+}
+
+/**
+ * catchブロックの中から呼び、処理中の例外の型とメッセージを記録する。
+ * C++03にはstd::exception_ptrがないので、標準例外の型を一つずつ判別する。
+ */
+ThreadPool::Error ThreadPool::Error::current()
+{
+	try{
+		throw;
+	}catch(const std::invalid_argument& err){
+		return Error(ERR_INVALID_ARGUMENT, err.what());
+	}catch(const std::domain_error& err){
+		return Error(ERR_DOMAIN_ERROR, err.what());
+	}catch(const std::length_error& err){
+		return Error(ERR_LENGTH_ERROR, err.what());
+	}catch(const std::out_of_range& err){
+		return Error(ERR_OUT_OF_RANGE, err.what());
+	}catch(const std::logic_error& err){
+		return Error(ERR_LOGIC_ERROR, err.what());
+	}catch(const std::range_error& err){
+		return Error(ERR_RANGE_ERROR, err.what());
+	}catch(const std::overflow_error& err){
+		return Error(ERR_OVERFLOW_ERROR, err.what());
+	}catch(const std::underflow_error& err){
+		return Error(ERR_UNDERFLOW_ERROR, err.what());
+	}catch(const std::runtime_error& err){
+		return Error(ERR_RUNTIME_ERROR, err.what());
+	}catch(const std::bad_alloc& err){
+		return Error(ERR_BAD_ALLOC, err.what());
+	}catch(const std::exception& err){
+		return Error(ERR_UNKNOWN, err.what());
+	}catch(...){
+		return Error(ERR_UNKNOWN, "ThreadPool: unknown exception in parallel task.");
+	}
+}
+
+void ThreadPool::Error::raise()const
+{
+	switch(type_){
+	case ERR_NONE:
+		return;
+	case ERR_INVALID_ARGUMENT:
+		throw std::invalid_argument(what_);
+	case ERR_DOMAIN_ERROR:
+		throw std::domain_error(what_);
+	case ERR_LENGTH_ERROR:
+		throw std::length_error(what_);
+	case ERR_OUT_OF_RANGE:
+		throw std::out_of_range(what_);
+	case ERR_LOGIC_ERROR:
+		throw std::logic_error(what_);
+	case ERR_RANGE_ERROR:
+		throw std::range_error(what_);
+	case ERR_OVERFLOW_ERROR:
+		throw std::overflow_error(what_);
+	case ERR_UNDERFLOW_ERROR:
+		throw std::underflow_error(what_);
+	case ERR_RUNTIME_ERROR:
+		throw std::runtime_error(what_);
+	case ERR_BAD_ALLOC:
+		throw std::bad_alloc();
+	case ERR_UNKNOWN:
+	default:
+		throw std::runtime_error(what_);
+	}
+}
@@ -0,0 +1,262 @@
+#ifndef _WIN32
+#define _FILE_OFFSET_BITS 64
+#include <sys/types.h>
+#endif
+#include <algorithm>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include "Image.hpp"
+#include "ImageProcesses.hpp"
+#include "PatternGenerator.hpp"
+#include "TiledImage.hpp"
+
+TiledImage::TiledImage(const column_t& a_width, const row_t& a_height, column_t a_tile_size, std::size_t a_cache_size):
+	width_(a_width), height_(a_height), tile_size_(a_tile_size), cache_size_(a_cache_size),
+	cache_(), resident_(), stored_(), scratch_(NULL), spills_(0), loads_(0)
+{
+	if(tile_size_ == 0){
+		throw std::invalid_argument(__func__ + std::string(": can not allocate tiled image. tile size must be more than 0."));
+	}
+	const std::size_t tiles = static_cast<std::size_t>(tiles_x())*tiles_y();
+	cache_size_ = std::max<std::size_t>(cache_size_, tiles_x());
+	resident_.assign(tiles, cache_.end());
+	stored_.assign(tiles, false);
+}
+
+TiledImage::~TiledImage()
+{
+	if(scratch_){
+		std::fclose(scratch_);
+	}
+}
+
+/**
+ * 各タイルにキャンバス上の位置と全体の大きさを渡して描かせる。
+ * 部分描画に対応していないパターンは、キャンバスが1タイルに収まらなければ例外を投げる。
+ */
+TiledImage& TiledImage::operator<<=(const PatternGenerator& generator)
+{
+	for(row_t y = 0; y < tiles_y(); ++y){
+		for(column_t x = 0; x < tiles_x(); ++x){
+			generator.generate_tile(tile(x, y), x*tile_size_, y*tile_size_, width(), height());
+		}
+	}
+	return *this;
+}
+
+/**
+ * 画素ごとに閉じた変換だけを受け付ける。近傍や画像全体を参照するImageProcessは
+ * タイルの継ぎ目で結果が変わるため、TiledImageには適用できない。
+ */
+TiledImage& TiledImage::operator>>=(const PixelConverter& converter)
+{
+	const Area whole;
+	const Tone tone(converter, whole);
+	for(row_t y = 0; y < tiles_y(); ++y){
+		for(column_t x = 0; x < tiles_x(); ++x){
+			tone.process_view(tile(x, y));
+		}
+	}
+	return *this;
+}
+
+TiledImage& TiledImage::operator<<=(std::istream& is)
+{
+	for(row_t h = 0; h < height(); ++h){
+		for(column_t x = 0; x < tiles_x(); ++x){
+			Tile& tile = load(static_cast<std::size_t>(h/tile_size_)*tiles_x() + x);
+			const column_t columns = std::min(tile_size_, width() - x*tile_size_);
+			tile.dirty_ = true;
+			is.read(reinterpret_cast<char*>(&tile.image_[h%tile_size_][0]), static_cast<std::streamsize>(columns*Image::pixelsize));
+			if(!is){
+				return *this;
+			}
+		}
+	}
+	return *this;
+}
+
+std::ostream& TiledImage::write(std::ostream& os)
+{
+	for(row_t h = 0; h < height(); ++h){
+		for(column_t x = 0; x < tiles_x(); ++x){
+			const Image& image = load(static_cast<std::size_t>(h/tile_size_)*tiles_x() + x).image_;
+			const column_t columns = std::min(tile_size_, width() - x*tile_size_);
+			os.write(reinterpret_cast<const char*>(&image[h%tile_size_][0]), static_cast<std::streamsize>(columns*Image::pixelsize));
+		}
+	}
+	return os;
+}
+
+#ifdef ENABLE_PNG
+namespace{
+class TiledRows: public Image::RowSource{
+public:
+	explicit TiledRows(TiledImage& image): image_(image), row_(image.width(), 1){}
+	virtual const byte_t* row(row_t row)
+	{
+		row_ = image_.crop(0, row, image_.width(), 1);
+		return row_.head();
+	}
+private:
+	TiledImage& image_;
+	Image row_;
+};
+}
+
+/**
+ * 1行ずつタイルから組み立てて書き出すので、使うメモリは1行分とタイルキャッシュだけで済む。
+ */
+const TiledImage& TiledImage::write_png(const std::string& filename)
+{
+	TiledRows rows(*this);
+	Image::write_png(filename, rows, width(), height(), Image::bitdepth);
+	return *this;
+}
+#endif
+
+/**
+ * 返すビューは次にload()で別のタイルを読み込むまでしか有効でない。キャッシュから追い出された
+ * スロットは別のタイルに使い回されるので、1タイルの処理を終えてから次のタイルを取り出すこと。
+ */
+ImageView TiledImage::tile(column_t x, row_t y)
+{
+	if(tiles_x() <= x || tiles_y() <= y){
+		throw std::invalid_argument(__func__ + std::string(": can not access tile. tile index out of range."));
+	}
+	Tile& tile = load(static_cast<std::size_t>(y)*tiles_x() + x);
+	tile.dirty_ = true;
+	return tile.image_.view(0, 0, std::min(tile_size_, width() - x*tile_size_), std::min(tile_size_, height() - y*tile_size_));
+}
+
+Image TiledImage::crop(column_t x, row_t y, column_t a_width, row_t a_height)
+{
+	if(width() < x || width() - x < a_width || height() < y || height() - y < a_height){
+		throw std::invalid_argument(__func__ + std::string(": can not crop tiled image. area out of range."));
+	}
+	Image result(a_width, a_height);
+	for(row_t h = 0; h < a_height; ++h){
+		for(column_t w = 0; w < a_width;){
+			const column_t column = x + w;
+			const Image& image = load(static_cast<std::size_t>((y + h)/tile_size_)*tiles_x() + column/tile_size_).image_;
+			const column_t columns = std::min(tile_size_ - column%tile_size_, a_width - w);
+			const ConstRow row = image[(y + h)%tile_size_];
+			std::copy(&row[column%tile_size_], &row[column%tile_size_ + columns], &result[h][w]);
+			w += columns;
+		}
+	}
+	return result;
+}
+
+TiledImage& TiledImage::paste(const Image& image, column_t x, row_t y)
+{
+	if(width() < x || width() - x < image.width() || height() < y || height() - y < image.height()){
+		throw std::invalid_argument(__func__ + std::string(": can not paste image. area out of range."));
+	}
+	for(row_t h = 0; h < image.height(); ++h){
+		for(column_t w = 0; w < image.width();){
+			const column_t column = x + w;
+			Tile& tile = load(static_cast<std::size_t>((y + h)/tile_size_)*tiles_x() + column/tile_size_);
+			const column_t columns = std::min(tile_size_ - column%tile_size_, image.width() - w);
+			tile.dirty_ = true;
+			std::copy(&image[h][w], &image[h][w + columns], &tile.image_[(y + h)%tile_size_][column%tile_size_]);
+			w += columns;
+		}
+	}
+	return *this;
+}
+
+TiledImage::pixel_type TiledImage::pixel(row_t row, column_t column)
+{
+	if(height() <= row || width() <= column){
+		throw std::invalid_argument(__func__ + std::string(": can not get pixel. position out of range."));
+	}
+	const Image& image = load(static_cast<std::size_t>(row/tile_size_)*tiles_x() + column/tile_size_).image_;
+	return image[row%tile_size_][column%tile_size_];
+}
+
+void TiledImage::pixel(row_t row, column_t column, const pixel_type& pixel)
+{
+	if(height() <= row || width() <= column){
+		throw std::invalid_argument(__func__ + std::string(": can not set pixel. position out of range."));
+	}
+	Tile& tile = load(static_cast<std::size_t>(row/tile_size_)*tiles_x() + column/tile_size_);
+	tile.dirty_ = true;
+	tile.image_[row%tile_size_][column%tile_size_] = pixel;
+}
+
+TiledImage::Tile& TiledImage::load(std::size_t index)
+{
+	const std::list<Tile>::iterator it = resident_[index];
+	if(it != cache_.end()){
+		cache_.splice(cache_.begin(), cache_, it);
+		return *it;
+	}
+	if(cache_.size() < cache_size_){
+		cache_.push_front(Tile(index, tile_size_));
+	}else{
+		Tile& victim = cache_.back();
+		if(victim.dirty_){
+			spill(victim);
+		}
+		resident_[victim.index_] = cache_.end();
+		victim.index_ = index;
+		cache_.splice(cache_.begin(), cache_, --cache_.end());
+	}
+	resident_[index] = cache_.begin();
+	fetch(cache_.front());
+	return cache_.front();
+}
+
+void TiledImage::spill(Tile& tile)
+{
+	if(!scratch_ && !(scratch_ = std::tmpfile())){
+		throw std::runtime_error(__func__ + std::string(": can not spill tile. can not create scratch file."));
+	}
+	const uint64_t offset = tile.index_*tile_bytes();
+#ifdef _WIN32
+	if(_fseeki64(scratch_, static_cast<__int64>(offset), SEEK_SET)){
+#else
+	if(fseeko(scratch_, static_cast<off_t>(offset), SEEK_SET)){
+#endif
+		throw std::runtime_error(__func__ + std::string(": can not spill tile. seek failed."));
+	}
+	const std::size_t size = static_cast<std::size_t>(tile_size_)*Image::pixelsize;
+	const Image& image = tile.image_;
+	for(column_t h = 0; h < tile_size_; ++h){
+		if(std::fwrite(&image[h][0], 1, size, scratch_) != size){
+			throw std::runtime_error(__func__ + std::string(": can not spill tile. write failed."));
+		}
+	}
+	stored_[tile.index_] = true;
+	tile.dirty_ = false;
+	++spills_;
+}
+
+void TiledImage::fetch(Tile& tile)
+{
+	tile.dirty_ = false;
+	if(!stored_[tile.index_]){
+		for(column_t h = 0; h < tile_size_; ++h){
+			std::fill(&tile.image_[h][0], &tile.image_[h][tile_size_], pixel_type());
+		}
+		return;
+	}
+	const uint64_t offset = tile.index_*tile_bytes();
+#ifdef _WIN32
+	if(_fseeki64(scratch_, static_cast<__int64>(offset), SEEK_SET)){
+#else
+	if(fseeko(scratch_, static_cast<off_t>(offset), SEEK_SET)){
+#endif
+		throw std::runtime_error(__func__ + std::string(": can not load tile. seek failed."));
+	}
+	const std::size_t size = static_cast<std::size_t>(tile_size_)*Image::pixelsize;
+	for(column_t h = 0; h < tile_size_; ++h){
+		if(std::fread(&tile.image_[h][0], 1, size, scratch_) != size){
+			throw std::runtime_error(__func__ + std::string(": can not load tile. read failed."));
+		}
+	}
+	++loads_;
+}
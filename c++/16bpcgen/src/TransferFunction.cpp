@@ -0,0 +1,188 @@
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include "TransferFunction.hpp"
+
+namespace{
+/**
+ * SMPTE ST 2084(PQ)の定数。
+ */
+const double pq_m1 = 2610.0/16384.0;
+const double pq_m2 = 2523.0/4096.0*128.0;
+const double pq_c1 = 3424.0/4096.0;
+const double pq_c2 = 2413.0/4096.0*32.0;
+const double pq_c3 = 2392.0/4096.0*32.0;
+
+/**
+ * ARIB STD-B67(HLG)の定数。
+ */
+const double hlg_a = 0.17883277;
+const double hlg_b = 1.0 - 4.0*hlg_a;
+const double hlg_c = 0.5 - hlg_a*std::log(4.0*hlg_a);
+
+/**
+ * BT.709のOETF。1.099, 0.018の丸めない値を使い、折れ点で2つの式が連続するようにする。
+ */
+const double bt709_alpha = 1.09929682680944;
+const double bt709_beta  = 0.018053968510807;
+
+void check_exponent(double exponent)
+{
+	if(!(0.0 < exponent)){
+		throw std::invalid_argument(__func__ + std::string(": can not build transfer function. exponent must be positive."));
+	}
+}
+
+/**
+ * 例外で抜けても必ずmutexを解放する。
+ */
+class Lock{
+public:
+	explicit Lock(pthread_mutex_t& mutex): mutex_(mutex){pthread_mutex_lock(&mutex_);}
+	~Lock(){pthread_mutex_unlock(&mutex_);}
+private:
+	Lock(const Lock&);
+	Lock& operator=(const Lock&);
+	pthread_mutex_t& mutex_;
+};
+}
+
+const std::size_t TransferFunction::power_tables;
+
+TransferFunction& TransferFunction::instance()
+{
+	static TransferFunction cache;
+	return cache;
+}
+
+TransferFunction::TransferFunction(): mutex_(), tables_(), powers_()
+{
+	pthread_mutex_init(&mutex_, NULL);
+}
+
+TransferFunction::~TransferFunction()
+{
+	pthread_mutex_destroy(&mutex_);
+}
+
+/**
+ * 曲線と向きごとに16bitの表を初回の要求時に一度だけ作り、以後は同じ表への参照を返す。
+ * TF_POWER以外の表は変更されず解放もされないので、Gammaなどは複製せずに参照を保持してよい。
+ * TF_POWERの表は指数を1/1000に丸めた値で作ってキーとし、power_tables個を超えると古いものから捨てる。
+ * このため参照は、別の指数の表をpower_tables個要求するまでしか有効でない。長く使うならbuildで作った表を持つ。
+ * TF_POWER以外ではexponentを使わない。
+ */
+const TransferFunction::table_type& TransferFunction::table(Curve curve, Direction direction, double exponent)
+{
+	if(curve < TF_SRGB || TF_POWER < curve){
+		throw std::invalid_argument(__func__ + std::string(": can not build transfer function. invalid curve."));
+	}
+	if(curve == TF_POWER){
+		check_exponent(exponent);
+		exponent = std::max(std::floor(exponent*1000.0 + 0.5), 1.0)/1000.0;
+	}else{
+		exponent = 0.0;
+	}
+	const key_type key(curve*2 + direction, exponent);
+	{
+		const Lock lock(mutex_);
+		const std::map<key_type, table_type>::const_iterator it = tables_.find(key);
+		if(it != tables_.end()){
+			return it->second;
+		}
+	}
+	table_type result = build(curve, direction, exponent);
+	const Lock lock(mutex_);
+	const std::pair<std::map<key_type, table_type>::iterator, bool> inserted = tables_.insert(std::make_pair(key, table_type()));
+	if(!inserted.second){
+		return inserted.first->second;
+	}
+	if(curve == TF_POWER){
+		try{
+			powers_.push_back(key);
+		}catch(...){
+			tables_.erase(inserted.first);
+			throw;
+		}
+		if(power_tables < powers_.size()){
+			tables_.erase(powers_.front());
+			powers_.pop_front();
+		}
+	}
+	inserted.first->second.swap(result);
+	return inserted.first->second;
+}
+
+std::size_t TransferFunction::tables()
+{
+	const Lock lock(mutex_);
+	return tables_.size();
+}
+
+/**
+ * キャッシュを介さずに表を作る。
+ */
+TransferFunction::table_type TransferFunction::build(Curve curve, Direction direction, double exponent)
+{
+	table_type result(static_cast<std::size_t>(Image::pixel_type::max) + 1);
+	for(std::size_t i = 0; i < result.size(); ++i){
+		const double x = static_cast<double>(i)/Image::pixel_type::max;
+		const double y = direction == TO_LINEAR ? to_linear(curve, x, exponent) : to_signal(curve, x, exponent);
+		result[i] = static_cast<value_type>(std::min(std::max(y, 0.0), 1.0)*Image::pixel_type::max + 0.5);
+	}
+	return result;
+}
+
+/**
+ * 信号値[0, 1]から線形光[0, 1]へ。PQは10000cd/m^2、HLGはシーン光の最大を1とする。
+ * TF_BT709はOETFの逆関数、TF_BT1886は黒レベル0のEOTF(2.4乗)。
+ */
+double TransferFunction::to_linear(Curve curve, double signal, double exponent)
+{
+	switch(curve){
+	case TF_SRGB:
+		return signal <= 0.04045 ? signal/12.92 : std::pow((signal + 0.055)/1.055, 2.4);
+	case TF_BT709:
+		return signal < 4.5*bt709_beta ? signal/4.5 : std::pow((signal + bt709_alpha - 1.0)/bt709_alpha, 1.0/0.45);
+	case TF_BT1886:
+		return std::pow(signal, 2.4);
+	case TF_PQ:{
+		const double p = std::pow(signal, 1.0/pq_m2);
+		return std::pow(std::max(p - pq_c1, 0.0)/(pq_c2 - pq_c3*p), 1.0/pq_m1);
+	}
+	case TF_HLG:
+		return signal <= 0.5 ? signal*signal/3.0 : (std::exp((signal - hlg_c)/hlg_a) + hlg_b)/12.0;
+	case TF_POWER:
+		check_exponent(exponent);
+		return std::pow(signal, exponent);
+	default:
+		throw std::invalid_argument(__func__ + std::string(": can not apply transfer function. invalid curve."));
+	}
+}
+
+/**
+ * 線形光[0, 1]から信号値[0, 1]へ。to_linearの逆関数。
+ */
+double TransferFunction::to_signal(Curve curve, double linear, double exponent)
+{
+	switch(curve){
+	case TF_SRGB:
+		return linear <= 0.0031308 ? linear*12.92 : 1.055*std::pow(linear, 1.0/2.4) - 0.055;
+	case TF_BT709:
+		return linear < bt709_beta ? linear*4.5 : bt709_alpha*std::pow(linear, 0.45) - (bt709_alpha - 1.0);
+	case TF_BT1886:
+		return std::pow(linear, 1.0/2.4);
+	case TF_PQ:{
+		const double p = std::pow(linear, pq_m1);
+		return std::pow((pq_c1 + pq_c2*p)/(1.0 + pq_c3*p), pq_m2);
+	}
+	case TF_HLG:
+		return linear <= 1.0/12.0 ? std::sqrt(3.0*linear) : hlg_a*std::log(12.0*linear - hlg_b) + hlg_c;
+	case TF_POWER:
+		check_exponent(exponent);
+		return std::pow(linear, 1.0/exponent);
+	default:
+		throw std::invalid_argument(__func__ + std::string(": can not apply transfer function. invalid curve."));
+	}
+}
@@ -7,6 +7,8 @@
 #endif
 #include <sys/stat.h>
 #include <unistd.h>
+#include <vector>
+#include "ColorConversion.hpp"
 #include "Image.hpp"
 #include "PatternGenerators.hpp"
 #ifdef _WIN32
@@ -25,39 +27,23 @@ int main(void)
 
 	for(row_t r = 0; r < height; ++r){
 		for(column_t c = 0; c < width; ++c){
-			try{
-				Image::pixel_type p(Image::pixel_type::max/2, static_cast<value_type>(c*Image::pixel_type::max/width), static_cast<value_type>(r*Image::pixel_type::max/height), Image::pixel_type::CS_YCBCR_BT601);
-				image[height - 1 - r][c] = p;
-			}catch(const std::invalid_argument& err){
-				image[height - 1 - r][c] = black;
-			}
-		}
-	}
-	image >> "./img/YCbCr601.png";
-
-	for(row_t r = 0; r < height; ++r){
-		for(column_t c = 0; c < width; ++c){
-			try{
-				Image::pixel_type p(Image::pixel_type::max/2, static_cast<value_type>(c*Image::pixel_type::max/width), static_cast<value_type>(r*Image::pixel_type::max/height), Image::pixel_type::CS_YCBCR_BT709);
-				image[height - 1 - r][c] = p;
-			}catch(const std::invalid_argument& err){
-				image[height - 1 - r][c] = black;
-			}
+			image[height - 1 - r][c] = Image::pixel_type(Image::pixel_type::max/2, static_cast<value_type>(c*Image::pixel_type::max/width), static_cast<value_type>(r*Image::pixel_type::max/height));
 		}
 	}
-	image >> "./img/YCbCr709.png";
-
-	for(row_t r = 0; r < height; ++r){
-		for(column_t c = 0; c < width; ++c){
-			try{
-				Image::pixel_type p(Image::pixel_type::max/2, static_cast<value_type>(c*Image::pixel_type::max/width), static_cast<value_type>(r*Image::pixel_type::max/height), Image::pixel_type::CS_YCBCR_BT2020);
-				image[height - 1 - r][c] = p;
-			}catch(const std::invalid_argument& err){
-				image[height - 1 - r][c] = black;
+	const Image::pixel_type::ColorSpace spaces[] = {Image::pixel_type::CS_YCBCR_BT601, Image::pixel_type::CS_YCBCR_BT709, Image::pixel_type::CS_YCBCR_BT2020};
+	const char* const filenames[] = {"./img/YCbCr601.png", "./img/YCbCr709.png", "./img/YCbCr2020.png"};
+	for(std::size_t i = 0; i < sizeof(spaces)/sizeof(spaces[0]); ++i){
+		std::vector<byte_t> mask;
+		Image rgb = ColorConversion(spaces[i]).to_rgb(image, &mask);
+		for(row_t r = 0; r < height; ++r){
+			for(column_t c = 0; c < width; ++c){
+				if(mask[r*width + c] & ColorConversion::OUT_OF_RANGE){
+					rgb[r][c] = black;
+				}
 			}
 		}
+		rgb >> filenames[i];
 	}
-	image >> "./img/YCbCr2020.png";
 
 	image <<= Luster(black);
 	const column_t center_column = width/2;
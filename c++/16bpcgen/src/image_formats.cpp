@@ -14,7 +14,7 @@ int main(void)
 	const row_t    height = 1080;
 	const std::string pngfile = "./img/PNG.png";
 	const std::string tiffile = "./img/TIFF.tif";
-	Image(width, height) << Luster(white) << Character("PNG",  black, 60) >> pngfile;
-	Image(pngfile)       << Luster(white) << Character("TIFF", black, 60) >> tiffile;
+	(Image(width, height) << Luster(white) <<= Character("PNG",  black, 60)) >> pngfile;
+	(Image(pngfile)       << Luster(white) <<= Character("TIFF", black, 60)) >> tiffile;
 	return 0;
 }
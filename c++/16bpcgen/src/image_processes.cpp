@@ -1,5 +1,7 @@
 #include <sys/stat.h>
 #include <unistd.h>
+#include "Compositor.hpp"
+#include "Dither.hpp"
 #include "Image.hpp"
 #include "ImageProcesses.hpp"
 #include "PatternGenerators.hpp"
@@ -23,10 +25,15 @@ int main(void)
 	Image offset    = orig >> Offset(0xffff/5);
 	Image reversal  = orig >> Reversal();
 
-	Image bit6 = orig & Image::pixel_type(0xfc00, 0xfc00, 0xfc00);
-	Image bit5 = orig & Image::pixel_type(0xf800, 0xf800, 0xf800);
-	Image bit4 = orig & Image::pixel_type(0xf000, 0xf000, 0xf000);
-	Image bit3 = orig & Image::pixel_type(0xe000, 0xe000, 0xe000);
+	Image bit6 = orig >> Dither(6);
+	Image bit5 = orig >> Dither(5);
+	Image bit4 = orig >> Dither(4);
+	Image bit3 = orig >> Dither(3);
+
+	Image mask3  = orig & Image::pixel_type(0xe000, 0xe000, 0xe000);
+	Image bayer3 = orig >> Dither(3, Dither::DITHER_BAYER);
+	Image noise3 = orig >> Dither(3, Dither::DITHER_BLUE_NOISE);
+	Image jarvis = orig >> Dither(3, Dither::DITHER_JARVIS);
 
 	Image normalize = orig >> Normalize();
 	Image median    = orig >> Median();
@@ -38,10 +45,13 @@ int main(void)
 	Image laplacian1 = orig >> 12 >> Laplacian3x3();
 	Image laplacian2 = orig >> 12 >> Laplacian5x5();
 
-	orig(r)(g)(b)
-		(gray(threshold)(offset)(reversal), Image::ORI_VERT)
-		(bit6(bit5)(bit4)(bit3), Image::ORI_VERT)
-		(normalize(median)(smoothing)(unsharp), Image::ORI_VERT)
-		(prewitt(sobel)(laplacian1)(laplacian2), Image::ORI_VERT) >> "./img/image_processes.png";
+	Compositor mosaic(4);
+	mosaic << orig       << r          << g          << b
+	       << gray       << threshold  << offset     << reversal
+	       << bit6       << bit5       << bit4       << bit3
+	       << mask3      << bayer3     << noise3     << jarvis
+	       << normalize  << median     << smoothing  << unsharp
+	       << prewitt    << sobel      << laplacian1 << laplacian2;
+	mosaic.compose() >> "./img/image_processes.png";
 	return 0;
 }
@@ -0,0 +1,1140 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include "BasicImage.hpp"
+#include "ColorConversion.hpp"
+#include "Compositor.hpp"
+#include "ContentHash.hpp"
+#include "ConverterChain.hpp"
+#include "Dither.hpp"
+#include "FramePool.hpp"
+#include "Histogram.hpp"
+#include "Image.hpp"
+#include "ImageExpression.hpp"
+#include "ImageProcesses.hpp"
+#include "IntegralImage.hpp"
+#include "Lut3D.hpp"
+#include "Metrics.hpp"
+#include "PatternGenerators.hpp"
+#include "PixelConverters.hpp"
+#include "PlanarImage.hpp"
+#include "ThreadPool.hpp"
+#include "TiledImage.hpp"
+
+/**
+ * 各パターンジェネレータと画像処理の出力を複数の解像度で生成し、
+ * 内容のハッシュ値をgolden.txtに記録された値と比較する。
+ * 出力を意図的に変えたときは--updateを付けて実行し、golden.txtを更新する。
+ */
+
+static const char* const manifest = "./src/test/golden.txt";
+
+static Image generate(column_t width, row_t height, const PatternGenerator& generator)
+{
+	Image image(width, height);
+	image <<= Luster(black);
+	return image <<= generator;
+}
+
+static Image source(column_t width, row_t height)
+{
+	return generate(width, height, Ramp());
+}
+
+static Image color_bar(column_t w, row_t h){return generate(w, h, ColorBar());}
+static Image luster(column_t w, row_t h){return generate(w, h, Luster(red));}
+static Image checker(column_t w, row_t h){return generate(w, h, Checker());}
+static Image checker_invert(column_t w, row_t h){return generate(w, h, Checker(true));}
+static Image stair_step_h(column_t w, row_t h){return generate(w, h, StairStepH());}
+static Image stair_step_v(column_t w, row_t h){return generate(w, h, StairStepV(2, 10, true));}
+static Image ramp(column_t w, row_t h){return generate(w, h, Ramp());}
+static Image cross_hatch(column_t w, row_t h){return generate(w, h, CrossHatch(w/8 + 1, h/8 + 1));}
+static Image character(column_t w, row_t h){return generate(w, h, Character("16bpc\n\tgen", yellow, w < 512 ? 1 : 2, h/4, w/16));}
+static Image line(column_t w, row_t h){return generate(w, h, Line(0, h/3, w - 1, h - 1, cyan));}
+static Image circle(column_t w, row_t h){return generate(w, h, Circle(w/2, h/2, magenta, h/3, true));}
+static Image ring(column_t w, row_t h){return generate(w, h, Circle(w/3, h/2, white, h/4, false));}
+static Image image8_png(column_t w, row_t h)
+{
+	const char* const filename = "./golden_image8.png";
+	const Image8 preview(source(w, h));
+	preview >> filename;
+	const Image result(filename);
+	std::remove(filename);
+	if(ContentHash::digest(result) != ContentHash::digest(preview.image())){
+		throw std::runtime_error(__func__ + std::string(": 8-bit PNG does not match the preview."));
+	}
+	return result;
+}
+
+/**
+ * 浮動小数点の画像は16bitへ量子化して書き出され、値域外の値は飽和する。
+ */
+static Image imagef_png(column_t w, row_t h)
+{
+	const char* const filename = "./golden_imagef.png";
+	ImageF linear(source(w, h));
+	ImageF::pixel_type& first = linear[0][0];
+	first.R(2.0f);
+	first.G(-1.0f);
+	first.B(0.5f);
+	ImageF::pixel_type& last = linear[h - 1][w - 1];
+	last.R(std::numeric_limits<float>::quiet_NaN());
+	last.G(1.0f);
+	last.B(0.0f);
+	linear >> filename;
+	const Image result(filename);
+	std::remove(filename);
+	Image expected = Image16(linear).image();
+	expected[0][0] = Image::pixel_type(Image::pixel_type::max, 0, 0x7fff);
+	expected[h - 1][w - 1] = Image::pixel_type(0, Image::pixel_type::max, 0);
+	if(ContentHash::digest(result) != ContentHash::digest(expected)){
+		throw std::runtime_error(__func__ + std::string(": float PNG does not match the quantized image."));
+	}
+	return result;
+}
+
+/**
+ * 継ぎ目をまたいでもImageへ一度に描いた結果と一致することを確かめる。
+ * キャッシュは1タイル行分なので、タイルはスクラッチファイルへ退避されてから読み戻される。
+ */
+static Image tiled(column_t width, row_t height, const PatternGenerator& generator)
+{
+	TiledImage image(width, height, 48, 2);
+	image <<= generator;
+	const Image result = image.crop(0, 0, width, height);
+	if(ContentHash::digest(result) != ContentHash::digest(generate(width, height, generator))){
+		throw std::runtime_error(__func__ + std::string(": tiled image does not match the whole image."));
+	}
+	return result;
+}
+
+static Image tiled_color_bar(column_t w, row_t h){return tiled(w, h, ColorBar());}
+static Image tiled_checker(column_t w, row_t h){return tiled(w, h, Checker(true));}
+static Image tiled_stair_step_h(column_t w, row_t h){return tiled(w, h, StairStepH());}
+static Image tiled_stair_step_v(column_t w, row_t h){return tiled(w, h, StairStepV(2, 10, true));}
+static Image tiled_ramp(column_t w, row_t h){return tiled(w, h, Ramp());}
+static Image tiled_cross_hatch(column_t w, row_t h){return tiled(w, h, CrossHatch(w/8 + 1, h/8 + 1));}
+static Image tiled_png(column_t w, row_t h)
+{
+	const char* const filename = "./golden_tiled.png";
+	TiledImage image(w, h, 48, 2);
+	image <<= Ramp();
+	image >>= GrayScale();
+	image.write_png(filename);
+	const Image result(filename);
+	std::remove(filename);
+	if(ContentHash::digest(result) != ContentHash::digest(source(w, h) >> GrayScale())){
+		throw std::runtime_error(__func__ + std::string(": tiled PNG does not match the whole image."));
+	}
+	return result;
+}
+
+/**
+ * 複製より前に取った行やビューを通じた書き込みが複製へ及ばないこと、
+ * 全画素を上書きするジェネレータが領域を共有する他の画像を変えないことを確かめる。
+ */
+static Image copy_isolation(column_t w, row_t h)
+{
+	const Image a = source(w, h);
+	const uint64_t expected = ContentHash::digest(a);
+	Image c(a);
+	const Row row = c[1];
+	const ImageView view = c.view();
+	const Image d(c);
+	Image e(0, 0);
+	e = c;
+	const Image f = c.crop(0, 1, w, 1);
+	row[0] = Image::pixel_type(1, 2, 3);
+	view[h - 1][w - 1] = Image::pixel_type(4, 5, 6);
+	if(ContentHash::digest(a) != expected || ContentHash::digest(d) != expected || ContentHash::digest(e) != expected ||
+	   ContentHash::digest(f) != ContentHash::digest(a.crop(0, 1, w, 1))){
+		throw std::runtime_error(__func__ + std::string(": write through an earlier row reaches a copy."));
+	}
+	const uint64_t written = ContentHash::digest(c);
+	if(written == expected){
+		throw std::runtime_error(__func__ + std::string(": write through a row is lost."));
+	}
+	Image g(c);
+	g <<= Luster(red);
+	const Image blue_image = c << Luster(blue);
+	if(ContentHash::digest(c) != written || ContentHash::digest(blue_image) != ContentHash::digest(generate(w, h, Luster(blue)))){
+		throw std::runtime_error(__func__ + std::string(": overwriting generator changes a shared image."));
+	}
+	return c;
+}
+
+static void write_raw(const char* filename, column_t width, row_t height, uint64_t pitch, std::size_t data_offset, const std::vector<char>& body)
+{
+	std::vector<char> header(data_offset);
+	const uint16_t byte_order = 0xfeff;
+	const uint16_t bitdepth = Image::bitdepth;
+	const uint64_t offset = data_offset;
+	std::memcpy(&header[0],  "16bpcraw",  8);
+	std::memcpy(&header[8],  &byte_order, sizeof(byte_order));
+	std::memcpy(&header[10], &bitdepth,   sizeof(bitdepth));
+	std::memcpy(&header[12], &width,      sizeof(width));
+	std::memcpy(&header[16], &height,     sizeof(height));
+	std::memcpy(&header[24], &pitch,      sizeof(pitch));
+	std::memcpy(&header[32], &offset,     sizeof(offset));
+	std::ofstream ofs(filename, std::ios::binary);
+	ofs.write(&header[0], static_cast<std::streamsize>(header.size()));
+	ofs.write(&body[0], static_cast<std::streamsize>(body.size()));
+}
+
+/**
+ * 並列に同じ大きさのフレームを借りては返す。
+ */
+class FrameChurn{
+public:
+	explicit FrameChurn(std::size_t size): size_(size){}
+	void operator()(std::size_t begin, std::size_t end)const
+	{
+		for(std::size_t i = begin; i < end; ++i){
+			FramePool::instance().release(FramePool::instance().acquire(size_), size_);
+		}
+	}
+private:
+	const std::size_t size_;
+};
+
+/**
+ * 空のプールでのミス、同じ大きさの帯へのヒット、容量を超えたときの大きい帯からの解放、
+ * 容量より大きいフレームの即時解放を統計値で確かめる。並列に借りて返した回数はヒットとミスの増分に一致する。
+ */
+static Image frame_pool(column_t w, row_t h)
+{
+	FramePool& pool = FramePool::instance();
+	const std::size_t capacity = pool.capacity();
+	const std::size_t page = FramePool::bucket(1);
+	pool.clear();
+	try{
+		const std::size_t hits = pool.hits(), misses = pool.misses();
+		byte_t* const frame = pool.acquire(page + 1);
+		pool.release(frame, page + 1);
+		if(pool.misses() != misses + 1 || pool.retained() != 2*page || FramePool::bucket(2*page) != 2*page){
+			throw std::runtime_error(__func__ + std::string(": empty pool does not miss."));
+		}
+		byte_t* const reused = pool.acquire(2*page);
+		if(reused != frame || pool.hits() != hits + 1 || pool.retained() != 0){
+			throw std::runtime_error(__func__ + std::string(": released frame is not reused."));
+		}
+		pool.release(reused, 2*page);
+		pool.clear();
+
+		pool.set_capacity(5*page);
+		byte_t* const small = pool.acquire(page);
+		byte_t* const large1 = pool.acquire(3*page);
+		byte_t* const large2 = pool.acquire(3*page);
+		pool.release(small, page);
+		pool.release(large1, 3*page);
+		pool.release(large2, 3*page);
+		if(pool.retained() != 4*page || pool.hits() != hits + 1 || pool.misses() != misses + 4){
+			throw std::runtime_error(__func__ + std::string(": frames over capacity are not evicted."));
+		}
+		byte_t* const kept = pool.acquire(page);
+		pool.release(kept, page);
+		if(kept != small || pool.hits() != hits + 2){
+			throw std::runtime_error(__func__ + std::string(": eviction does not start from the largest bucket."));
+		}
+		pool.release(pool.acquire(6*page), 6*page);
+		if(pool.retained() != 4*page || pool.misses() != misses + 5){
+			throw std::runtime_error(__func__ + std::string(": frame larger than capacity is retained."));
+		}
+		if(1e-12 < std::fabs(pool.hit_rate() - static_cast<double>(pool.hits())/static_cast<double>(pool.hits() + pool.misses()))){
+			throw std::runtime_error(__func__ + std::string(": hit rate does not match the counters."));
+		}
+
+		ThreadPool& threads = ThreadPool::instance();
+		const std::size_t count = threads.threads();
+		const std::size_t before = pool.hits() + pool.misses();
+		threads.set_threads(4);
+		parallel_for(0, 4096, FrameChurn(page), 64);
+		threads.set_threads(count);
+		if(pool.hits() + pool.misses() != before + 4096 || pool.retained() < page){
+			throw std::runtime_error(__func__ + std::string(": concurrent acquires are not counted."));
+		}
+	}catch(...){
+		pool.set_capacity(capacity);
+		throw;
+	}
+	pool.set_capacity(capacity);
+	pool.clear();
+	return source(w, h);
+}
+
+/**
+ * 行頭が64バイトに揃っていない.rawは揃えた行へ複写して読まれ、
+ * (height - 1)*pitchが桁あふれするヘッダは拒否されることを確かめる。
+ */
+static Image raw_unaligned(column_t w, row_t h)
+{
+	const char* const filename = "./golden_unaligned.raw";
+	const Image image = source(w, h);
+	const std::size_t pitch = image.row_size() + 8;
+	std::vector<char> body(h*pitch);
+	for(row_t i = 0; i < h; ++i){
+		std::memcpy(&body[i*pitch], image.head() + i*image.pitch(), image.row_size());
+	}
+	write_raw(filename, w, h, pitch, 4096 + 8, body);
+	const Image result(filename);
+	if(reinterpret_cast<std::size_t>(result.head()) % Image::alignment || result.pitch() % Image::alignment ||
+	   ContentHash::digest(result) != ContentHash::digest(image)){
+		std::remove(filename);
+		throw std::runtime_error(__func__ + std::string(": unaligned raw image is not copied into aligned rows."));
+	}
+
+	write_raw(filename, w, 3, uint64_t(1) << 63, 4096, std::vector<char>(image.row_size()));
+	try{
+		Image overflow(filename);
+		std::remove(filename);
+		throw std::runtime_error(__func__ + std::string(": overflowing pitch is accepted."));
+	}catch(const std::invalid_argument&){
+	}
+	std::remove(filename);
+	return result;
+}
+
+#ifndef _WIN32
+/**
+ * ファイル記述子へ書き出してから読み戻す。truncateが真なら末尾の1バイトを切り詰めてから読む。
+ */
+static bool fd_round_trip(const Image& image, Image::RawLayout layout, Image& result, bool truncate)
+{
+	const char* const filename = "./golden_layout.raw";
+	const int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if(fd < 0){
+		throw std::runtime_error(__func__ + std::string(": can not open scratch file."));
+	}
+	bool ok = image.export_raw(fd, layout);
+	const off_t size = lseek(fd, 0, SEEK_CUR);
+	ok = ok && (!truncate || !ftruncate(fd, size - 1)) && !lseek(fd, 0, SEEK_SET) && result.import_raw(fd, layout);
+	close(fd);
+	std::remove(filename);
+	return ok;
+}
+#endif
+
+/**
+ * 各レイアウトで先頭画素のバイト列を確かめ、ストリームとファイル記述子の両方で往復させる。
+ * 途中で途切れた入力ではfalseを返すことも確かめる。8bitのレイアウトは上位8bitだけが往復する。
+ */
+static Image raw_layouts(column_t w, row_t h)
+{
+	static const struct{
+		Image::RawLayout layout;
+		std::size_t sample_size;
+		bool planar;
+		bool big_endian;
+	}layouts[] = {
+		{Image::RAW_RGB48LE,    2, false, false},
+		{Image::RAW_RGB48BE,    2, false, true},
+		{Image::RAW_RGB24,      1, false, true},
+		{Image::RAW_PLANAR48LE, 2, true,  false},
+		{Image::RAW_PLANAR48BE, 2, true,  true},
+	};
+	const Image::pixel_type::value_type values[] = {0x1234, 0x5678, 0x9abc};
+	Image image = source(w, h);
+	image[0][0] = Image::pixel_type(values[0], values[1], values[2]);
+	Image quantized(w, h);
+	for(row_t y = 0; y < h; ++y){
+		for(column_t x = 0; x < w; ++x){
+			const Image::pixel_type& pixel = image[y][x];
+			quantized[y][x] = Image::pixel_type(
+				static_cast<Image::pixel_type::value_type>((pixel.R() >> 8)*0x101),
+				static_cast<Image::pixel_type::value_type>((pixel.G() >> 8)*0x101),
+				static_cast<Image::pixel_type::value_type>((pixel.B() >> 8)*0x101));
+		}
+	}
+	const std::size_t pixels = static_cast<std::size_t>(w)*h;
+	for(std::size_t i = 0; i < sizeof(layouts)/sizeof(layouts[0]); ++i){
+		const std::size_t size = layouts[i].sample_size;
+		const Image& expected = size == 1 ? quantized : image;
+		std::ostringstream os;
+		if(!image.export_raw(os, layouts[i].layout) || os.str().size() != pixels*3*size){
+			throw std::runtime_error(__func__ + std::string(": raw frame has a wrong size."));
+		}
+		const std::string bytes = os.str();
+		for(std::size_t c = 0; c < 3; ++c){
+			const std::size_t pos = (layouts[i].planar ? pixels : 1)*c*size;
+			const unsigned int high = values[c] >> 8, low = values[c] & 0xffu;
+			const unsigned int first = static_cast<unsigned char>(bytes[pos]);
+			const unsigned int second = size == 2 ? static_cast<unsigned char>(bytes[pos + 1]) : low;
+			if(first != (layouts[i].big_endian || size == 1 ? high : low) || second != (layouts[i].big_endian || size == 1 ? low : high)){
+				throw std::runtime_error(__func__ + std::string(": raw samples are in a wrong order."));
+			}
+		}
+		std::istringstream is(bytes);
+		Image result(w, h);
+		if(!result.import_raw(is, layouts[i].layout) || ContentHash::digest(result) != ContentHash::digest(expected)){
+			throw std::runtime_error(__func__ + std::string(": raw stream does not round-trip."));
+		}
+		std::istringstream truncated(bytes.substr(0, bytes.size() - 1));
+		Image partial(w, h);
+		if(partial.import_raw(truncated, layouts[i].layout)){
+			throw std::runtime_error(__func__ + std::string(": short raw stream is accepted."));
+		}
+#ifndef _WIN32
+		Image from_fd(w, h);
+		if(!fd_round_trip(image, layouts[i].layout, from_fd, false) || ContentHash::digest(from_fd) != ContentHash::digest(expected)){
+			throw std::runtime_error(__func__ + std::string(": raw file does not round-trip."));
+		}
+		if(fd_round_trip(image, layouts[i].layout, partial, true)){
+			throw std::runtime_error(__func__ + std::string(": short raw file is accepted."));
+		}
+#endif
+	}
+	return quantized;
+}
+
+/**
+ * Sharma, Wu, Dalal (2005) "The CIEDE2000 Color-Difference Formula" の検証用データ34組と照合し、
+ * 一致すれば色差のヒートマップを返す。
+ */
+static Image ciede2000(column_t w, row_t h)
+{
+	static const double pairs[][7] = {
+		{50.0000,   2.6772, -79.7751, 50.0000,   0.0000, -82.7485,  2.0425},
+		{50.0000,   3.1571, -77.2803, 50.0000,   0.0000, -82.7485,  2.8615},
+		{50.0000,   2.8361, -74.0200, 50.0000,   0.0000, -82.7485,  3.4412},
+		{50.0000,  -1.3802, -84.2814, 50.0000,   0.0000, -82.7485,  1.0000},
+		{50.0000,  -1.1848, -84.8006, 50.0000,   0.0000, -82.7485,  1.0000},
+		{50.0000,  -0.9009, -85.5211, 50.0000,   0.0000, -82.7485,  1.0000},
+		{50.0000,   0.0000,   0.0000, 50.0000,  -1.0000,   2.0000,  2.3669},
+		{50.0000,  -1.0000,   2.0000, 50.0000,   0.0000,   0.0000,  2.3669},
+		{50.0000,   2.4900,  -0.0010, 50.0000,  -2.4900,   0.0009,  7.1792},
+		{50.0000,   2.4900,  -0.0010, 50.0000,  -2.4900,   0.0010,  7.1792},
+		{50.0000,   2.4900,  -0.0010, 50.0000,  -2.4900,   0.0011,  7.2195},
+		{50.0000,   2.4900,  -0.0010, 50.0000,  -2.4900,   0.0012,  7.2195},
+		{50.0000,  -0.0010,   2.4900, 50.0000,   0.0009,  -2.4900,  4.8045},
+		{50.0000,  -0.0010,   2.4900, 50.0000,   0.0010,  -2.4900,  4.8045},
+		{50.0000,  -0.0010,   2.4900, 50.0000,   0.0011,  -2.4900,  4.7461},
+		{50.0000,   2.5000,   0.0000, 50.0000,   0.0000,  -2.5000,  4.3065},
+		{50.0000,   2.5000,   0.0000, 73.0000,  25.0000, -18.0000, 27.1492},
+		{50.0000,   2.5000,   0.0000, 61.0000,  -5.0000,  29.0000, 22.8977},
+		{50.0000,   2.5000,   0.0000, 56.0000, -27.0000,  -3.0000, 31.9030},
+		{50.0000,   2.5000,   0.0000, 58.0000,  24.0000,  15.0000, 19.4535},
+		{50.0000,   2.5000,   0.0000, 50.0000,   3.1736,   0.5854,  1.0000},
+		{50.0000,   2.5000,   0.0000, 50.0000,   3.2972,   0.0000,  1.0000},
+		{50.0000,   2.5000,   0.0000, 50.0000,   1.8634,   0.5757,  1.0000},
+		{50.0000,   2.5000,   0.0000, 50.0000,   3.2592,   0.3350,  1.0000},
+		{60.2574, -34.0099,  36.2677, 60.4626, -34.1751,  39.4387,  1.2644},
+		{63.0109, -31.0961,  -5.8663, 62.8187, -29.7946,  -4.0864,  1.2630},
+		{61.2901,   3.7196,  -5.3901, 61.4292,   2.2480,  -4.9620,  1.8731},
+		{35.0831, -44.1164,   3.7933, 35.0232, -40.0716,   1.5901,  1.8645},
+		{22.7233,  20.0904, -46.6940, 23.0331,  14.9730, -42.5619,  2.0373},
+		{36.4612,  47.8580,  18.3852, 36.2715,  50.5065,  21.2231,  1.4146},
+		{90.8027,  -2.0831,   1.4410, 91.1528,  -1.6435,   0.0447,  1.4441},
+		{90.9257,  -0.5406,  -0.9208, 88.6381,  -0.8985,  -0.7239,  1.5381},
+		{ 6.7747,  -0.2908,  -2.4247,  5.8714,  -0.0985,  -2.2286,  0.6377},
+		{ 2.0776,   0.0795,  -1.1350,  0.9033,  -0.0636,  -0.5514,  0.9082}
+	};
+	for(std::size_t i = 0; i < sizeof(pairs)/sizeof(pairs[0]); ++i){
+		const double* const p = pairs[i];
+		const double forward  = Metrics::ciede2000(Pixel<double>(p[0], p[1], p[2]), Pixel<double>(p[3], p[4], p[5]));
+		const double backward = Metrics::ciede2000(Pixel<double>(p[3], p[4], p[5]), Pixel<double>(p[0], p[1], p[2]));
+		if(1e-4 < std::fabs(forward - p[6]) || 1e-4 < std::fabs(backward - p[6])){
+			std::ostringstream oss;
+			oss << __func__ << ": pair " << i + 1 << " gives " << forward << '/' << backward << ", expected " << p[6];
+			throw std::runtime_error(oss.str());
+		}
+	}
+	Image map(0, 0);
+	Metrics(source(w, h), source(w, h) >> GrayScale()).delta_e(&map);
+	return map;
+}
+
+static bool near(double value, double expected, double tolerance)
+{
+	return std::fabs(value - expected) <= tolerance;
+}
+
+static bool infinite(double value)
+{
+	return std::numeric_limits<double>::max() < value;
+}
+
+/**
+ * 平坦な2画像のSSIMは輝度項だけが残る。
+ * SSIMの局所モーメントは単精度で求めるので、比較には1e-3程度の幅を持たせる。
+ */
+static double flat_ssim(Image::pixel_type::value_type a, Image::pixel_type::value_type b)
+{
+	const double x = static_cast<double>(a)/Image::pixel_type::max, y = static_cast<double>(b)/Image::pixel_type::max;
+	const double c1 = 0.01*0.01;
+	return (2.0*x*y + c1)/(x*x + y*y + c1);
+}
+
+static double expected_psnr(double error)
+{
+	return 10.0*std::log10(static_cast<double>(Image::pixel_type::max)*Image::pixel_type::max/(error*error));
+}
+
+/**
+ * 同一画像はPSNRが無限大、SSIMが1、ΔEが0になること、市松模様の±dの雑音はMSEがd*dになること、
+ * 平坦な画像のSSIMが輝度項に一致すること、1画素と1列の画像でも同じ値になることを確かめる。
+ */
+static Image metrics(column_t w, row_t h)
+{
+	const Image reference = source(w, h);
+	const Image same(reference);
+	const Metrics identical(reference, same);
+	const Pixel<double> identical_mse = identical.mse(), identical_psnr = identical.psnr(), identical_ssim = identical.ssim();
+	if(0.0 < identical_mse.R() + identical_mse.G() + identical_mse.B() ||
+	   !infinite(identical_psnr.R()) || !infinite(identical_psnr.G()) || !infinite(identical_psnr.B()) ||
+	   !near(identical_ssim.R(), 1.0, 1e-6) || !near(identical_ssim.G(), 1.0, 1e-6) || !near(identical_ssim.B(), 1.0, 1e-6) ||
+	   0.0 < identical.delta_e()){
+		throw std::runtime_error(__func__ + std::string(": identical images are not a perfect match."));
+	}
+
+	const Image::pixel_type gray(0x8000, 0x4000, 0xc000);
+	const Image flat = generate(w, h, Luster(gray));
+	Image noisy(flat);
+	const Image::pixel_type::value_type d = 0x0100;
+	for(row_t y = 0; y < h; ++y){
+		for(column_t x = 0; x < w; ++x){
+			const bool up = (x + y)%2 == 0;
+			noisy[y][x].R(static_cast<Image::pixel_type::value_type>(up ? gray.R() + d : gray.R() - d));
+			noisy[y][x].G(static_cast<Image::pixel_type::value_type>(up ? gray.G() - 2*d : gray.G() + 2*d));
+		}
+	}
+	const Metrics noise(flat, noisy);
+	const Pixel<double> noise_mse = noise.mse(), noise_psnr = noise.psnr(), noise_ssim = noise.ssim();
+	if(!near(noise_mse.R(), 1.0*d*d, 1e-9) || !near(noise_mse.G(), 4.0*d*d, 1e-9) || 0.0 < noise_mse.B() ||
+	   !near(noise_psnr.R(), expected_psnr(d), 1e-9) || !near(noise_psnr.G(), expected_psnr(2.0*d), 1e-9) || !infinite(noise_psnr.B()) ||
+	   !(noise_ssim.G() < noise_ssim.R() && noise_ssim.R() < 1.0) || !near(noise_ssim.B(), 1.0, 1e-6)){
+		throw std::runtime_error(__func__ + std::string(": checkered noise does not give the known error."));
+	}
+
+	const Image::pixel_type dark(0x4000, 0x2000, 0xffff);
+	const Image darker = generate(w, h, Luster(dark));
+	const Pixel<double> flat_index = Metrics(flat, darker).ssim();
+	if(!near(flat_index.R(), flat_ssim(gray.R(), dark.R()), 1e-3) || !near(flat_index.G(), flat_ssim(gray.G(), dark.G()), 1e-3) ||
+	   !near(flat_index.B(), flat_ssim(gray.B(), dark.B()), 1e-3)){
+		throw std::runtime_error(__func__ + std::string(": flat images do not give the luminance term."));
+	}
+
+	const column_t widths[] = {1, 1};
+	const row_t heights[] = {1, h};
+	for(std::size_t i = 0; i < 2; ++i){
+		const Image a = generate(widths[i], heights[i], Luster(gray));
+		const Image b = generate(widths[i], heights[i], Luster(dark));
+		const Metrics edge(a, b);
+		const Pixel<double> edge_psnr = edge.psnr(), edge_ssim = edge.ssim();
+		if(!near(edge_psnr.R(), expected_psnr(gray.R() - dark.R()), 1e-9) || !near(edge_psnr.B(), expected_psnr(dark.B() - gray.B()), 1e-9) ||
+		   !near(edge_ssim.G(), flat_ssim(gray.G(), dark.G()), 1e-3) || !infinite(Metrics(a, a).psnr().G()) ||
+		   !near(Metrics(a, a).ssim().B(), 1.0, 1e-6)){
+			throw std::runtime_error(__func__ + std::string(": edge-sized images do not give the known values."));
+		}
+	}
+	try{
+		Metrics(reference, flat.crop(0, 0, w - 1, h));
+		throw std::runtime_error(__func__ + std::string(": images of different sizes are compared."));
+	}catch(const std::invalid_argument&){
+	}
+	Image map(0, 0);
+	noise.ssim(&map);
+	return map;
+}
+
+static Image channel(column_t w, row_t h){return source(w, h) >> Channel(Channel::G);}
+static Image gray_scale(column_t w, row_t h){return source(w, h) >> GrayScale();}
+static Image threshold(column_t w, row_t h){return source(w, h) >> Threshold(0x7fff, Channel::R);}
+
+/**
+ * 並列実行中に投げられた例外が、スレッド数によらず元の型のまま呼び出し元へ届くことを確かめる。
+ */
+static Image threshold_invalid(column_t w, row_t h)
+{
+	ThreadPool& pool = ThreadPool::instance();
+	const std::size_t threads = pool.threads();
+	pool.set_threads(4);
+	const Image image = source(w, h);
+	try{
+		image >> Threshold(0x7fff, Channel::R | Channel::G);
+	}catch(const std::invalid_argument&){
+		pool.set_threads(threads);
+		return image;
+	}catch(...){
+		pool.set_threads(threads);
+		throw std::runtime_error(__func__ + std::string(": parallel task changed the exception type."));
+	}
+	pool.set_threads(threads);
+	throw std::runtime_error(__func__ + std::string(": invalid channel is accepted."));
+}
+static Image offset(column_t w, row_t h){return source(w, h) >> Offset(0xffff/5);}
+static Image offset_invert(column_t w, row_t h){return source(w, h) >> Offset(0xffff/5, true, Channel::B);}
+static Image reversal(column_t w, row_t h){return source(w, h) >> Reversal();}
+static Image gamma(column_t w, row_t h)
+{
+	std::vector<Image::pixel_type::value_type> lut(static_cast<std::size_t>(Image::pixel_type::max) + 1);
+	for(std::size_t i = 0; i < lut.size(); ++i){
+		lut[i] = static_cast<Image::pixel_type::value_type>(i*i/Image::pixel_type::max);
+	}
+	return source(w, h) >> Gamma(lut);
+}
+static Image gamma_srgb(column_t w, row_t h){return source(w, h) >> Gamma(TransferFunction::TF_SRGB, TransferFunction::TO_LINEAR);}
+static Image gamma_pq(column_t w, row_t h){return source(w, h) >> Gamma(TransferFunction::TF_PQ, TransferFunction::TO_SIGNAL);}
+static Image gamma_hlg(column_t w, row_t h){return source(w, h) >> Gamma(TransferFunction::TF_HLG, TransferFunction::TO_LINEAR, Channel::R | Channel::B);}
+static Image gamma_power(column_t w, row_t h){return source(w, h) >> Gamma(TransferFunction::TF_POWER, TransferFunction::TO_SIGNAL, Channel::G, 2.6);}
+/**
+ * TF_POWERの表は丸めた指数で共有され、キャッシュはpower_tables個を超えて増えないこと、
+ * 他の曲線の表は捨てられないこと、不正な指数では何もキャッシュされないことを確かめる。
+ */
+static Image transfer_function_cache(column_t w, row_t h)
+{
+	TransferFunction& cache = TransferFunction::instance();
+	const TransferFunction::table_type* const srgb = &cache.table(TransferFunction::TF_SRGB, TransferFunction::TO_SIGNAL);
+	const std::size_t base = cache.tables();
+	const TransferFunction::table_type power = TransferFunction::build(TransferFunction::TF_POWER, TransferFunction::TO_LINEAR, 1.8);
+	const TransferFunction::table_type& shared = cache.table(TransferFunction::TF_POWER, TransferFunction::TO_LINEAR, 1.8);
+	if(&shared != &cache.table(TransferFunction::TF_POWER, TransferFunction::TO_LINEAR, 1.8 + 1e-5) || shared != power){
+		throw std::runtime_error(__func__ + std::string(": close exponents do not share a table."));
+	}
+	for(std::size_t i = 0; i < 3*TransferFunction::power_tables; ++i){
+		cache.table(TransferFunction::TF_POWER, TransferFunction::TO_SIGNAL, 1.0 + 0.01*static_cast<double>(i));
+	}
+	if(base + TransferFunction::power_tables < cache.tables() ||
+	   srgb != &cache.table(TransferFunction::TF_SRGB, TransferFunction::TO_SIGNAL)){
+		throw std::runtime_error(__func__ + std::string(": power tables are not bounded."));
+	}
+	const std::size_t tables = cache.tables();
+	try{
+		cache.table(TransferFunction::TF_POWER, TransferFunction::TO_LINEAR, -1.0);
+		throw std::runtime_error(__func__ + std::string(": negative exponent is accepted."));
+	}catch(const std::invalid_argument&){
+	}
+	if(cache.tables() != tables){
+		throw std::runtime_error(__func__ + std::string(": failed build leaves a table."));
+	}
+	const Image image = source(w, h);
+	const Image result = image >> Gamma(TransferFunction::TF_POWER, TransferFunction::TO_LINEAR, Channel::R | Channel::B, 1.8);
+	if(ContentHash::digest(result) != ContentHash::digest(image >> Gamma(power, Channel::R | Channel::B))){
+		throw std::runtime_error(__func__ + std::string(": Gamma does not use the same table."));
+	}
+	return result;
+}
+class Half: public Channel{
+public:
+	Half(): Channel(Channel::R){}
+	virtual Image::pixel_type& convert(Image::pixel_type& pixel)const
+	{
+		pixel.R(static_cast<Image::pixel_type::value_type>(pixel.R()/2));
+		return pixel;
+	}
+	virtual Half* clone()const{return new Half(*this);}
+};
+static Image channel_subclass(column_t w, row_t h){return source(w, h) >> Half();}
+static Image channel_subclass_planar(column_t w, row_t h){return (PlanarImage(source(w, h)) >> Half()).image();}
+class HalfOffset: public Offset{
+public:
+	HalfOffset(): Offset(0xffff/3){}
+	virtual Image::pixel_type& convert(Image::pixel_type& pixel)const
+	{
+		pixel.G(static_cast<Image::pixel_type::value_type>(pixel.G()/2));
+		return pixel;
+	}
+	virtual HalfOffset* clone()const{return new HalfOffset(*this);}
+};
+static Image offset_subclass_planar(column_t w, row_t h){return (PlanarImage(source(w, h)) >> HalfOffset()).image();}
+static Image converter_chain(column_t w, row_t h)
+{
+	std::vector<Image::pixel_type::value_type> lut(static_cast<std::size_t>(Image::pixel_type::max) + 1);
+	for(std::size_t i = 0; i < lut.size(); ++i){
+		lut[i] = static_cast<Image::pixel_type::value_type>(i*i/Image::pixel_type::max);
+	}
+	ConverterChain chain;
+	chain << Offset(0xffff/7) << Reversal(Channel::R | Channel::G) << Gamma(lut) << GrayScale() << Offset(0xffff/9, true, Channel::B);
+	return source(w, h) >> chain;
+}
+
+/**
+ * 段は文ごとに追加した一時オブジェクトで、convertだけを定義した派生クラスは畳み込まれずに複製される。
+ * 複製したConverterChainも、1段ずつ変換した結果と一致することを確かめる。
+ */
+static Image converter_chain_subclass(column_t w, row_t h)
+{
+	ConverterChain chain;
+	chain << Offset(0xffff/7);
+	chain << HalfOffset();
+	chain << Half();
+	chain << Reversal(Channel::G);
+	if(chain.stages() != 4 || !chain.folded(0) || chain.folded(1) || chain.folded(2) || !chain.folded(3)){
+		throw std::runtime_error(__func__ + std::string(": subclass is folded into a table."));
+	}
+	const ConverterChain copy(chain);
+	chain = ConverterChain();
+	const Image image = source(w, h) >> copy;
+	if(ContentHash::digest(image) != ContentHash::digest(source(w, h) >> Offset(0xffff/7) >> HalfOffset() >> Half() >> Reversal(Channel::G))){
+		throw std::runtime_error(__func__ + std::string(": chain does not match the stages applied one by one."));
+	}
+	return image;
+}
+static Image lut3d(column_t w, row_t h)
+{
+	const int size = 17;
+	std::stringstream cube;
+	cube << "TITLE \"golden\"\nLUT_3D_SIZE " << size << "\n" << std::fixed << std::setprecision(6);
+	for(int b = 0; b < size; ++b){
+		for(int g = 0; g < size; ++g){
+			for(int r = 0; r < size; ++r){
+				const double x = r/(size - 1.0), y = g/(size - 1.0), z = b/(size - 1.0);
+				cube << x*x << " " << 0.6*y + 0.4*x*z << " " << 1.0 - z*(1.0 - y) << "\n";
+			}
+		}
+	}
+	return source(w, h) >> Lut3D(cube);
+}
+static Image tone(column_t w, row_t h){return source(w, h) >> Tone(Reversal(), Area(w/2, h/2, w/4, h/4));}
+/**
+ * ヒストグラムの度数、累積度数、CDF、最小、最大、百分位を総当たりの集計と照合する。
+ */
+static void check_histogram(const ImageView& view)
+{
+	const Histogram histogram(view);
+	const uint64_t total = static_cast<uint64_t>(view.width())*view.height();
+	std::vector<uint64_t> counts(3*static_cast<std::size_t>(Histogram::bins));
+	std::vector<std::vector<Histogram::value_type> > values(3);
+	for(row_t y = 0; y < view.height(); ++y){
+		for(column_t x = 0; x < view.width(); ++x){
+			const Image::pixel_type& pixel = view[y][x];
+			const Histogram::value_type samples[] = {pixel.R(), pixel.G(), pixel.B()};
+			for(std::size_t c = 0; c < 3; ++c){
+				++counts[c*Histogram::bins + samples[c]];
+				values[c].push_back(samples[c]);
+			}
+		}
+	}
+	if(histogram.total() != total){
+		throw std::runtime_error(__func__ + std::string(": total does not match."));
+	}
+	const double ratios[] = {0.0, 0.01, 0.25, 0.5, 0.9, 1.0};
+	for(byte_t c = 0; c < 3; ++c){
+		const uint64_t* const expected = &counts[static_cast<std::size_t>(c)*Histogram::bins];
+		uint64_t sum = 0;
+		for(std::size_t v = 0; v < Histogram::bins; ++v){
+			const Histogram::value_type value = static_cast<Histogram::value_type>(v);
+			sum += expected[v];
+			if(histogram.count(c, value) != expected[v] || histogram.cumulative(c, value) != sum ||
+			   1e-12 < std::fabs(histogram.cdf(c, value) - (total ? static_cast<double>(sum)/static_cast<double>(total) : 0.0))){
+				throw std::runtime_error(__func__ + std::string(": counts do not match."));
+			}
+		}
+		if(!total){
+			continue;
+		}
+		std::sort(values[c].begin(), values[c].end());
+		if(histogram.min(c) != values[c].front() || histogram.max(c) != values[c].back()){
+			throw std::runtime_error(__func__ + std::string(": min/max does not match."));
+		}
+		for(std::size_t i = 0; i < sizeof(ratios)/sizeof(ratios[0]); ++i){
+			const uint64_t position = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(ratios[i]*static_cast<double>(total))));
+			if(histogram.percentile(c, ratios[i]) != values[c][position - 1]){
+				throw std::runtime_error(__func__ + std::string(": percentile does not match."));
+			}
+		}
+	}
+}
+
+/**
+ * 4スレッドで、画像全体、一部を指すビュー、高さがスレッド数に満たない帯、空のビューを集計する。
+ */
+static Image histogram(column_t w, row_t h)
+{
+	Image image = source(w, h) >> Offset(0x0123);
+	image[h/2][w/2] = Image::pixel_type(0, Image::pixel_type::max, 0x7fff);
+	ThreadPool& pool = ThreadPool::instance();
+	const std::size_t threads = pool.threads();
+	pool.set_threads(4);
+	try{
+		const ImageView view = image.view();
+		check_histogram(view);
+		check_histogram(view.view(w/3, h/4, w/2, h/3));
+		check_histogram(view.view(1, 2, w - 3, 1));
+		check_histogram(view.view(0, 0, w, 3));
+		check_histogram(view.view(0, h - 5, w, 5));
+		check_histogram(view.view(w/2, h/2, 0, 4));
+	}catch(...){
+		pool.set_threads(threads);
+		throw;
+	}
+	pool.set_threads(threads);
+	return image;
+}
+/**
+ * viewから作った表の和、二乗和、平均、分散のO(1)問い合わせを、
+ * 各矩形内の画素を総当たりで集計した値と照合する。
+ */
+static void check_integral(const ImageView& view, const Area* areas, std::size_t count)
+{
+	const IntegralImage integral(view);
+	for(std::size_t i = 0; i < count; ++i){
+		const Area& area = areas[i];
+		const Pixel<double> mean = integral.mean(area.offset_x_, area.offset_y_, area.width_, area.height_);
+		const Pixel<double> variance = integral.variance(area.offset_x_, area.offset_y_, area.width_, area.height_);
+		const double means[] = {mean.R(), mean.G(), mean.B()};
+		const double variances[] = {variance.R(), variance.G(), variance.B()};
+		const uint64_t n = static_cast<uint64_t>(area.width_)*area.height_;
+		for(byte_t c = 0; c < 3; ++c){
+			std::vector<double> values;
+			uint64_t sum = 0, squared_sum = 0;
+			for(row_t y = area.offset_y_; y < area.offset_y_ + area.height_; ++y){
+				for(column_t x = area.offset_x_; x < area.offset_x_ + area.width_; ++x){
+					const Image::pixel_type& pixel = view[y][x];
+					const uint64_t value = c == 0 ? pixel.R() : c == 1 ? pixel.G() : pixel.B();
+					sum += value;
+					squared_sum += value*value;
+					values.push_back(static_cast<double>(value));
+				}
+			}
+			const double expected_mean = n ? static_cast<double>(sum)/static_cast<double>(n) : 0.0;
+			double deviation = 0.0;
+			for(std::size_t v = 0; v < values.size(); ++v){
+				deviation += (values[v] - expected_mean)*(values[v] - expected_mean);
+			}
+			const double expected_variance = n ? deviation/static_cast<double>(n) : 0.0;
+			if(integral.sum(c, area.offset_x_, area.offset_y_, area.width_, area.height_) != sum ||
+			   integral.squared_sum(c, area.offset_x_, area.offset_y_, area.width_, area.height_) != squared_sum){
+				throw std::runtime_error(__func__ + std::string(": sums do not match."));
+			}
+			if(1e-9*(1.0 + expected_mean) < std::fabs(means[c] - expected_mean) ||
+			   1e-9*(1.0 + expected_mean*expected_mean) < std::fabs(variances[c] - expected_variance)){
+				throw std::runtime_error(__func__ + std::string(": mean/variance does not match."));
+			}
+		}
+	}
+}
+
+static bool squared_sum_rejected(const Image& image)
+{
+	const IntegralImage integral(image, false);
+	try{
+		integral.squared_sum(0, 0, 0, image.width(), image.height());
+	}catch(const std::runtime_error&){
+		return true;
+	}
+	return false;
+}
+
+/**
+ * 画像全体、四隅の1画素、右端の列、下端の行、内側の矩形、空の矩形と、一部を指すビューから作った表を確かめる。
+ */
+static Image integral_image(column_t w, row_t h)
+{
+	Image image = (source(w, h) & generate(w, h, Checker())) | (generate(w, h, ColorBar()) >> 2);
+	image[0][0] = white;
+	image[h - 1][w - 1] = white;
+	const ImageView view = image.view();
+	const Area areas[] = {
+		Area(w, h, 0, 0),
+		Area(1, 1, 0, 0), Area(1, 1, w - 1, 0), Area(1, 1, 0, h - 1), Area(1, 1, w - 1, h - 1),
+		Area(1, h, w - 1, 0), Area(w, 1, 0, h - 1),
+		Area(w/2, h/2, w/5, h/3),
+		Area(0, 0, w, h), Area(0, h, w/2, 0),
+	};
+	check_integral(view, areas, sizeof(areas)/sizeof(areas[0]));
+	const ImageView roi = view.view(w/4, h/5, w/2 + 1, h/2 + 1);
+	const Area roi_areas[] = {
+		Area(roi.width(), roi.height(), 0, 0),
+		Area(1, 1, roi.width() - 1, roi.height() - 1),
+		Area(roi.width() - 2, roi.height() - 2, 1, 1),
+	};
+	check_integral(roi, roi_areas, sizeof(roi_areas)/sizeof(roi_areas[0]));
+	if(!squared_sum_rejected(image)){
+		throw std::runtime_error(__func__ + std::string(": squared sum without table is accepted."));
+	}
+	return image;
+}
+
+static Image normalize(column_t w, row_t h){return (source(w, h) >>= 2) >> Normalize();}
+static Image median(column_t w, row_t h){return generate(w, h, Checker()) >> Median();}
+static Image crop(column_t w, row_t h){return source(w, h) >> Crop(Area(w/2, h/2, w/3, h/5));}
+static Image dither_bayer(column_t w, row_t h){return source(w, h) >> Dither(4, Dither::DITHER_BAYER);}
+static Image dither_blue_noise(column_t w, row_t h){return source(w, h) >> Dither(3, Dither::DITHER_BLUE_NOISE);}
+static Image dither_floyd_steinberg(column_t w, row_t h){return source(w, h) >> Dither(5, Dither::DITHER_FLOYD_STEINBERG);}
+static Image dither_jarvis(column_t w, row_t h){return source(w, h) >> Dither(2, Dither::DITHER_JARVIS);}
+static Image weighted_smoothing(column_t w, row_t h){return generate(w, h, ColorBar()) >> WeightedSmoothing();}
+static Image unsharp_mask(column_t w, row_t h){return generate(w, h, ColorBar()) >> UnSharpMask();}
+static Image prewitt(column_t w, row_t h){return (source(w, h) >>= 12) >> Prewitt();}
+static Image sobel(column_t w, row_t h){return (source(w, h) >>= 12) >> Sobel();}
+static Image laplacian3x3(column_t w, row_t h){return (source(w, h) >>= 12) >> Laplacian3x3();}
+static Image laplacian5x5(column_t w, row_t h){return (source(w, h) >>= 12) >> Laplacian5x5();}
+static Image box_blur(column_t w, row_t h){return generate(w, h, ColorBar()) >> BoxBlur(w/16, h/9 + 1);}
+static Image hscale(column_t w, row_t h){return generate(w, h, ColorBar()) >> HScale(w*2/3 + 1);}
+static Image vscale(column_t w, row_t h){return generate(w, h, StairStepV()) >> VScale(h*3/2);}
+static Image key_stone_top_left(column_t w, row_t h){return source(w, h) >> KeyStone(KeyStone::TOP_LEFT, w/5, h/7);}
+static Image key_stone_top_right(column_t w, row_t h){return source(w, h) >> KeyStone(KeyStone::TOP_RIGHT, w/5, h/7);}
+static Image key_stone_bottom_left(column_t w, row_t h){return source(w, h) >> KeyStone(KeyStone::BOTTOM_LEFT, w/5, h/7);}
+static Image key_stone_bottom_right(column_t w, row_t h){return source(w, h) >> KeyStone(KeyStone::BOTTOM_RIGHT, w/5, h/7);}
+static Image ycbcr(column_t w, row_t h){return ColorConversion(Image::pixel_type::CS_YCBCR_BT709).from_rgb(source(w, h));}
+static Image ycbcr_rgb(column_t w, row_t h){return ColorConversion(Image::pixel_type::CS_YCBCR_BT2020).to_rgb(source(w, h));}
+static Image ycbcr_fixed(column_t w, row_t h){return ColorConversion(Image::pixel_type::CS_YCBCR_BT601, ColorConversion::PREC_FIXED).from_rgb(source(w, h));}
+static Image ycbcr_fixed_rgb(column_t w, row_t h){return ColorConversion(Image::pixel_type::CS_YCBCR_BT601, ColorConversion::PREC_FIXED).to_rgb(source(w, h));}
+static Image hsv(column_t w, row_t h){return ColorConversion(Image::pixel_type::CS_HSV).from_rgb(generate(w, h, ColorBar()));}
+static Image hsv_fixed(column_t w, row_t h){return ColorConversion(Image::pixel_type::CS_HSV, ColorConversion::PREC_FIXED).from_rgb(source(w, h));}
+static Image hsv_rgb(column_t w, row_t h){return ColorConversion(Image::pixel_type::CS_HSV).to_rgb(source(w, h));}
+static Image xyz(column_t w, row_t h){return ColorConversion(Image::pixel_type::CS_XYZ).to_rgb(source(w, h));}
+static Image bit_mask(column_t w, row_t h)
+{
+	const Image image = source(w, h);
+	Image result(0, 0);
+	result = image & Image::pixel_type(0xf000, 0xfc00, 0xff00);
+	return result;
+}
+static Image bit_blend(column_t w, row_t h)
+{
+	const Image a = source(w, h);
+	const Image b = generate(w, h, ColorBar());
+	Image result(0, 0);
+	result = ((a & b) | (b << 3)) >> 1;
+	return result;
+}
+
+/**
+ * 期待値の画像を1画素ずつ組み立てるために、tileを(x, y)へ書き写す。
+ */
+static void paste(Image& canvas, const Image& tile, column_t x, row_t y)
+{
+	for(row_t r = 0; r < tile.height(); ++r){
+		for(column_t c = 0; c < tile.width(); ++c){
+			canvas[y + r][x + c] = tile[r][c];
+		}
+	}
+}
+
+static void check_composite(const Image& result, const Image& expected, const char* message)
+{
+	if(result.width() != expected.width() || result.height() != expected.height() ||
+	   ContentHash::digest(result) != ContentHash::digest(expected)){
+		throw std::runtime_error("compositor: " + std::string(message));
+	}
+}
+
+/**
+ * 大きさの揃わない格子、背景の塗りつぶし、位置指定の重ね合わせ、空のCompositorを確かめ、
+ * 隙間のない格子はoperator()で連結した画像と一致することを確かめる。
+ */
+static Image compositor(column_t w, row_t h)
+{
+	const Image a = source(w/3, h/2);
+	const Image b = generate(w/4, h/3, ColorBar());
+	const Image c = generate(w/2, h/4, Checker());
+	const Image d = source(w/5, h/2 + 1);
+	const Image e = generate(w/3, h/5, Luster(red));
+	const Image f = generate(w/4, h/4, Ramp());
+
+	Compositor grid(3);
+	grid << a << b << c << d << e;
+	grid.add(f, w/2, h/2);
+	const Image result = grid.compose(blue);
+	Image expected(w/3 + w/3 + w/2, h/2 + h/2 + 1);
+	expected <<= Luster(blue);
+	paste(expected, a, 0, 0);
+	paste(expected, b, w/3, 0);
+	paste(expected, c, w/3 + w/3, 0);
+	paste(expected, d, 0, h/2);
+	paste(expected, e, w/3, h/2);
+	paste(expected, f, w/2, h/2);
+	check_composite(result, expected, "uneven grid does not match.");
+
+	const Image g = generate(w/4, h/3 + 1, Checker(true));
+	Compositor positioned;
+	positioned.add(a, 1, 2).add(g, w/4, h/4).add(b, w/2, 0);
+	Image overlapped(std::max(w/4 + w/4, w/2 + w/4), std::max(2 + h/2, h/4 + h/3 + 1));
+	overlapped <<= Luster(green);
+	paste(overlapped, a, 1, 2);
+	paste(overlapped, g, w/4, h/4);
+	paste(overlapped, b, w/2, 0);
+	check_composite(positioned.compose(green), overlapped, "positioned tiles do not match.");
+
+	const Image q0 = source(w/2, h/2), q1 = generate(w/2, h/2, ColorBar());
+	const Image q2 = generate(w/2, h/2, StairStepH()), q3 = generate(w/2, h/2, Checker());
+	check_composite((Compositor(2) << q0 << q1 << q2 << q3).compose(red),
+	                q0(q1, Image::ORI_HORI)(q2(q3, Image::ORI_HORI), Image::ORI_VERT), "2x2 grid differs from joins.");
+	check_composite((Compositor(3) << q0 << a << d.crop(0, 1, w/5, h/2)).compose(red),
+	                q0(a, Image::ORI_HORI)(d.crop(0, 1, w/5, h/2), Image::ORI_HORI), "single row differs from joins.");
+	check_composite((Compositor(1) << a << source(w/3, h/5)).compose(red),
+	                a(source(w/3, h/5), Image::ORI_VERT), "single column differs from joins.");
+
+	const Image empty = Compositor().compose();
+	const Image empty_grid = Compositor(4).compose();
+	if(empty.width() || empty.height() || empty_grid.width() || empty_grid.height() || Compositor(2).size()){
+		throw std::runtime_error(__func__ + std::string(": empty compositor is not empty."));
+	}
+	try{
+		Compositor().add(a);
+		throw std::runtime_error(__func__ + std::string(": grid without columns accepts an image."));
+	}catch(const std::invalid_argument&){
+	}
+	return result;
+}
+
+/**
+ * 代入先を右辺の複数の深さで参照する3段の式を、上書き前の値から1画素ずつ求めた結果と照合する。
+ * 作業領域の各段が互いに重ならず、別名の行も上書き前に退避されることを確かめる。
+ */
+static Image bit_alias(column_t w, row_t h)
+{
+	const Image a = source(w, h);
+	const Image b = generate(w, h, ColorBar());
+	Image result = a >> 3;
+	const Image before = result >> 0;
+	result = (a | (b & result)) & ((result >> 1) | (b & (a << 2)));
+	for(row_t y = 0; y < h; ++y){
+		for(column_t x = 0; x < w; ++x){
+			const unsigned as[] = {a[y][x].R(), a[y][x].G(), a[y][x].B()};
+			const unsigned bs[] = {b[y][x].R(), b[y][x].G(), b[y][x].B()};
+			const unsigned olds[] = {before[y][x].R(), before[y][x].G(), before[y][x].B()};
+			const unsigned news[] = {result[y][x].R(), result[y][x].G(), result[y][x].B()};
+			for(std::size_t c = 0; c < 3; ++c){
+				const unsigned expected = (as[c] | (bs[c] & olds[c])) & ((olds[c] >> 1) | (bs[c] & ((as[c] << 2) & 0xffffu)));
+				if(news[c] != expected){
+					throw std::runtime_error(__func__ + std::string(": aliased expression does not use the old values."));
+				}
+			}
+		}
+	}
+	return result;
+}
+
+static const struct{
+	const char* name;
+	Image (*render)(column_t, row_t);
+}cases[] = {
+	{"ColorBar",             color_bar},
+	{"Luster",               luster},
+	{"Checker",              checker},
+	{"CheckerInvert",        checker_invert},
+	{"StairStepH",           stair_step_h},
+	{"StairStepV",           stair_step_v},
+	{"Ramp",                 ramp},
+	{"CrossHatch",           cross_hatch},
+	{"Character",            character},
+	{"Line",                 line},
+	{"Circle",               circle},
+	{"Ring",                 ring},
+	{"Image8PNG",            image8_png},
+	{"ImageFPNG",            imagef_png},
+	{"TiledColorBar",        tiled_color_bar},
+	{"TiledChecker",         tiled_checker},
+	{"TiledStairStepH",      tiled_stair_step_h},
+	{"TiledStairStepV",      tiled_stair_step_v},
+	{"TiledRamp",            tiled_ramp},
+	{"TiledCrossHatch",      tiled_cross_hatch},
+	{"TiledPNG",             tiled_png},
+	{"RawUnaligned",         raw_unaligned},
+	{"CopyIsolation",        copy_isolation},
+	{"FramePool",            frame_pool},
+	{"RawLayouts",           raw_layouts},
+	{"Channel",              channel},
+	{"GrayScale",            gray_scale},
+	{"Threshold",            threshold},
+	{"ThresholdInvalid",     threshold_invalid},
+	{"CIEDE2000",            ciede2000},
+	{"Metrics",              metrics},
+	{"Offset",               offset},
+	{"OffsetInvert",         offset_invert},
+	{"Reversal",             reversal},
+	{"Gamma",                gamma},
+	{"GammaSRGB",            gamma_srgb},
+	{"GammaPQ",              gamma_pq},
+	{"GammaHLG",             gamma_hlg},
+	{"GammaPower",           gamma_power},
+	{"TransferFunctionCache", transfer_function_cache},
+	{"ChannelSubclass",      channel_subclass},
+	{"ChannelSubclassPlanar", channel_subclass_planar},
+	{"OffsetSubclassPlanar", offset_subclass_planar},
+	{"ConverterChain",       converter_chain},
+	{"ConverterChainSubclass", converter_chain_subclass},
+	{"Lut3D",                lut3d},
+	{"Tone",                 tone},
+	{"Histogram",            histogram},
+	{"IntegralImage",        integral_image},
+	{"Normalize",            normalize},
+	{"Median",               median},
+	{"Crop",                 crop},
+	{"DitherBayer",          dither_bayer},
+	{"DitherBlueNoise",      dither_blue_noise},
+	{"DitherFloydSteinberg", dither_floyd_steinberg},
+	{"DitherJarvis",         dither_jarvis},
+	{"WeightedSmoothing",    weighted_smoothing},
+	{"UnSharpMask",          unsharp_mask},
+	{"Prewitt",              prewitt},
+	{"Sobel",                sobel},
+	{"Laplacian3x3",         laplacian3x3},
+	{"Laplacian5x5",         laplacian5x5},
+	{"BoxBlur",              box_blur},
+	{"HScale",               hscale},
+	{"VScale",               vscale},
+	{"KeyStoneTopLeft",      key_stone_top_left},
+	{"KeyStoneTopRight",     key_stone_top_right},
+	{"KeyStoneBottomLeft",   key_stone_bottom_left},
+	{"KeyStoneBottomRight",  key_stone_bottom_right},
+	{"YCbCr",                ycbcr},
+	{"YCbCrToRGB",           ycbcr_rgb},
+	{"YCbCrFixed",           ycbcr_fixed},
+	{"YCbCrFixedToRGB",      ycbcr_fixed_rgb},
+	{"HSV",                  hsv},
+	{"HSVFixed",             hsv_fixed},
+	{"HSVToRGB",             hsv_rgb},
+	{"XYZToRGB",             xyz},
+	{"BitMask",              bit_mask},
+	{"BitBlend",             bit_blend},
+	{"BitAlias",             bit_alias},
+	{"Compositor",           compositor},
+};
+
+static const struct{
+	column_t width;
+	row_t height;
+}sizes[] = {
+	{  64,  36},
+	{ 258, 131},
+	{ 640, 360},
+};
+
+int main(int argc, char* argv[])
+{
+	const bool update = 1 < argc && !std::strcmp(argv[1], "--update");
+
+	std::map<std::string, std::string> golden;
+	std::ifstream ifs(manifest);
+	for(std::string key, hash; ifs >> key >> hash;){
+		golden[key] = hash;
+	}
+
+	std::ostringstream oss;
+	int failures = 0;
+	for(std::size_t i = 0; i < sizeof(cases)/sizeof(cases[0]); ++i){
+		for(std::size_t j = 0; j < sizeof(sizes)/sizeof(sizes[0]); ++j){
+			std::ostringstream key;
+			key << cases[i].name << '@' << sizes[j].width << 'x' << sizes[j].height;
+			const std::string hash = ContentHash::hex(ContentHash::digest(cases[i].render(sizes[j].width, sizes[j].height)));
+			oss << key.str() << ' ' << hash << std::endl;
+			if(!update && golden[key.str()] != hash){
+				std::cerr << key.str() << ": expected " << (golden[key.str()].empty() ? "(none)" : golden[key.str()]) << ", got " << hash << std::endl;
+				++failures;
+			}
+		}
+	}
+
+	if(update){
+		std::ofstream ofs(manifest);
+		ofs << oss.str();
+		return ofs ? 0 : 1;
+	}
+	return failures ? 1 : 0;
+}
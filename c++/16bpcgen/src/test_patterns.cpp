@@ -13,7 +13,7 @@ int main(void)
 	const column_t width  = 1920;
 	const row_t    height = 1080;
 
-	Image(width, height) << Luster(white) << TypeWriter(__FILE__, black) >> "./img/sourcecode.png";
+	(Image(width, height) << Luster(white) <<= TypeWriter(__FILE__, black)) >> "./img/sourcecode.png";
 
 	Image image(width, height);
 	image << ColorBar()               >> "./img/colorbar.png";
@@ -34,12 +34,12 @@ int main(void)
 	image << StairStepV(1, 20, false) >> "./img/stairstepV2.png";
 	image << StairStepV(1, 20, true)  >> "./img/stairstepV3.png";
 	image << Ramp()                   >> "./img/ramp.png";
-	image << Luster(black)
-			<< CrossHatch(width/10, height/10)   >> "./img/crosshatch.png";
-	image << Luster(black)
-			<< Character(" !\"#$%&'()*+,-./\n"
+	(image << Luster(black)
+			<<= CrossHatch(width/10, height/10))  >> "./img/crosshatch.png";
+	(image << Luster(black)
+			<<= Character(" !\"#$%&'()*+,-./\n"
 						"0123456789:;<=>?@\nABCDEFGHIJKLMNO\nPQRSTUVWXYZ[\\]^_`\n"
-						"abcdefghijklmno\npqrstuvwxyz{|}~", red, 10) >> "./img/character.png";
+						"abcdefghijklmno\npqrstuvwxyz{|}~", red, 10)) >> "./img/character.png";
 #if 201103L <= __cplusplus
 	image << WhiteNoise() >> "./img/whitenoise.png";
 #endif